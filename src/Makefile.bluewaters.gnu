@@ -27,19 +27,50 @@
 CUDA_HOME = $(subst bin/nvcc,,$(shell which nvcc))
 
 CC 	= cc
-CFLAGS	= -O3 -g
-GFLAGS	= $(CUDA_HOME)bin/nvcc -use_fast_math -arch=sm_35
+CXX	= CC
+# spatial order of the stencils, 4 or 8
+FD_ORDER = 4
+CFLAGS	= -O3 -g -DFD_ORDER=$(FD_ORDER)
+GFLAGS	= $(CUDA_HOME)bin/nvcc -use_fast_math -arch=sm_35 -DFD_ORDER=$(FD_ORDER)
+OMPFLAGS = -fopenmp
 
 INCDIR  = -I$(CUDA_HOME)include
-OBJECTS	= command.o pmcl3d.o grid.o source.o mesh.o cerjan.o swap.o kernel.o io.o
-LIB	= -lm -ldl -L$(CUDA_HOME)lib64 -lcudart -lstdc++
+OBJECTS	= command.o sim.o grid.o source.o mesh.o cerjan.o swap.o kernel.o io.o mask.o sink.o iohints.o kernel_cpu.o drm.o monitor.o halo.o frame.o mediacache.o log.o
+LIB	= -lm -lz -ldl -L$(CUDA_HOME)lib64 -lcudart -lstdc++
 
-pmcl3d:	$(OBJECTS)
-	$(CC) $(CFLAGS) $(INCDIR) -o	pmcl3d	$(OBJECTS)	$(LIB)
+pmcl3d:	pmcl3d.o libpmcl3d.a
+	$(CC) $(CFLAGS) $(OMPFLAGS) $(INCDIR) -o	pmcl3d	pmcl3d.o libpmcl3d.a	$(LIB)
+
+# simulation library for embedding, see pmcl3d_api.h
+libpmcl3d.a:	$(OBJECTS)
+	ar rcs libpmcl3d.a $(OBJECTS)
+
+# post-processor for the SX/SY/SZ output
+postproc:	postproc.o command.o io.o grid.o
+	$(CC) $(CFLAGS) $(OMPFLAGS) $(INCDIR) -o	postproc	postproc.o command.o io.o grid.o	$(LIB)
+
+# converted media cache for one decomposition, mpirun -np PX*PY mediapart <pmcl3d options>
+mediapart:	mediapart.o libpmcl3d.a
+	$(CC) $(CFLAGS) $(OMPFLAGS) $(INCDIR) -o	mediapart	mediapart.o libpmcl3d.a	$(LIB)
+
+# many small runs in one allocation, mpirun -np 1+N jobpack <job list>
+jobpack:	jobpack.o libpmcl3d.a
+	$(CC) $(CFLAGS) $(OMPFLAGS) $(INCDIR) -o	jobpack	jobpack.o libpmcl3d.a	$(LIB)
+
+# weak/strong scaling study under a local mpirun, e.g. make scaling SCALING="--decomp 1x1,2x2"
+scaling:	pmcl3d
+	python scaling.py --exe ./pmcl3d $(SCALING)
+
+# reference consumer of the --SINK output stream
+sinkreader:	sinkreader.cpp sink.h
+	$(CXX) $(CFLAGS) -o	sinkreader	sinkreader.cpp
 
 pmcl3d.o:	pmcl3d.c
 	$(CC) $(CFLAGS) $(INCDIR) -c -o pmcl3d.o	pmcl3d.c
 
+sim.o:		sim.c pmcl3d_api.h
+	$(CC) $(CFLAGS) $(INCDIR) -c -o sim.o		sim.c
+
 command.o:	command.c
 	$(CC) $(CFLAGS) $(INCDIR) -c -o	command.o	command.c
 
@@ -47,7 +78,7 @@ io.o:	  io.c
 	$(CC) $(CFLAGS) $(INCDIR) -c -o	io.o	  io.c
 
 grid.o:		grid.c
-	$(CC) $(CFLAGS) $(INCDIR) -c -o grid.o		grid.c
+	$(CC) $(CFLAGS) $(OMPFLAGS) $(INCDIR) -c -o grid.o		grid.c
 
 source.o:	source.c
 	$(CC) $(CFLAGS) $(INCDIR) -c -o source.o	source.c
@@ -61,8 +92,47 @@ cerjan.o:	cerjan.c
 swap.o:		swap.c
 	$(CC) $(CFLAGS) $(INCDIR) -c -o swap.o		swap.c
 
+mask.o:		mask.c
+	$(CC) $(CFLAGS) $(INCDIR) -c -o mask.o		mask.c
+
+postproc.o:	postproc.c
+	$(CC) $(CFLAGS) $(INCDIR) -c -o postproc.o	postproc.c
+
+sink.o:		sink.c sink.h
+	$(CC) $(CFLAGS) $(INCDIR) -c -o sink.o		sink.c
+
+iohints.o:	iohints.c
+	$(CC) $(CFLAGS) $(INCDIR) -c -o iohints.o	iohints.c
+
+kernel_cpu.o:	kernel_cpu.c
+	$(CC) $(CFLAGS) $(OMPFLAGS) $(INCDIR) -c -o kernel_cpu.o	kernel_cpu.c
+
+drm.o:		drm.c
+	$(CC) $(CFLAGS) $(INCDIR) -c -o drm.o		drm.c
+
+monitor.o:	monitor.c
+	$(CC) $(CFLAGS) $(OMPFLAGS) $(INCDIR) -c -o monitor.o	monitor.c
+
+halo.o:		halo.c
+	$(CC) $(CFLAGS) $(INCDIR) -c -o halo.o		halo.c
+
+frame.o:	frame.c
+	$(CC) $(CFLAGS) $(INCDIR) -c -o frame.o	frame.c
+
+mediacache.o:	mediacache.c
+	$(CC) $(CFLAGS) $(INCDIR) -c -o mediacache.o	mediacache.c
+
+log.o:		log.c
+	$(CC) $(CFLAGS) $(INCDIR) -c -o log.o		log.c
+
+mediapart.o:	mediapart.c
+	$(CC) $(CFLAGS) $(INCDIR) -c -o mediapart.o	mediapart.c
+
+jobpack.o:	jobpack.c pmcl3d_api.h
+	$(CC) $(CFLAGS) $(INCDIR) -c -o jobpack.o	jobpack.c
+
 kernel.o:	kernel.cu
 	$(GFLAGS) $(INCDIR) -c -o	kernel.o	kernel.cu
 
 clean:
-	rm -f *.o pmcl3d
+	rm -f *.o libpmcl3d.a pmcl3d postproc mediapart jobpack sinkreader
@@ -72,3 +72,15 @@ void inicrj(float ARBC, int *coords, int nxt, int nyt, int nzt, int NX, int NY,
   }
   return;
 }
+
+// round-trip amplitude of a wave at vp crossing the ND sponge points and back, it is
+// damped by exp(-(alpha*m)^2) once per step for DH/(vp*DT) steps at point m
+float crjrefl(float ARBC, int ND, float DH, float DT, float vp)
+{
+  double sum;
+
+  if(ND<=0)
+     return 1.0;
+  sum = (ND+1.0)*(2.0*ND+1.0)/(6.0*ND);      // sum_m (m/ND)^2, m = 1..ND
+  return exp(2.0*log(ARBC)*sum*DH/(vp*DT));
+}
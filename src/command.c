@@ -60,6 +60,46 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 *  INVEL        <STRING>                      mesh input file                                                  *
 *  INSRC_I2     <STRING>                      split source input file prefix for IFAULT=2 option               *
 *  CHKFILE      <STRING>      -c              Checkpoint statistics file to write to                           *
+*  MASK         <STRING>                      surface mask file for sparse output (empty for none)             *
+*  MASKTYPE     <INTEGER>                     mask file format (0=raster of rec_NX*rec_NY bytes, 1=polygon)    *
+*  SINK         <STRING>                      Unix socket of a local output consumer (empty for none)          *
+*  SINKMODE     <INTEGER>                     0=stream and write files, 1=stream only                          *
+*  IOHINTS      <STRING>                      MPI-IO hints file, [media] and [output] sections (empty: none)   *
+*  IOTUNE       <INTEGER>                     >0: benchmark output hints with IOTUNE repetitions and exit      *
+*  CPU          <INTEGER>                     0=CUDA kernels, 1=host kernels with fused velocity/stress sweep  *
+*  CPUTILE      <INTEGER>                     column tile edge of the host kernels (0=from cache size)         *
+*  FDCOEF       <INTEGER>                     stencil coefficients of order FD_ORDER, 0=Taylor, 1=DRP          *
+*  DRMREC       <STRING>                      domain reduction: record the DRMBOX boundary field to this file  *
+*  DRMIN        <STRING>                      domain reduction: inject the boundary field of this file         *
+*  DRMBOX       <STRING>                      recorded box "x0,x1,y0,y1,z1" (m), open at the free surface      *
+*  DRMORIGIN    <STRING>                      "x,y" (m) of the first grid point in the frame of DRMIN          *
+*  DRMSKIP      <INTEGER>                     time steps per record of DRMREC                                  *
+*  MONITOR      <INTEGER>                     health check every MONITOR steps: energy, |v|, NaN/Inf (0=off)   *
+*  MONACTION    <INTEGER>                     on instability 0=report, 1=stop cleanly, 2=MPI_Abort             *
+*  MONGROW      <FLOAT>                       kinetic energy growth between checks that flags instability      *
+*  HEARTBEAT    <STRING>                      heartbeat file rewritten at every check (empty for none)         *
+*  ENDTOL       <FLOAT>                       end the run when the ENDMODE metric drops below ENDTOL*peak      *
+*  ENDWIN       <INTEGER>                     time steps of the sliding window of the ENDTOL criterion         *
+*  ENDMODE      <INTEGER>                     ENDTOL metric: 0=energy in recorded region, 1=surface PGV        *
+*  SRCDT        <FLOAT>                       sample interval of a coarse source file (s), 0 = DT              *
+*  SRCINTERP    <INTEGER>                     SRCDT interpolation: 1=linear, 3=cubic (Catmull-Rom)             *
+*  HALOFMT      <INTEGER>                     halo messages: 0=fp32, 1=fp16, 2=bf16, 3=int16 scaled per plane  *
+*  FRAMES       <INTEGER>                     time steps between surface |v| movie frames, 0 = none            *
+*  FRAMESKIP    <INTEGER>                     frame pixel every FRAMESKIP surface points in x and y            *
+*  FRAMEVMAX    <FLOAT>                       frame colour scale top |v| (m/s), 0 = auto per frame             *
+*  FRAMEFMT     <INTEGER>                     frame files: 0=PNG, 1=raw 8-bit                                  *
+*  FRAMEOUT     <STRING>                      frame file prefix, _<step>.png or _<step>.raw appended           *
+*  AUTO         <INTEGER>                     DH/DT/ND from FMAX and PPW: 0=off, 1=report, 2=apply DT and ND   *
+*  FMAX         <FLOAT>                       AUTO highest frequency to resolve (Hz)                           *
+*  PPW          <FLOAT>                       AUTO grid points per minimum S wavelength                        *
+*  COURANT      <FLOAT>                       AUTO target vp*dt/dh, 0 = 90% of the stability limit             *
+*  REFL         <FLOAT>                       AUTO target round-trip amplitude of the Cerjan sponge            *
+*  MEDIACACHE   <STRING>                      directory of converted media from mediapart, "" = none           *
+*  CPUBRICK     <INTEGER>                     host fields in b x b column bricks, 0 = flat layout              *
+*  CPUREC       <INTEGER>                     1 = host fields interleaved in one record per column             *
+*  LOGLEVEL     <INTEGER>                     stdout level: 0=errors, 1=summary, 2=per-rank detail, 3=debug    *
+*  LOGRANKS     <STRING>                      ranks printing per-rank messages, e.g. "0-3,17" or "all"         *
+*  LOGDIR       <STRING>                      directory of per-node logs of every level, "" = none             *
 ****************************************************************************************************************
 */
 
@@ -125,7 +165,48 @@ const char  def_INSRC_I2[50]  = "input_rst/srcpart/split_faults/fault";
 
 const char  def_CHKFILE[50]   = "output_ckp/CHKP";
 
-void command(int argc,    char **argv,
+const char  def_MASK[50]      = "";
+const int   def_MASKTYPE      = 0;
+const char  def_SINK[50]      = "";
+const int   def_SINKMODE      = 0;
+const char  def_IOHINTS[50]   = "";
+const int   def_IOTUNE        = 0;
+const int   def_CPU           = 0;
+const int   def_CPUTILE       = 0;
+const int   def_FDCOEF        = 0;
+const char  def_DRMREC[50]    = "";
+const char  def_DRMIN[50]     = "";
+const char  def_DRMBOX[50]    = "";
+const char  def_DRMORIGIN[50] = "";
+const int   def_DRMSKIP       = 1;
+const int   def_MONITOR       = 0;
+const int   def_MONACTION     = 1;
+const float def_MONGROW       = 10.0;
+const char  def_HEARTBEAT[50] = "";
+const float def_ENDTOL        = 0.0;
+const int   def_ENDWIN        = 1000;
+const int   def_ENDMODE       = 0;
+const float def_SRCDT         = 0.0;
+const int   def_SRCINTERP     = 3;
+const int   def_HALOFMT       = 0;
+const int   def_FRAMES        = 0;
+const int   def_FRAMESKIP     = 1;
+const float def_FRAMEVMAX     = 0.0;
+const int   def_FRAMEFMT      = 0;
+const char  def_FRAMEOUT[50]  = "output_sfc/frame";
+const int   def_AUTO          = 0;
+const float def_FMAX          = 0.0;
+const float def_PPW           = 5.0;
+const float def_COURANT       = 0.0;
+const float def_REFL          = 0.01;
+const char  def_MEDIACACHE[50] = "";
+const int   def_CPUBRICK      = 0;
+const int   def_CPUREC        = 0;
+const int   def_LOGLEVEL      = 1;
+const char  def_LOGRANKS[50]  = "0";
+const char  def_LOGDIR[50]    = "";
+
+int command(int argc,    char **argv,
 	     float *TMAX, float *DH,       float *DT,   float *ARBC,    float *PHT,
              int *NPC,    int *ND,         int *NSRC,   int *NST,       int *NVAR,
              int *NVE,    int *MEDIASTART, int *IFAULT, int *READ_STEP, int *READ_STEP_GPU,
@@ -135,7 +216,20 @@ void command(int argc,    char **argv,
              int *NBGY,   int *NEDY,       int *NSKPY,
              int *NBGZ,   int *NEDZ,       int *NSKPZ,
              float *FL,   float *FH,       float *FP,   int *IDYNA,     int *SoCalQ,
-             char *INSRC, char *INVEL,     char *OUT,   char *INSRC_I2, char *CHKFILE)
+             char *INSRC, char *INVEL,     char *OUT,   char *INSRC_I2, char *CHKFILE,
+             char *MASK,  int *MASKTYPE,  char *SINK,  int *SINKMODE,
+             char *IOHINTS, int *IOTUNE, int *CPU, int *CPUTILE, int *FDCOEF,
+             char *DRMREC, char *DRMIN, char *DRMBOX, char *DRMORIGIN, int *DRMSKIP,
+             int *MONITOR, int *MONACTION, float *MONGROW, char *HEARTBEAT,
+             float *ENDTOL, int *ENDWIN, int *ENDMODE,
+             float *SRCDT, int *SRCINTERP,
+             int *HALOFMT,
+             int *FRAMES, int *FRAMESKIP, float *FRAMEVMAX, int *FRAMEFMT, char *FRAMEOUT,
+             int *AUTO, float *FMAX, float *PPW, float *COURANT, float *REFL,
+             char *MEDIACACHE,
+             int *CPUBRICK,
+             int *CPUREC,
+             int *LOGLEVEL, char *LOGRANKS, char *LOGDIR)
 {
 
    // Fill in default values
@@ -187,6 +281,46 @@ void command(int argc,    char **argv,
     strcpy(OUT, def_OUT);
     strcpy(INSRC_I2, def_INSRC_I2);
     strcpy(CHKFILE, def_CHKFILE);
+    strcpy(MASK, def_MASK);
+   *MASKTYPE   = def_MASKTYPE;
+    strcpy(SINK, def_SINK);
+   *SINKMODE   = def_SINKMODE;
+    strcpy(IOHINTS, def_IOHINTS);
+   *IOTUNE     = def_IOTUNE;
+   *CPU        = def_CPU;
+   *CPUTILE    = def_CPUTILE;
+   *FDCOEF     = def_FDCOEF;
+    strcpy(DRMREC, def_DRMREC);
+    strcpy(DRMIN, def_DRMIN);
+    strcpy(DRMBOX, def_DRMBOX);
+    strcpy(DRMORIGIN, def_DRMORIGIN);
+   *DRMSKIP    = def_DRMSKIP;
+   *MONITOR    = def_MONITOR;
+   *MONACTION  = def_MONACTION;
+   *MONGROW    = def_MONGROW;
+    strcpy(HEARTBEAT, def_HEARTBEAT);
+   *ENDTOL     = def_ENDTOL;
+   *ENDWIN     = def_ENDWIN;
+   *ENDMODE    = def_ENDMODE;
+   *SRCDT      = def_SRCDT;
+   *SRCINTERP  = def_SRCINTERP;
+   *HALOFMT    = def_HALOFMT;
+   *FRAMES     = def_FRAMES;
+   *FRAMESKIP  = def_FRAMESKIP;
+   *FRAMEVMAX  = def_FRAMEVMAX;
+   *FRAMEFMT   = def_FRAMEFMT;
+    strcpy(FRAMEOUT, def_FRAMEOUT);
+   *AUTO       = def_AUTO;
+   *FMAX       = def_FMAX;
+   *PPW        = def_PPW;
+   *COURANT    = def_COURANT;
+   *REFL       = def_REFL;
+    strcpy(MEDIACACHE, def_MEDIACACHE);
+   *CPUBRICK   = def_CPUBRICK;
+   *CPUREC     = def_CPUREC;
+   *LOGLEVEL   = def_LOGLEVEL;
+    strcpy(LOGRANKS, def_LOGRANKS);
+    strcpy(LOGDIR, def_LOGDIR);
 
     extern char *optarg;
     static const char *optstring = "-T:H:t:A:P:M:D:S:N:V:B:n:I:R:Q:X:Y:Z:x:y:z:i:l:h:p:s:r:W:1:2:3:11:12:13:21:22:23:100:101:102:o:c:";
@@ -232,6 +366,47 @@ void command(int argc,    char **argv,
         {"OUT", required_argument, NULL, 'o'},
         {"INSRC_I2", required_argument, NULL, 102},
         {"CHKFILE", required_argument, NULL, 'c'},
+        {"MASK", required_argument, NULL, 200},
+        {"MASKTYPE", required_argument, NULL, 201},
+        {"SINK", required_argument, NULL, 202},
+        {"SINKMODE", required_argument, NULL, 203},
+        {"IOHINTS", required_argument, NULL, 204},
+        {"IOTUNE", required_argument, NULL, 205},
+        {"CPU", required_argument, NULL, 206},
+        {"CPUTILE", required_argument, NULL, 207},
+        {"FDCOEF", required_argument, NULL, 208},
+        {"DRMREC", required_argument, NULL, 209},
+        {"DRMIN", required_argument, NULL, 210},
+        {"DRMBOX", required_argument, NULL, 211},
+        {"DRMORIGIN", required_argument, NULL, 212},
+        {"DRMSKIP", required_argument, NULL, 213},
+        {"MONITOR", required_argument, NULL, 214},
+        {"MONACTION", required_argument, NULL, 215},
+        {"MONGROW", required_argument, NULL, 216},
+        {"HEARTBEAT", required_argument, NULL, 217},
+        {"ENDTOL", required_argument, NULL, 218},
+        {"ENDWIN", required_argument, NULL, 219},
+        {"ENDMODE", required_argument, NULL, 220},
+        {"SRCDT", required_argument, NULL, 221},
+        {"SRCINTERP", required_argument, NULL, 222},
+        {"HALOFMT", required_argument, NULL, 223},
+        {"FRAMES", required_argument, NULL, 224},
+        {"FRAMESKIP", required_argument, NULL, 225},
+        {"FRAMEVMAX", required_argument, NULL, 226},
+        {"FRAMEFMT", required_argument, NULL, 227},
+        {"FRAMEOUT", required_argument, NULL, 228},
+        {"AUTO", required_argument, NULL, 229},
+        {"FMAX", required_argument, NULL, 230},
+        {"PPW", required_argument, NULL, 231},
+        {"COURANT", required_argument, NULL, 232},
+        {"REFL", required_argument, NULL, 233},
+        {"MEDIACACHE", required_argument, NULL, 234},
+        {"CPUBRICK", required_argument, NULL, 235},
+        {"CPUREC", required_argument, NULL, 236},
+        {"LOGLEVEL", required_argument, NULL, 237},
+        {"LOGRANKS", required_argument, NULL, 238},
+        {"LOGDIR", required_argument, NULL, 239},
+        {0, 0, 0, 0}
     };
 
     // If IFAULT=2 and INSRC is not set, then *INSRC = def_INSRC_TPSRC, not def_INSRC
@@ -239,6 +414,8 @@ void command(int argc,    char **argv,
     // If IFAULT=1 and READ_STEP_GPU is not set, it should be = READ_STEP
     int readstepGpuIsSet = 0;
     int c;
+    // full getopt reset, command() runs once per pmcl3d_create
+    optind = 0;
     while ((c=getopt_long(argc, argv, optstring, long_options, NULL)) != -1)
     {
         switch (c) {
@@ -326,14 +503,111 @@ void command(int argc,    char **argv,
                 strcpy(INSRC_I2, optarg); break;
             case 'c':
                 strcpy(CHKFILE, optarg); break;
+            case 200:
+                strcpy(MASK, optarg); break;
+            case 201:
+                *MASKTYPE   = atoi(optarg); break;
+            case 202:
+                strcpy(SINK, optarg); break;
+            case 203:
+                *SINKMODE   = atoi(optarg); break;
+            case 204:
+                strcpy(IOHINTS, optarg); break;
+            case 205:
+                *IOTUNE     = atoi(optarg); break;
+            case 206:
+                *CPU        = atoi(optarg); break;
+            case 207:
+                *CPUTILE    = atoi(optarg); break;
+            case 208:
+                *FDCOEF     = atoi(optarg); break;
+            case 209:
+                strcpy(DRMREC, optarg); break;
+            case 210:
+                strcpy(DRMIN, optarg); break;
+            case 211:
+                strcpy(DRMBOX, optarg); break;
+            case 212:
+                strcpy(DRMORIGIN, optarg); break;
+            case 213:
+                *DRMSKIP    = atoi(optarg); break;
+            case 214:
+                *MONITOR    = atoi(optarg); break;
+            case 215:
+                *MONACTION  = atoi(optarg); break;
+            case 216:
+                *MONGROW    = atof(optarg); break;
+            case 217:
+                strcpy(HEARTBEAT, optarg); break;
+            case 218:
+                *ENDTOL     = atof(optarg); break;
+            case 219:
+                *ENDWIN     = atoi(optarg); break;
+            case 220:
+                *ENDMODE    = atoi(optarg); break;
+            case 221:
+                *SRCDT      = atof(optarg); break;
+            case 222:
+                *SRCINTERP  = atoi(optarg); break;
+            case 223:
+                *HALOFMT    = atoi(optarg); break;
+            case 224:
+                *FRAMES     = atoi(optarg); break;
+            case 225:
+                *FRAMESKIP  = atoi(optarg); break;
+            case 226:
+                *FRAMEVMAX  = atof(optarg); break;
+            case 227:
+                *FRAMEFMT   = atoi(optarg); break;
+            case 228:
+                strcpy(FRAMEOUT, optarg); break;
+            case 229:
+                *AUTO       = atoi(optarg); break;
+            case 230:
+                *FMAX       = atof(optarg); break;
+            case 231:
+                *PPW        = atof(optarg); break;
+            case 232:
+                *COURANT    = atof(optarg); break;
+            case 233:
+                *REFL       = atof(optarg); break;
+            case 234:
+                strcpy(MEDIACACHE, optarg); break;
+            case 235:
+                *CPUBRICK   = atoi(optarg); break;
+            case 236:
+                *CPUREC     = atoi(optarg); break;
+            case 237:
+                *LOGLEVEL   = atoi(optarg); break;
+            case 238:
+                strcpy(LOGRANKS, optarg); break;
+            case 239:
+                strcpy(LOGDIR, optarg); break;
             default:
                 printf("Usage: %s \nOptions:\n\t[(-T | --TMAX) <TMAX>]\n\t[(-H | --DH) <DH>]\n\t[(-t | --DT) <DT>]\n\t[(-A | --ARBC) <ARBC>]\n\t[(-P | --PHT) <PHT>]\n\t[(-M | --NPC) <NPC>]\n\t[(-D | --ND) <ND>]\n\t[(-S | --NSRC) <NSRC>]\n\t[(-N | --NST) <NST>]\n",argv[0]);
                 printf("\n\t[(-V | --NVE) <NVE>]\n\t[(-B | --MEDIASTART) <MEDIASTART>]\n\t[(-n | --NVAR) <NVAR>]\n\t[(-I | --IFAULT) <IFAULT>]\n\t[(-R | --READ_STEP) <x READ_STEP for CPU>]\n\t[(-Q | --READ_STEP_GPU) <READ_STEP for GPU>]\n");
                 printf("\n\t[(-X | --NX) <x length]\n\t[(-Y | --NY) <y length>]\n\t[(-Z | --NZ) <z length]\n\t[(-x | --NPX) <x processors]\n\t[(-y | --NPY) <y processors>]\n\t[(-z | --NPZ) <z processors>]\n");
                 printf("\n\t[(-1 | --NBGX) <starting point to record in X>]\n\t[(-2 | --NEDX) <ending point to record in X>]\n\t[(-3 | --NSKPX) <skipping points to record in X>]\n\t[(-11 | --NBGY) <starting point to record in Y>]\n\t[(-12 | --NEDY) <ending point to record in Y>]\n\t[(-13 | --NSKPY) <skipping points to record in Y>]\n\t[(-21 | --NBGZ) <starting point to record in Z>]\n\t[(-22 | --NEDZ) <ending point to record in Z>]\n\t[(-23 | --NSKPZ) <skipping points to record in Z>]\n");
                 printf("\n\t[(-i | --IDYNA) <i IDYNA>]\n\t[(-s | --SoCalQ) <s SoCalQ>]\n\t[(-l | --FL) <l FL>]\n\t[(-h | --FH) <i FH>]\n\t[(-p | --FP) <p FP>]\n\t[(-r | --NTISKP) <time skipping in writing>]\n\t[(-W | --WRITE_STEP) <time aggregation in writing>]\n");
-                printf("\n\t[(-100 | --INSRC) <source file>]\n\t[(-101 | --INVEL) <mesh file>]\n\t[(-o | --OUT) <output file>]\n\t[(-102 | --INSRC_I2) <split source file prefix (IFAULT=2)>]\n\t[(-c | --CHKFILE) <checkpoint file to write statistics>]\n\n");
-                exit(-1);
+                printf("\n\t[(-100 | --INSRC) <source file>]\n\t[(-101 | --INVEL) <mesh file>]\n\t[(-o | --OUT) <output file>]\n\t[(-102 | --INSRC_I2) <split source file prefix (IFAULT=2)>]\n\t[(-c | --CHKFILE) <checkpoint file to write statistics>]\n");
+                printf("\n\t[--MASK <surface mask file for sparse output>]\n\t[--MASKTYPE <0=raster, 1=polygon>]\n");
+                printf("\n\t[--SINK <Unix socket of output consumer>]\n\t[--SINKMODE <0=stream and files, 1=stream only>]\n");
+                printf("\n\t[--IOHINTS <MPI-IO hints file>]\n\t[--IOTUNE <repetitions of the output hints benchmark>]\n");
+                printf("\n\t[--CPU <0=CUDA kernels, 1=host kernels, fused sweep>]\n\t[--CPUTILE <column tile edge, 0=from cache size>]\n");
+                printf("\n\t[--FDCOEF <stencil coefficients, 0=Taylor, 1=DRP>]\n");
+                printf("\n\t[--DRMREC <boundary wavefield file to record>]\n\t[--DRMBOX <x0,x1,y0,y1,z1 (m)>]\n\t[--DRMSKIP <time steps per record>]\n");
+                printf("\n\t[--DRMIN <boundary wavefield file to inject>]\n\t[--DRMORIGIN <x,y (m) in the recording frame>]\n");
+                printf("\n\t[--MONITOR <time steps between health checks>]\n\t[--MONACTION <0=report, 1=stop, 2=abort>]\n\t[--MONGROW <energy growth limit>]\n\t[--HEARTBEAT <heartbeat file>]\n");
+                printf("\n\t[--ENDTOL <relative end threshold>]\n\t[--ENDWIN <window time steps>]\n\t[--ENDMODE <0=energy, 1=surface PGV>]\n");
+                printf("\n\t[--SRCDT <source file sample interval>]\n\t[--SRCINTERP <1=linear, 3=cubic>]\n");
+                printf("\n\t[--HALOFMT <0=fp32, 1=fp16, 2=bf16, 3=int16>]\n");
+                printf("\n\t[--FRAMES <time steps between frames>]\n\t[--FRAMESKIP <pixel spacing in grid points>]\n\t[--FRAMEVMAX <colour scale (m/s), 0=auto>]\n\t[--FRAMEFMT <0=PNG, 1=raw 8-bit>]\n\t[--FRAMEOUT <frame file prefix>]\n");
+                printf("\n\t[--AUTO <0=off, 1=report, 2=apply DT and ND>]\n\t[--FMAX <highest frequency (Hz)>]\n\t[--PPW <points per S wavelength>]\n\t[--COURANT <vp*dt/dh, 0=90%% of limit>]\n\t[--REFL <sponge reflection>]\n");
+                printf("\n\t[--MEDIACACHE <converted media directory>]\n");
+                printf("\n\t[--CPUBRICK <column brick edge of the host fields, 0=flat>]\n");
+                printf("\n\t[--CPUREC <1=interleave the host fields per column>]\n");
+                printf("\n\t[--LOGLEVEL <0=errors, 1=summary, 2=per-rank detail, 3=debug>]\n\t[--LOGRANKS <ranks printing per-rank messages, e.g. 0-3,17 or all>]\n\t[--LOGDIR <per-node log directory>]\n\n");
+                return -1;
         }
     }
     // If IFAULT=2 and INSRC is not set, then *INSRC = def_INSRC_TPSRC, not def_INSRC
@@ -343,5 +617,9 @@ void command(int argc,    char **argv,
     if(!readstepGpuIsSet){
       *READ_STEP_GPU = *READ_STEP;
     }
-    return;
+    if(*FDCOEF<0 || *FDCOEF>1){
+      printf("FDCOEF must be 0 (Taylor) or 1 (DRP), got %d\n", *FDCOEF);
+      return -1;
+    }
+    return 0;
 }
@@ -0,0 +1,821 @@
+/**
+@section LICENSE
+Copyright (c) 2013-2016, Regents of the University of California
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+********************************************************************************
+* drm.c                                                                        *
+* domain reduction: boundary wavefield recording and injection                 *
+*                                                                              *
+* A regional run (--DRMREC) records all nine fields in a shell of DRM_MARGIN   *
+* cells around the surface of a box (--DRMBOX x0,x1,y0,y1,z1 in m, open at    *
+* the free surface) every DRMSKIP steps. The file holds a DrmHeader, the       *
+* global (x,y,depth) cell of every point and one record per DRMSKIP steps of   *
+* [9][npts] floats, u,v,w,xx,yy,zz,xy,xz,yz.                                   *
+*                                                                              *
+* A nested run (--DRMIN, origin --DRMORIGIN in the regional frame) takes the   *
+* recorded field as background. Inside the box the grid holds the total field, *
+* outside only the scattered field, which the Cerjan sponge absorbs. Every     *
+* stencil that crosses the box surface would mix the two, so the background    *
+* at the points across the surface is added (inside) or removed (outside) as   *
+* an effective force in the layer of reach points on either side, the         *
+* finite-difference form of the domain reduction method. The background is     *
+* interpolated trilinearly in space and linearly in time from the records.    *
+*                                                                              *
+* The corrections are rows of a sparse matrix over the background values at    *
+* the layer points, built once with the material coefficients of the stress    *
+* and velocity updates (memory variables and sponge included), so they are     *
+* exact for every step. Both are added after the stress update of a step: the  *
+* stress rows belong to that update, the velocity rows to the next one.        *
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pmcl3d.h"
+
+#define DRM_MAGIC   0x4d445741   // "AWDM"
+#define DRM_VERSION 1
+#define DRM_MARGIN  6
+
+#define NFLD   15   // u,v,w, xx,yy,zz,xy,xz,yz, r1..r6
+#define FORM_A 0
+#define FORM_B 1
+
+// staggered position of every field relative to the cell in units of DH:
+// x, y and depth below the free surface (at the level of w, xz and yz)
+static const float stag[9][3] = { {-0.5, 0.0, 0.5}, { 0.0, 0.5, 0.5}, { 0.0, 0.0, 0.0},
+                                  { 0.0, 0.0, 0.5}, { 0.0, 0.0, 0.5}, { 0.0, 0.0, 0.5},
+                                  {-0.5, 0.5, 0.5}, {-0.5, 0.0, 0.0}, { 0.0, 0.5, 0.0} };
+
+// terms {field, axis, form} of the velocity updates and of the strain rates
+// of the stress updates, see dvel and str_col
+static const int velterm[3][3][3] = { {{3,0,FORM_A}, {6,1,FORM_A}, {7,2,FORM_A}},
+                                      {{6,0,FORM_B}, {4,1,FORM_B}, {8,2,FORM_A}},
+                                      {{7,0,FORM_B}, {8,1,FORM_A}, {5,2,FORM_B}} };
+static const int diagterm[3][3]     = { {0,0,FORM_B}, {1,1,FORM_A}, {2,2,FORM_A} };
+static const int shearterm[3][2][3] = { {{0,1,FORM_B}, {1,0,FORM_A}},
+                                        {{0,2,FORM_B}, {2,0,FORM_A}},
+                                        {{1,2,FORM_B}, {2,1,FORM_B}} };
+
+typedef struct {
+  int   row, g, pos, col;
+  float coef;
+} DrmEntry;
+
+static int      drmcpu, myrank, rec = 0, inj = 0;
+static int      d_nxt, d_nyt, d_nzt, d_slice, d_yline, gx0, gy0;
+static int      d_NX;
+static float    d_DH, d_DT, d_dth, d_dh1, c[4], cz[2][4], *d_lam_mu;
+static double   xorig, yorig, bbox[5];
+
+// recorder
+static MPI_File recfh;
+static DrmHeader rechdr;
+static long     recoff;
+static int      nrecpt, *recpos, *d_recpos;
+static float    *recbuf, *d_recbuf;
+
+// injection
+static DrmHeader inhdr;
+static MPI_File infh;
+static int      nrow, ncol, nent, rowoff[NFLD+1], *rowpos, *rowptr, *entcol, *d_rowpos;
+static int      *colg, *colpos, *colidx, lo, hi, cached[3];
+static float    *entcoef, *colw, *bg, *delta, *d_delta, *cache[3];
+static int      clamped = 0;
+
+static int parselist(char *s, double *v, int n, const char *name)
+{
+  int i;
+
+  for(i=0;i<n;i++)
+  {
+     v[i] = strtod(s, &s);
+     if(i<n-1)
+     {
+        if(*s!=',') break;
+        s++;
+     }
+  }
+  if(i<n || *s)
+  {
+     printf("--%s needs %d comma separated values\n", name, n);
+     return -1;
+  }
+  return 0;
+}
+
+// total field region: the box, at the staggered position of field g
+static int inbox(int g, int i, int j, int k)
+{
+  double x, y, d;
+
+  x = xorig + (gx0 + i - 2 - 4*loop + stag[g][0])*d_DH;
+  y = yorig + (gy0 + j - 2 - 4*loop + stag[g][1])*d_DH;
+  d = (d_nzt + align - 1 - k + stag[g][2])*d_DH;
+  return x>=bbox[0] && x<=bbox[1] && y>=bbox[2] && y<=bbox[3] && d<=bbox[4];
+}
+
+// within reach+1 cells of the box surface
+static int nearbox(int i, int j, int k)
+{
+  double x, y, d, r = (reach+1)*d_DH;
+
+  x = xorig + (gx0 + i - 2 - 4*loop)*d_DH;
+  y = yorig + (gy0 + j - 2 - 4*loop)*d_DH;
+  d = (d_nzt + align - 1 - k)*d_DH;
+  if(x<bbox[0]-r || x>bbox[1]+r || y<bbox[2]-r || y>bbox[3]+r || d>bbox[4]+r) return 0;
+  return x<bbox[0]+r || x>bbox[1]-r || y<bbox[2]+r || y>bbox[3]-r || d>bbox[4]-r;
+}
+
+static DrmEntry *ent;
+static int      entmax;
+
+static void addentry(int row, int g, int pos, float coef)
+{
+  if(nent==entmax)
+  {
+     entmax = (entmax ? 2*entmax : 65536);
+     ent    = (DrmEntry *)realloc(ent, sizeof(DrmEntry)*entmax);
+  }
+  ent[nent].row  = row;
+  ent[nent].g    = g;
+  ent[nent].pos  = pos;
+  ent[nent].coef = coef;
+  nent++;
+  return;
+}
+
+// background term of field g at (i,j,k) with weight w seen from a point with
+// box flag chi. Points above the free surface hold images that the stress
+// update derives from the fields below (str_col), their terms are expanded.
+static void addterm(int row, int chi, int g, int i, int j, int k, float w)
+{
+  int surf = d_nzt+align-1, jm, ip;
+  float lm;
+
+  if(k<=surf)
+  {
+     if(inbox(g, i, j, k)!=chi)
+        addentry(row, g, i*d_slice + j*d_yline + k, w*(chi ? 1.0 : -1.0));
+     return;
+  }
+  if(g==5 || g==7 || g==8)
+  {
+     // stress images: zz mirrored about the surface, xz and yz about their zero level
+     addterm(row, chi, g, i, j, (g==5 ? 2*surf+1-k : 2*surf-k), -w);
+     return;
+  }
+  if(g>2 || k>surf+1) return;   // never read by the stress update
+  if(g==0)
+  {
+     addterm(row, chi, 0, i,   j, surf,  w);
+     addterm(row, chi, 2, i,   j, surf, -w);
+     addterm(row, chi, 2, i-1, j, surf,  w);
+  }
+  else if(g==1)
+  {
+     addterm(row, chi, 1, i, j,   surf,  w);
+     addterm(row, chi, 2, i, j+1, surf, -w);
+     addterm(row, chi, 2, i, j,   surf,  w);
+  }
+  else
+  {
+     lm = d_lam_mu[i*(d_nyt+4+8*loop) + j]*w;
+     jm = (gy0 + j - 4*loop - 1 > 1);
+     ip = (gx0 + i - 4*loop - 1 < d_NX);
+     addterm(row, chi, 2, i, j, surf-1, w);
+     if(ip) addterm(row, chi, 0, i+1, j, surf+1, -lm);
+     addterm(row, chi, 0, i,   j,   surf+1,  lm);
+     addterm(row, chi, 0, i+1, j,   surf,   -lm);
+     addterm(row, chi, 0, i,   j,   surf,    lm);
+     addterm(row, chi, 1, i,   j,   surf+1, -lm);
+     if(jm) addterm(row, chi, 1, i, j-1, surf+1, lm);
+     addterm(row, chi, 1, i,   j,   surf,   -lm);
+     addterm(row, chi, 1, i,   j-1, surf,    lm);
+  }
+  return;
+}
+
+// background terms of one staggered difference of field g at pos that
+// cross the box surface, scaled by coef
+static void stencil(int row, int chi, int g, int axis, int form, int pos, int k, float coef)
+{
+  int   m, s, q, sign;
+  const float *a = (axis==2 ? cz[k>=d_nzt+align-FD_FSLAYERS] : c);
+
+  s = (axis==0 ? d_slice : (axis==1 ? d_yline : 1));
+  for(m=1;m<=reach;m++)
+    for(sign=1;sign>=-1;sign-=2)
+    {
+       if(a[m-1]==0.0) continue;
+       if(form==FORM_A) q = pos + (sign>0 ? (m-1)*s : -m*s);
+       else             q = pos + (sign>0 ? m*s     : (1-m)*s);
+       addterm(row, chi, g, q/d_slice, (q%d_slice)/d_yline, q%d_yline, sign*coef*a[m-1]);
+    }
+  return;
+}
+
+// copies the entries of the last row to an image row at pos
+static void image(int row, int pos)
+{
+  int e, n = nent;
+
+  for(e=n-1;e>=0 && ent[e].row==row;e--)
+     addentry(row+1, ent[e].g, ent[e].pos, -ent[e].coef);
+  rowpos[row+1] = pos;
+  return;
+}
+
+// stress update coefficients at pos as in str_col: f_dcrj, coefficient of the
+// own and the two other strain rates, the same for the memory variable, and
+// per shear component the stress and memory variable coefficient
+static void strcoef(int pos, float f_dcrj, float *lam, float *mu, float *qp, float *qs, float *vx1,
+                    float *dg, float *sh)
+{
+  int   ip1 = pos+d_slice, jm1 = pos-d_yline, km1 = pos-1;
+  int   ijk = pos+d_slice-d_yline, ik1 = pos+d_slice-1, jk1 = pos-d_yline-1, ijk1 = pos+d_slice-d_yline-1;
+  float xl, xm, xmu1, xmu2, xmu3, qpa, h, h1, h2, h3, f_vx1 = vx1[pos];
+
+  xl   = 8.0/(  lam[pos] + lam[ip1] + lam[jm1] + lam[ijk] + lam[km1] + lam[ik1] + lam[jk1] + lam[ijk1] );
+  xm   = 16.0/( mu[pos]  + mu[ip1]  + mu[jm1]  + mu[ijk]  + mu[km1]  + mu[ik1]  + mu[jk1]  + mu[ijk1] );
+  xmu1 = 2.0/(  mu[pos]  + mu[km1] );
+  xmu2 = 2.0/(  mu[pos]  + mu[jm1] );
+  xmu3 = 2.0/(  mu[pos]  + mu[ip1] );
+  xl   = xl + xm;
+  qpa  = 0.0625*( qp[pos] + qp[ip1] + qp[jm1] + qp[ijk] + qp[km1] + qp[ik1] + qp[jk1] + qp[ijk1] );
+  h    = 0.0625*( qs[pos] + qs[ip1] + qs[jm1] + qs[ijk] + qs[km1] + qs[ik1] + qs[jk1] + qs[ijk1] );
+  h1   = 0.250*(  qs[pos] + qs[km1] );
+  h2   = 0.250*(  qs[pos] + qs[jm1] );
+  h3   = 0.250*(  qs[pos] + qs[ip1] );
+
+  h    = -xm*h*d_dh1*f_vx1;
+  h1   = -xmu1*h1*d_dh1*f_vx1;
+  h2   = -xmu2*h2*d_dh1*f_vx1;
+  h3   = -xmu3*h3*d_dh1*f_vx1;
+  qpa  = -qpa*xl*d_dh1*f_vx1;
+  xm   = xm*d_dth   + d_DT*h;
+  xmu1 = xmu1*d_dth + d_DT*h1;
+  xmu2 = xmu2*d_dth + d_DT*h2;
+  xmu3 = xmu3*d_dth + d_DT*h3;
+  xl   = xl*d_dth   + d_DT*qpa;
+
+  dg[0] = f_dcrj*xl;
+  dg[1] = f_dcrj*(xl-xm);
+  dg[2] = qpa;
+  dg[3] = qpa-h;
+  sh[0] = f_dcrj*xmu1;  sh[1] = h1;
+  sh[2] = f_dcrj*xmu2;  sh[3] = h2;
+  sh[4] = f_dcrj*xmu3;  sh[5] = h3;
+  return;
+}
+
+static int cmppos(const void *a, const void *b)
+{
+  const DrmEntry *x = (const DrmEntry *)a, *y = (const DrmEntry *)b;
+
+  if(x->g!=y->g) return x->g - y->g;
+  return (x->pos>y->pos) - (x->pos<y->pos);
+}
+
+static int cmprow(const void *a, const void *b)
+{
+  const DrmEntry *x = (const DrmEntry *)a, *y = (const DrmEntry *)b;
+
+  if(x->row!=y->row) return x->row - y->row;
+  return (x->col>y->col) - (x->col<y->col);
+}
+
+// builds the correction rows of this rank, see the header
+static void buildrows(int xls, int xre, int yls, int yre, float *d1, float *lam, float *mu, float *qp, float *qs,
+                      float *vx1, float *dcrjx, float *dcrjy, float *dcrjz)
+{
+  int   f, i, j, k, s, t, pos, chi, rowmax = 0, surf = d_nzt+align-1;
+  int   is, ie, js, je;
+  float f_dcrj, f_d, dg[4], sh[6], coef;
+
+  nrow   = 0;
+  nent   = 0;
+  rowpos = NULL;
+  for(f=0;f<NFLD;f++)
+  {
+     rowoff[f] = nrow;
+     // velocity on the interior, stress also on the ghost planes next to a neighbour
+     is = (f<3 ? 2+4*loop : xls);
+     ie = (f<3 ? d_nxt+4*loop+1 : xre);
+     js = (f<3 ? 2+4*loop : yls);
+     je = (f<3 ? d_nyt+4*loop+1 : yre);
+     for(i=is;i<=ie;i++)
+       for(j=js;j<=je;j++)
+         for(k=align;k<=surf;k++)
+         {
+            if(!nearbox(i, j, k)) continue;
+            if((f==7 || f==8 || f==13 || f==14) && k==surf) continue;
+            if(nrow+2>rowmax)
+            {
+               rowmax = (rowmax ? 2*rowmax : 65536);
+               rowpos = (int *)realloc(rowpos, sizeof(int)*rowmax);
+            }
+            pos    = i*d_slice + j*d_yline + k;
+            f_dcrj = (dcrjx ? dcrjx[i]*dcrjy[j]*dcrjz[k] : 1.0);
+            chi    = inbox(f<9 ? f : f-6, i, j, k);
+            if(f<3)
+            {
+               if(f==0)      f_d = 0.25*(d1[pos] + d1[pos-d_yline] + d1[pos-1]       + d1[pos-d_yline-1]);
+               else if(f==1) f_d = 0.25*(d1[pos] + d1[pos+d_slice] + d1[pos-1]       + d1[pos+d_slice-1]);
+               else          f_d = 0.25*(d1[pos] + d1[pos+d_slice] + d1[pos-d_yline] + d1[pos+d_slice-d_yline]);
+               for(t=0;t<3;t++)
+                  stencil(nrow, chi, velterm[f][t][0], velterm[f][t][1], velterm[f][t][2], pos, k, d_dth/f_d);
+            }
+            else
+            {
+               strcoef(pos, f_dcrj, lam, mu, qp, qs, vx1, dg, sh);
+               // xx,yy,zz and r1..r3: own strain rate (u_x for xx) and the other two
+               if(f<6 || (f>=9 && f<12))
+                 for(t=0;t<3;t++)
+                 {
+                    s    = (t==(f<9 ? f-3 : f-9) ? 0 : 1);
+                    coef = (f<9 ? dg[s] : dg[2+s]);
+                    stencil(nrow, chi, diagterm[t][0], diagterm[t][1], diagterm[t][2], pos, k, coef);
+                 }
+               else
+               {
+                  s    = (f<9 ? f-6 : f-12);
+                  coef = sh[2*s + (f<9 ? 0 : 1)];
+                  for(t=0;t<2;t++)
+                     stencil(nrow, chi, shearterm[s][t][0], shearterm[s][t][1], shearterm[s][t][2], pos, k, coef);
+               }
+            }
+            if(nent==0 || ent[nent-1].row!=nrow) continue;
+            rowpos[nrow] = pos;
+            // free surface images written by the stress update
+            if(f==5 && k==surf)                      image(nrow++, pos+1);
+            else if(f==5 && k==surf-1)               image(nrow++, pos+3);
+            else if((f==7 || f==8) && k==surf-1)     image(nrow++, pos+2);
+            else if((f==7 || f==8) && k==surf-2)     image(nrow++, pos+4);
+            nrow++;
+         }
+  }
+  rowoff[NFLD] = nrow;
+
+  // one column per background value, the entries of a row sorted by column
+  qsort(ent, nent, sizeof(DrmEntry), cmppos);
+  ncol = 0;
+  for(t=0;t<nent;t++)
+  {
+     if(t==0 || ent[t].g!=ent[t-1].g || ent[t].pos!=ent[t-1].pos) ncol++;
+     ent[t].col = ncol-1;
+  }
+  colg   = (int *)malloc(sizeof(int)*(ncol+1));
+  colpos = (int *)malloc(sizeof(int)*(ncol+1));
+  colidx = (int *)malloc(sizeof(int)*(8*ncol+1));
+  colw   = (float *)malloc(sizeof(float)*(8*ncol+1));
+  for(t=0;t<nent;t++)
+  {
+     colg[ent[t].col]   = ent[t].g;
+     colpos[ent[t].col] = ent[t].pos;
+  }
+  qsort(ent, nent, sizeof(DrmEntry), cmprow);
+  rowptr  = (int *)calloc(nrow+1, sizeof(int));
+  entcol  = (int *)malloc(sizeof(int)*(nent+1));
+  entcoef = (float *)malloc(sizeof(float)*(nent+1));
+  for(t=0;t<nent;t++)
+  {
+     rowptr[ent[t].row+1]++;
+     entcol[t]  = ent[t].col;
+     entcoef[t] = ent[t].coef;
+  }
+  for(t=0;t<nrow;t++) rowptr[t+1] += rowptr[t];
+  free(ent);
+  ent    = NULL;
+  entmax = 0;
+  return;
+}
+
+// spatial interpolation weights of every column from the recorded points
+static int interpolation(int npts, int *table)
+{
+  int  t, n, a, b, e, cx, cy, cd, nx, ny, nd, corner;
+  int  bx[2] = {0, 0}, by[2] = {0, 0}, bd[2] = {0, 0}, *map;
+  long mapsize;
+  double fx[3], w[3], x, y, d, h = inhdr.dh;
+
+  for(n=0;n<npts;n++)
+  {
+     if(n==0 || table[3*n]   < bx[0]) bx[0] = table[3*n];
+     if(n==0 || table[3*n]   > bx[1]) bx[1] = table[3*n];
+     if(n==0 || table[3*n+1] < by[0]) by[0] = table[3*n+1];
+     if(n==0 || table[3*n+1] > by[1]) by[1] = table[3*n+1];
+     if(n==0 || table[3*n+2] < bd[0]) bd[0] = table[3*n+2];
+     if(n==0 || table[3*n+2] > bd[1]) bd[1] = table[3*n+2];
+  }
+  nx      = bx[1]-bx[0]+1;
+  ny      = by[1]-by[0]+1;
+  nd      = bd[1]-bd[0]+1;
+  mapsize = (long)nx*ny*nd;
+  map     = (int *)malloc(sizeof(int)*mapsize);
+  for(n=0;n<mapsize;n++) map[n] = -1;
+  for(n=0;n<npts;n++)
+     map[((long)(table[3*n]-bx[0])*ny + table[3*n+1]-by[0])*nd + table[3*n+2]-bd[0]] = n;
+
+  lo = npts;
+  hi = -1;
+  for(t=0;t<ncol;t++)
+  {
+     e  = colpos[t];
+     a  = colg[t];
+     x  = xorig + (gx0 + e/d_slice - 2 - 4*loop + stag[a][0])*d_DH;
+     y  = yorig + (gy0 + (e%d_slice)/d_yline - 2 - 4*loop + stag[a][1])*d_DH;
+     d  = (d_nzt + align - 1 - e%d_yline + stag[a][2])*d_DH;
+     fx[0] = x/h - stag[a][0];
+     fx[1] = y/h - stag[a][1];
+     fx[2] = d/h - stag[a][2];
+     // normal stresses and horizontal velocities above their first level take the surface value
+     if(fx[2]<0.0) fx[2] = 0.0;
+     for(b=0;b<3;b++)
+     {
+        w[b] = fx[b] - floor(fx[b]);
+        if(w[b]<1.0e-6)     w[b] = 0.0;
+        if(w[b]>1.0-1.0e-6) w[b] = 1.0;
+     }
+     cx = (int)floor(fx[0]);
+     cy = (int)floor(fx[1]);
+     cd = (int)floor(fx[2]);
+     for(corner=0;corner<8;corner++)
+     {
+        int   ix = cx+(corner&1), iy = cy+((corner>>1)&1), id = cd+((corner>>2)&1);
+        float wt = ((corner&1)      ? w[0] : 1.0-w[0])
+                 * (((corner>>1)&1) ? w[1] : 1.0-w[1])
+                 * (((corner>>2)&1) ? w[2] : 1.0-w[2]);
+        colidx[8*t+corner] = -1;
+        colw[8*t+corner]   = wt;
+        if(wt==0.0) continue;
+        if(ix<bx[0] || ix>bx[1] || iy<by[0] || iy>by[1] || id<bd[0] || id>bd[1] ||
+           (n = map[((long)(ix-bx[0])*ny + iy-by[0])*nd + id-bd[0]])<0)
+        {
+           printf("%d) DRM: cell (%d,%d,%d) of the recording grid is not in the record\n", myrank, ix, iy, id);
+           free(map);
+           return -1;
+        }
+        colidx[8*t+corner] = n;
+        if(n<lo) lo = n;
+        if(n>hi) hi = n;
+     }
+  }
+  free(map);
+  return 0;
+}
+
+int drminit(char *DRMREC, char *DRMIN, char *DRMBOX, char *DRMORIGIN, int DRMSKIP, int CPU,
+            int rank, int *coord, MPI_Comm MCW, int NX, int NY, int ND,
+            int nxt, int nyt, int nzt, float DH, float DT, int FDCOEF,
+            int xls, int xre, int yls, int yre,
+            Grid3D d1, Grid3D mu, Grid3D lam, Grid3D qp, Grid3D qs, Grid3D vx1, Grid3D lam_mu,
+            Grid1D dcrjx, Grid1D dcrjy, Grid1D dcrjz)
+{
+  float  cc[2][4] = {FD_TAYLOR, FD_DRP}, c4th[4] = FD_TAYLOR4;
+  double org[2] = {0.0, 0.0}, r;
+  int    i, j, k, n, err = 0, *table = NULL;
+  long   off, npts;
+  MPI_Offset disp;
+
+  // nothing open yet, drmclose frees what a failure below leaves behind
+  rec     = 0;
+  inj     = 0;
+  recpos  = d_recpos = NULL;
+  recbuf  = d_recbuf = NULL;
+  rowpos  = rowptr = entcol = d_rowpos = colg = colpos = colidx = NULL;
+  entcoef = colw = bg = delta = d_delta = NULL;
+  for(i=0;i<3;i++) cache[i] = NULL;
+  drmcpu  = CPU;
+  myrank  = rank;
+  d_NX    = NX;
+  d_lam_mu = &lam_mu[0][0][0];
+  d_nxt   = nxt;
+  d_nyt   = nyt;
+  d_nzt   = nzt;
+  d_slice = (nyt+4+8*loop)*(nzt+2*align);
+  d_yline = nzt+2*align;
+  gx0     = nxt*coord[0];
+  gy0     = nyt*coord[1];
+  d_DH    = DH;
+  d_DT    = DT;
+  d_dth   = DT/DH;
+  d_dh1   = 1.0/DH;
+  for(i=0;i<4;i++)
+  {
+     c[i]     = cc[FDCOEF][i];
+     cz[0][i] = cc[FDCOEF][i];
+     cz[1][i] = c4th[i];
+  }
+
+  if(DRMREC[0])
+  {
+     if(parselist(DRMBOX, bbox, 5, "DRMBOX")) return -1;
+     if(DRMSKIP<1)
+     {
+        printf("DRMSKIP must be positive\n");
+        return -1;
+     }
+     xorig = 0.0;
+     yorig = 0.0;
+     // cells within DRM_MARGIN of the box surface, outside or inside;
+     // the first pass counts, the second fills
+     r = DRM_MARGIN*DH;
+     for(n=0;n<2;n++)
+     {
+        if(n==1)
+        {
+           recpos = (int *)malloc(sizeof(int)*(nrecpt+1));
+           table  = (int *)malloc(sizeof(int)*3*(nrecpt+1));
+        }
+        nrecpt = 0;
+        for(i=2+4*loop;i<nxt+2+4*loop;i++)
+          for(j=2+4*loop;j<nyt+2+4*loop;j++)
+            for(k=align;k<nzt+align;k++)
+            {
+               double x = (gx0+i-2-4*loop)*DH, y = (gy0+j-2-4*loop)*DH, d = (nzt+align-1-k)*DH;
+               if(x<bbox[0]-r || x>bbox[1]+r || y<bbox[2]-r || y>bbox[3]+r || d>bbox[4]+r) continue;
+               if(x>bbox[0]+r && x<bbox[1]-r && y>bbox[2]+r && y<bbox[3]-r && d<bbox[4]-r) continue;
+               if(n==1)
+               {
+                  recpos[nrecpt]    = i*d_slice + j*d_yline + k;
+                  table[3*nrecpt]   = gx0+i-2-4*loop;
+                  table[3*nrecpt+1] = gy0+j-2-4*loop;
+                  table[3*nrecpt+2] = nzt+align-1-k;
+               }
+               nrecpt++;
+            }
+     }
+     off  = nrecpt;
+     npts = nrecpt;
+     MPI_Exscan(MPI_IN_PLACE, &off, 1, MPI_LONG, MPI_SUM, MCW);
+     if(rank==0) off = 0;
+     MPI_Allreduce(MPI_IN_PLACE, &npts, 1, MPI_LONG, MPI_SUM, MCW);
+     if(npts==0)
+     {
+        if(rank==0) printf("DRM: box %s has no cells in the grid\n", DRMBOX);
+        free(table);
+        return -1;
+     }
+     memset(&rechdr, 0, sizeof(DrmHeader));
+     rechdr.magic   = DRM_MAGIC;
+     rechdr.version = DRM_VERSION;
+     rechdr.npts    = npts;
+     rechdr.skip    = DRMSKIP;
+     rechdr.dh      = DH;
+     rechdr.dt      = DT;
+     rechdr.margin  = DRM_MARGIN;
+     for(i=0;i<5;i++) rechdr.box[i] = bbox[i];
+     recoff = off;
+
+     err = MPI_File_open(MCW, DRMREC, MPI_MODE_CREATE|MPI_MODE_WRONLY, MPI_INFO_NULL, &recfh);
+     if(err!=MPI_SUCCESS)
+     {
+        if(rank==0) printf("can't open DRM record file %s\n", DRMREC);
+        free(table);
+        return -1;
+     }
+     rec = 1;
+     MPI_File_set_size(recfh, 0);
+     disp = sizeof(DrmHeader) + sizeof(int)*3*off;
+     MPI_File_write_at_all(recfh, disp, table, 3*nrecpt, MPI_INT, MPI_STATUS_IGNORE);
+     free(table);
+     recbuf = (float *)malloc(sizeof(float)*(9*nrecpt+1));
+     if(!CPU && nrecpt>0)
+     {
+        cudaMalloc((void**)&d_recpos, sizeof(int)*nrecpt);
+        cudaMemcpy(d_recpos, recpos, sizeof(int)*nrecpt, cudaMemcpyHostToDevice);
+        cudaMalloc((void**)&d_recbuf, sizeof(float)*9*nrecpt);
+     }
+     if(rank==0)
+        printf("DRM: recording %ld points every %d steps to %s\n", npts, DRMSKIP, DRMREC);
+  }
+
+  if(DRMIN[0])
+  {
+     if(DRMORIGIN[0] && parselist(DRMORIGIN, org, 2, "DRMORIGIN")) return -1;
+     xorig = org[0];
+     yorig = org[1];
+     err = MPI_File_open(MCW, DRMIN, MPI_MODE_RDONLY, MPI_INFO_NULL, &infh);
+     if(err!=MPI_SUCCESS)
+     {
+        if(rank==0) printf("can't open DRM input file %s\n", DRMIN);
+        return -1;
+     }
+     inj = 1;
+     if(rank==0) MPI_File_read_at(infh, 0, &inhdr, sizeof(DrmHeader), MPI_BYTE, MPI_STATUS_IGNORE);
+     MPI_Bcast(&inhdr, sizeof(DrmHeader), MPI_BYTE, 0, MCW);
+     if(inhdr.magic!=DRM_MAGIC || inhdr.version!=DRM_VERSION || inhdr.nrec<1)
+     {
+        if(rank==0) printf("%s is not a complete DRM record file\n", DRMIN);
+        return -1;
+     }
+     for(i=0;i<5;i++) bbox[i] = inhdr.box[i];
+     if(rank==0)
+     {
+        printf("DRM: injecting %s, box %g-%g x %g-%g m to %g m depth, %d records every %g s, grid %g m\n",
+               DRMIN, bbox[0], bbox[1], bbox[2], bbox[3], bbox[4], inhdr.nrec, inhdr.skip*inhdr.dt, inhdr.dh);
+        if(DH>inhdr.dh)
+           printf("DRM: warning, the nested grid (%g m) is coarser than the recording grid\n", DH);
+        if(bbox[0]-xorig<ND*DH || xorig+NX*DH-bbox[1]<ND*DH || bbox[2]-yorig<ND*DH ||
+           yorig+NY*DH-bbox[3]<ND*DH || nzt*DH-bbox[4]<ND*DH)
+           printf("DRM: warning, the box reaches into the absorbing layer\n");
+     }
+
+     buildrows(xls, xre, yls, yre, &d1[0][0][0], &lam[0][0][0], &mu[0][0][0], &qp[0][0][0], &qs[0][0][0],
+               &vx1[0][0][0], dcrjx, dcrjy, dcrjz);
+
+     // the point table, only needed by ranks with background points
+     npts  = inhdr.npts;
+     table = (int *)malloc(sizeof(int)*3*(ncol>0 ? npts : 1));
+     MPI_File_read_at_all(infh, sizeof(DrmHeader), table, (ncol>0 ? 3*npts : 0), MPI_INT, MPI_STATUS_IGNORE);
+     err = (ncol>0 ? interpolation(npts, table) : 0);
+     free(table);
+     MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MIN, MCW);
+     if(err) return -1;
+
+     n = (hi>=lo ? hi-lo+1 : 1);
+     for(i=0;i<3;i++)
+     {
+        cache[i]  = (float *)malloc(sizeof(float)*9*n);
+        cached[i] = -1;
+     }
+     bg    = (float *)malloc(sizeof(float)*(ncol+1));
+     delta = (float *)malloc(sizeof(float)*(nrow+1));
+     if(!CPU && nrow>0)
+     {
+        cudaMalloc((void**)&d_rowpos, sizeof(int)*nrow);
+        cudaMemcpy(d_rowpos, rowpos, sizeof(int)*nrow, cudaMemcpyHostToDevice);
+        cudaMalloc((void**)&d_delta, sizeof(float)*nrow);
+     }
+     k = nrow;
+     MPI_Reduce(&k, &n, 1, MPI_INT, MPI_SUM, 0, MCW);
+     if(rank==0) printf("DRM: %d correction points\n", n);
+  }
+  return 0;
+}
+
+// records the fields after step cur_step
+static void record(long cur_step, float **fld)
+{
+  int        v, n;
+  MPI_Offset disp;
+
+  if(cur_step%rechdr.skip) return;
+  for(v=0;v<9;v++)
+  {
+     if(drmcpu)
+       for(n=0;n<nrecpt;n++) recbuf[v*nrecpt+n] = fld[v][recpos[n]];
+     else if(nrecpt>0)
+       drmgather_H(d_recbuf+v*nrecpt, d_recpos, nrecpt, fld[v]);
+  }
+  if(!drmcpu && nrecpt>0)
+     cudaMemcpy(recbuf, d_recbuf, sizeof(float)*9*nrecpt, cudaMemcpyDeviceToHost);
+  for(v=0;v<9;v++)
+  {
+     disp = sizeof(DrmHeader) + sizeof(int)*3*rechdr.npts
+          + sizeof(float)*((MPI_Offset)rechdr.nrec*9*rechdr.npts + v*rechdr.npts + recoff);
+     MPI_File_write_at_all(recfh, disp, recbuf+v*nrecpt, nrecpt, MPI_FLOAT, MPI_STATUS_IGNORE);
+  }
+  rechdr.nrec++;
+  return;
+}
+
+// record r (0 = the zero initial state) in cache slot r%3
+static float *getrecord(int r)
+{
+  int        s = r%3, v, n = hi-lo+1;
+  MPI_Offset disp;
+
+  if(r>inhdr.nrec)
+  {
+     if(!clamped) printf("%d) DRM: past the last record, holding it\n", myrank);
+     clamped = 1;
+     r = inhdr.nrec;
+     s = r%3;
+  }
+  if(cached[s]==r) return cache[s];
+  if(r==0)
+    memset(cache[s], 0, sizeof(float)*9*n);
+  else
+    for(v=0;v<9;v++)
+    {
+       disp = sizeof(DrmHeader) + sizeof(int)*3*inhdr.npts
+            + sizeof(float)*((MPI_Offset)(r-1)*9*inhdr.npts + v*inhdr.npts + lo);
+       MPI_File_read_at(infh, disp, cache[s]+v*n, n, MPI_FLOAT, MPI_STATUS_IGNORE);
+    }
+  cached[s] = r;
+  return cache[s];
+}
+
+// background of field g at time t from the records, fractional record number
+static void background(double fr, int vel)
+{
+  int    t, k, r = (int)floor(fr+1.0e-6), n = hi-lo+1;
+  double w = fr - r;
+  float  *a, *b, va, vb;
+
+  if(w<1.0e-6) w = 0.0;
+  a = getrecord(r);
+  b = (w>0.0 ? getrecord(r+1) : a);
+  if(b==a) w = 0.0;
+  for(t=0;t<ncol;t++)
+  {
+     if((colg[t]<3)!=vel) continue;
+     va = 0.0;
+     vb = 0.0;
+     for(k=0;k<8;k++)
+     {
+        if(colidx[8*t+k]<0) continue;
+        va += colw[8*t+k]*a[colg[t]*n + colidx[8*t+k]-lo];
+        vb += colw[8*t+k]*b[colg[t]*n + colidx[8*t+k]-lo];
+     }
+     bg[t] = (1.0-w)*va + w*vb;
+  }
+  return;
+}
+
+// adds the corrections after the stress update of step cur_step
+static void inject(long cur_step, float **fld)
+{
+  int    f, t, e;
+  double tr = inhdr.skip*(double)inhdr.dt;
+  float  s, *p;
+
+  if(nrow==0) return;
+  // stresses at cur_step*DT, velocities half a step earlier; record r holds
+  // the stresses at r*tr and the velocities at r*tr - dt/2 of the recording grid
+  background(cur_step*(double)d_DT/tr, 0);
+  background(((cur_step-0.5)*d_DT + 0.5*inhdr.dt)/tr, 1);
+  for(t=0;t<nrow;t++)
+  {
+     s = 0.0;
+     for(e=rowptr[t];e<rowptr[t+1];e++) s += entcoef[e]*bg[entcol[e]];
+     delta[t] = s;
+  }
+  if(drmcpu)
+    for(f=0;f<NFLD;f++)
+    {
+       p = fld[f];
+       for(t=rowoff[f];t<rowoff[f+1];t++) p[rowpos[t]] += delta[t];
+    }
+  else
+  {
+     cudaMemcpy(d_delta, delta, sizeof(float)*nrow, cudaMemcpyHostToDevice);
+     for(f=0;f<NFLD;f++)
+       if(rowoff[f+1]>rowoff[f])
+         drmadd_H(fld[f], d_rowpos+rowoff[f], d_delta+rowoff[f], rowoff[f+1]-rowoff[f]);
+     cudaThreadSynchronize();
+  }
+  return;
+}
+
+// fld: u1,v1,w1,xx,yy,zz,xy,xz,yz,r1..r6, host arrays with --CPU 1, device arrays otherwise
+void drmstep(long cur_step, float **fld)
+{
+  if(inj) inject(cur_step, fld);
+  if(rec) record(cur_step, fld);
+  return;
+}
+
+void drmclose(int rank)
+{
+  int i;
+
+  if(rec)
+  {
+     if(rank==0) MPI_File_write_at(recfh, 0, &rechdr, sizeof(DrmHeader), MPI_BYTE, MPI_STATUS_IGNORE);
+     MPI_File_close(&recfh);
+     if(rank==0) printf("DRM: %d records written\n", rechdr.nrec);
+     free(recpos);
+     free(recbuf);
+     if(d_recpos) cudaFree(d_recpos);
+     if(d_recbuf) cudaFree(d_recbuf);
+  }
+  if(inj)
+  {
+     MPI_File_close(&infh);
+     free(rowpos);  free(rowptr);  free(entcol);  free(entcoef);
+     free(colg);    free(colpos);  free(colidx);  free(colw);    free(bg);  free(delta);
+     for(i=0;i<3;i++) free(cache[i]);
+     if(d_rowpos) cudaFree(d_rowpos);
+     if(d_delta)  cudaFree(d_delta);
+  }
+  rec     = 0;
+  inj     = 0;
+  clamped = 0;
+  return;
+}
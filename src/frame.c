@@ -0,0 +1,283 @@
+/**
+@section LICENSE
+Copyright (c) 2013-2016, Regents of the University of California
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*
+********************************************************************************
+* frame.c                                                                      *
+* in-situ movie frames of the surface velocity magnitude (--FRAMES)            *
+*                                                                              *
+* Every FRAMES steps each rank takes |v| on the free surface of its block at   *
+* every FRAMESKIP-th grid point in x and y, and maps it to 8 bits against a    *
+* fixed scale FRAMEVMAX (m/s) or, with FRAMEVMAX 0, the largest |v| of the     *
+* frame over all ranks. The 8-bit tiles are gathered to rank 0 with one        *
+* MPI_Gatherv and written as FRAMEOUT_<step>.png, colour mapped and deflated   *
+* with zlib (FRAMEFMT 0), or as the bare 8-bit values FRAMEOUT_<step>.raw,     *
+* W x H bytes (FRAMEFMT 1). North (y = NY) is the top row of an image.         *
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <zlib.h>
+#include "pmcl3d.h"
+
+static int      f_skip, f_fmt, f_cpu, f_rank, f_size;
+static float    f_vmax;
+static char     f_out[50];
+static MPI_Comm f_comm;
+static int      f_n, f_W, f_H;                  // local pixels, image size
+static int      *f_pos = NULL, *d_f_pos = NULL;
+static float    *f_v = NULL, *d_f_v = NULL;
+static unsigned char *f_tile = NULL, *f_all = NULL, *f_img = NULL;
+static int      *f_box = NULL, *f_cnt = NULL, *f_dsp = NULL;    // rank 0: x0, y0, w, h of every tile
+
+// dark violet - red - orange - white, like the usual perceptual maps
+static void colour(int c, unsigned char *rgb)
+{
+  static const float knot[5][3] = {{0,0,0}, {60,10,120}, {200,40,70}, {250,160,20}, {255,255,230}};
+  float x = c*4.0f/255.0f, w;
+  int   k = (int)x, i;
+
+  if(k>3) k = 3;
+  w = x-k;
+  for(i=0;i<3;i++)
+     rgb[i] = (unsigned char)(knot[k][i]+w*(knot[k+1][i]-knot[k][i])+0.5f);
+  return;
+}
+
+static void put32(unsigned char *p, unsigned long v)
+{
+  p[0] = (v>>24)&0xff;
+  p[1] = (v>>16)&0xff;
+  p[2] = (v>>8)&0xff;
+  p[3] = v&0xff;
+  return;
+}
+
+static void chunk(FILE *fp, const char *type, unsigned char *data, unsigned long len)
+{
+  unsigned char b[4];
+  unsigned long crc;
+
+  put32(b, len);
+  fwrite(b, 1, 4, fp);
+  fwrite(type, 1, 4, fp);
+  if(len>0) fwrite(data, 1, len, fp);
+  crc = crc32(0L, (const Bytef *)type, 4);
+  if(len>0) crc = crc32(crc, data, len);
+  put32(b, crc);
+  fwrite(b, 1, 4, fp);
+  return;
+}
+
+// 8-bit image f_img of W x H to an RGB PNG
+static int writepng(char *name)
+{
+  static const unsigned char sig[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+  unsigned char hdr[13], *raw, *z;
+  unsigned long nraw = (unsigned long)f_H*(3*f_W+1), nz = compressBound(nraw);
+  long  i, j;
+  FILE  *fp;
+
+  raw = (unsigned char *)malloc(nraw);
+  z   = (unsigned char *)malloc(nz);
+  for(j=0;j<f_H;j++)
+  {
+     raw[j*(3*f_W+1)] = 0;          // no filter
+     for(i=0;i<f_W;i++)
+        colour(f_img[j*f_W+i], raw+j*(3*f_W+1)+1+3*i);
+  }
+  if(compress2(z, &nz, raw, nraw, Z_DEFAULT_COMPRESSION)!=Z_OK)
+  {
+     printf("frame %s: deflate failed\n", name);
+     free(raw);  free(z);
+     return -1;
+  }
+  fp = fopen(name, "wb");
+  if(!fp)
+  {
+     printf("can't open frame %s\n", name);
+     free(raw);  free(z);
+     return -1;
+  }
+  put32(hdr, f_W);
+  put32(hdr+4, f_H);
+  hdr[8]  = 8;      // bit depth
+  hdr[9]  = 2;      // RGB
+  hdr[10] = 0;
+  hdr[11] = 0;
+  hdr[12] = 0;
+  fwrite(sig, 1, 8, fp);
+  chunk(fp, "IHDR", hdr, 13);
+  chunk(fp, "IDAT", z, nz);
+  chunk(fp, "IEND", NULL, 0);
+  fclose(fp);
+  free(raw);
+  free(z);
+  return 0;
+}
+
+int frameinit(int FRAMESKIP, float FRAMEVMAX, int FRAMEFMT, char *FRAMEOUT, int CPU, int rank, int size, MPI_Comm MCW,
+              int *coord, int NX, int NY, int nxt, int nyt, int nzt)
+{
+  int i, j, x0, y0, w, h, n, box[4];
+
+  if(FRAMESKIP<1 || FRAMEFMT<0 || FRAMEFMT>1)
+  {
+     if(rank==0) printf("FRAMESKIP must be positive and FRAMEFMT 0 or 1\n");
+     return -1;
+  }
+  f_skip = FRAMESKIP;
+  f_vmax = FRAMEVMAX;
+  f_fmt  = FRAMEFMT;
+  f_cpu  = CPU;
+  f_rank = rank;
+  f_size = size;
+  f_comm = MCW;
+  strcpy(f_out, FRAMEOUT);
+  f_W    = (NX+f_skip-1)/f_skip;
+  f_H    = (NY+f_skip-1)/f_skip;
+
+  // pixels of this block: grid points with a global index divisible by FRAMESKIP
+  x0 = (nxt*coord[0]+f_skip-1)/f_skip;
+  y0 = (nyt*coord[1]+f_skip-1)/f_skip;
+  w  = (nxt*(coord[0]+1)+f_skip-1)/f_skip-x0;
+  h  = (nyt*(coord[1]+1)+f_skip-1)/f_skip-y0;
+  f_n    = w*h;
+  f_pos  = (int *)malloc(sizeof(int)*(f_n>0 ? f_n : 1));
+  f_v    = (float *)malloc(sizeof(float)*3*(f_n>0 ? f_n : 1));
+  f_tile = (unsigned char *)malloc(f_n>0 ? f_n : 1);
+  n = 0;
+  for(j=0;j<h;j++)
+     for(i=0;i<w;i++)
+        f_pos[n++] = gridcol((x0+i)*f_skip-nxt*coord[0]+2+4*loop, (y0+j)*f_skip-nyt*coord[1]+2+4*loop) + nzt+align-1;
+  if(!CPU && f_n>0)
+  {
+     cudaMalloc((void**)&d_f_pos, sizeof(int)*f_n);
+     cudaMalloc((void**)&d_f_v, sizeof(float)*3*f_n);
+     cudaMemcpy(d_f_pos, f_pos, sizeof(int)*f_n, cudaMemcpyHostToDevice);
+  }
+
+  box[0] = x0;  box[1] = y0;  box[2] = w;  box[3] = h;
+  if(rank==0)
+  {
+     f_box = (int *)malloc(sizeof(int)*4*size);
+     f_cnt = (int *)malloc(sizeof(int)*size);
+     f_dsp = (int *)malloc(sizeof(int)*size);
+     f_all = (unsigned char *)malloc((size_t)f_W*f_H);
+     f_img = (unsigned char *)malloc((size_t)f_W*f_H);
+  }
+  MPI_Gather(box, 4, MPI_INT, f_box, 4, MPI_INT, 0, MCW);
+  if(rank==0)
+  {
+     for(i=0,n=0;i<size;i++)
+     {
+        f_cnt[i] = f_box[4*i+2]*f_box[4*i+3];
+        f_dsp[i] = n;
+        n       += f_cnt[i];
+     }
+     printf("surface frames %d x %d pixels, every %d grid points, %s, scale %s\n", f_W, f_H, f_skip,
+            (f_fmt==0 ? "PNG" : "raw 8-bit"), (f_vmax>0.0 ? "fixed" : "auto"));
+  }
+  return 0;
+}
+
+void framestep(long cur_step, float *u1, float *v1, float *w1)
+{
+  int   i, j, r, *b;
+  float *u = f_v, *v = f_v+f_n, *w = f_v+2*f_n, m, vmax = 0.0f;
+  char  name[80];
+
+  if(f_n>0)
+  {
+     if(f_cpu)
+        for(i=0;i<f_n;i++)
+        {
+           u[i] = u1[f_pos[i]];
+           v[i] = v1[f_pos[i]];
+           w[i] = w1[f_pos[i]];
+        }
+     else
+     {
+        drmgather_H(d_f_v,       d_f_pos, f_n, u1);
+        drmgather_H(d_f_v+f_n,   d_f_pos, f_n, v1);
+        drmgather_H(d_f_v+2*f_n, d_f_pos, f_n, w1);
+        cudaMemcpy(f_v, d_f_v, sizeof(float)*3*f_n, cudaMemcpyDeviceToHost);
+     }
+     for(i=0;i<f_n;i++)
+     {
+        u[i] = sqrtf(u[i]*u[i]+v[i]*v[i]+w[i]*w[i]);
+        if(u[i]>vmax) vmax = u[i];
+     }
+  }
+  if(f_vmax>0.0)
+     vmax = f_vmax;
+  else
+     MPI_Allreduce(MPI_IN_PLACE, &vmax, 1, MPI_FLOAT, MPI_MAX, f_comm);
+  for(i=0;i<f_n;i++)
+  {
+     m = (vmax>0.0f ? 255.0f*u[i]/vmax : 0.0f);
+     f_tile[i] = (unsigned char)(m<255.0f ? m+0.5f : 255.0f);
+  }
+  MPI_Gatherv(f_tile, f_n, MPI_UNSIGNED_CHAR, f_all, f_cnt, f_dsp, MPI_UNSIGNED_CHAR, 0, f_comm);
+  if(f_rank!=0)
+     return;
+
+  for(r=0;r<f_size;r++)
+  {
+     b = f_box+4*r;
+     for(j=0;j<b[3];j++)
+        memcpy(f_img+(long)(f_H-1-b[1]-j)*f_W+b[0], f_all+f_dsp[r]+j*b[2], b[2]);
+  }
+  if(f_fmt==0)
+  {
+     sprintf(name, "%s_%07ld.png", f_out, cur_step);
+     writepng(name);
+  }
+  else
+  {
+     FILE *fp;
+     sprintf(name, "%s_%07ld.raw", f_out, cur_step);
+     fp = fopen(name, "wb");
+     if(!fp)
+        printf("can't open frame %s\n", name);
+     else
+     {
+        fwrite(f_img, 1, (size_t)f_W*f_H, fp);
+        fclose(fp);
+     }
+  }
+  return;
+}
+
+void frameclose()
+{
+  free(f_pos);
+  free(f_v);
+  free(f_tile);
+  cudaFree(d_f_pos);
+  cudaFree(d_f_v);
+  if(f_rank==0)
+  {
+     free(f_box);
+     free(f_cnt);
+     free(f_dsp);
+     free(f_all);
+     free(f_img);
+  }
+  f_pos = d_f_pos = NULL;
+  f_v   = d_f_v   = NULL;
+  return;
+}
@@ -23,12 +23,102 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <limits.h>
 #include "pmcl3d.h"
 
+// Column bricks (--CPUBRICK): the nz floats of column (i,j) stay contiguous,
+// but the columns are grouped into b x b bricks stored one after the other,
+// x-major over the bricks and inside a brick. The i+-1 and j+-1 neighbours of
+// a column are then mostly within b*b*nz floats instead of a yz plane away.
+// b = 1 is the flat layout.
+//
+// Column records (--CPUREC): the nrec padded fields from AllocField share one
+// array holding, per column, the nz floats of every field side by side. The
+// velocity, stress, memory variable and material columns a kernel reads at
+// (i,j) are then one contiguous record of nrec*nz floats instead of nrec
+// streams in separate arrays.
+//
+// U[i][j][k] works for every layout; flat offsets of the padded fields come
+// from gridcol and are the same for all of them.
+static int    g_b = 1, g_nx = 1, g_ny = 1, g_nz = 1, g_nbj = 1, g_nrec = 1, g_nfield = 0;
+static Grid3D g_rec = NULL;
+
+static long brickcol(int i, int j, int b, int nbj)
+{
+   return (long)(i/b*nbj + j/b)*b*b + (i%b)*b + j%b;
+}
+
+// layout of the padded nx x ny x nz fields: b x b bricks, nrec fields per record
+void SetFieldLayout(int b, int nrec, int nx, int ny, int nz)
+{
+   g_b      = (b>1 ? b : 1);
+   g_nrec   = (nrec>1 ? nrec : 1);
+   g_nx     = nx;
+   g_ny     = ny;
+   g_nz     = nz;
+   g_nbj    = (ny+g_b-1)/g_b;
+   g_nfield = 0;
+   g_rec    = NULL;
+   return;
+}
+
+// offset of column (i,j) of a padded field from its first float
+long gridcol(int i, int j)
+{
+   return brickcol(i, j, g_b, g_nbj)*g_nrec*g_nz;
+}
+
+// next padded field; the first field of the records owns their memory, the
+// others only their pointer tables
+Grid3D AllocField(void)
+{
+   int    i, j;
+   Grid3D U;
+
+   if(g_nrec==1)
+      return Alloc3DB(g_nx, g_ny, g_nz, g_b);
+   if(g_nfield==g_nrec)
+   {
+      printf("Cannot allocate more than %d fields in the column records\n", g_nrec);
+      exit(-1);
+   }
+   if(g_nfield++==0)
+   {
+      // positions stay int, as in the separate arrays
+      if((double)(g_nx+g_b)*(g_ny+g_b)*g_nrec*g_nz>INT_MAX)
+      {
+         printf("Cannot index %d-field column records of %dx%dx%d, use separate arrays\n", g_nrec, g_nx, g_ny, g_nz);
+         exit(-1);
+      }
+      return g_rec = Alloc3DB(g_nx, g_ny, g_nrec*g_nz, g_b);
+   }
+
+   U = (Grid3D)malloc(sizeof(float**)*g_nx + sizeof(float *)*g_nx*g_ny);
+   if (!U){
+       printf("Cannot allocate 3D float array\n");
+       exit(-1);
+   }
+   for(i=0;i<g_nx;i++)
+   {
+       U[i] = ((float**) U) + g_nx + i*g_ny;
+       for(j=0;j<g_ny;j++)
+           U[i][j] = g_rec[i][j] + (g_nfield-1)*g_nz;
+   }
+   return U;
+}
+
 Grid3D Alloc3D(int nx, int ny, int nz)
 {
-   int i, j, k;
-   Grid3D U = (Grid3D)malloc(sizeof(float**)*nx + sizeof(float *)*nx*ny +sizeof(float)*nx*ny*nz);
+   return Alloc3DB(nx, ny, nz, 1);
+}
+
+// nx x ny x nz array in b x b column bricks, partial bricks at the high i and j
+// ends are padded
+Grid3D Alloc3DB(int nx, int ny, int nz, int b)
+{
+   int  i, j, k, nbj = (ny+b-1)/b;
+   long ncol = (long)((nx+b-1)/b)*nbj*b*b;
+   Grid3D U = (Grid3D)malloc(sizeof(float**)*nx + sizeof(float *)*nx*ny +sizeof(float)*ncol*nz);
 
    if (!U){
        printf("Cannot allocate 3D float array\n");
@@ -41,8 +131,10 @@ Grid3D Alloc3D(int nx, int ny, int nz)
    float *Ustart = (float *) (U[nx-1] + ny);
    for(i=0;i<nx;i++)
        for(j=0;j<ny;j++)
-           U[i][j] = Ustart + i*ny*nz + j*nz;
+           U[i][j] = Ustart + brickcol(i, j, b, nbj)*nz;
 
+   // first touch by the threads that later sweep the array
+#pragma omp parallel for private(j,k)
    for(i=0;i<nx;i++)
        for(j=0;j<ny;j++)
            for(k=0;k<nz;k++)
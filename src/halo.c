@@ -0,0 +1,208 @@
+/**
+@section LICENSE
+Copyright (c) 2013-2016, Regents of the University of California
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*
+********************************************************************************
+* halo.c                                                                       *
+* reduced precision velocity halo messages (--HALOFMT)                         *
+*                                                                              *
+* The packed x and y messages (SL_vel, SF_vel, ...) hold u1, v1 and w1 of      *
+* 4*loop ghost planes each, 12*loop planes of equal length. With HALOFMT > 0   *
+* every float is sent as 16 bits and expanded again on receipt:                *
+*   1  IEEE fp16, round to nearest even, |v| below 6e-8 is lost                *
+*   2  bf16, the upper half of the fp32 word rounded to nearest even           *
+*   3  int16 times a per-plane scale max|v|/32767, the scales lead the message *
+* The encoded message is a float array of halowords() words so PostSendMsg_*   *
+* and PostRecvMsg_* send it unchanged; the bits are never converted by MPI.    *
+*                                                                              *
+* Every encode also decodes, and the largest round-trip error relative to the  *
+* largest |v| sent is reported at the end of the run with the bytes saved.     *
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "pmcl3d.h"
+
+static int    h_fmt = 0, h_nplane;
+static double h_err = 0.0, h_max = 0.0;         // largest round-trip error and |v| sent
+static double h_bytes = 0.0, h_bytes32 = 0.0;   // bytes sent, and as fp32
+static const char *h_name[4] = {"fp32", "fp16", "bf16", "int16"};
+
+typedef union { float f; unsigned int u; } word;
+
+static unsigned short tohalf(float f)
+{
+  word         v;
+  unsigned int u, sign, mant, m, rem, half;
+  int          shift;
+
+  v.f  = f;
+  sign = (v.u>>16)&0x8000;
+  u    = v.u&0x7fffffff;
+  if(u>=0x7f800000)               // inf, nan
+     return sign|0x7c00|(u>0x7f800000 ? 0x200 : 0);
+  if(u>=0x477ff000)               // rounds above 65504
+     return sign|0x7c00;
+  if(u<0x38800000)                // fp16 subnormal
+  {
+     if(u<0x33000000)
+        return sign;
+     shift = 126-(u>>23);
+     mant  = (u&0x7fffff)|0x800000;
+     m     = mant>>shift;
+     rem   = mant&((1u<<shift)-1);
+     half  = 1u<<(shift-1);
+     if(rem>half || (rem==half && (m&1))) m++;
+     return sign|m;
+  }
+  u -= 0x38000000;                // rebias 127 -> 15
+  return sign|((u+0xfff+((u>>13)&1))>>13);
+}
+
+static float fromhalf(unsigned short h)
+{
+  word         v;
+  unsigned int e = (h>>10)&0x1f, m = h&0x3ff;
+
+  if(e==0)
+     return (h&0x8000 ? -1.0f : 1.0f)*m*5.9604644775390625e-8f;    // m * 2^-24
+  v.u = ((unsigned int)(h&0x8000)<<16) | (e==31 ? 0x7f800000 : (e+112)<<23) | (m<<13);
+  return v.f;
+}
+
+static unsigned short tobf16(float f)
+{
+  word v;
+
+  v.f = f;
+  if((v.u&0x7fffffff)>0x7f800000)
+     return (v.u>>16)|0x40;
+  return (v.u+0x7fff+((v.u>>16)&1))>>16;
+}
+
+static float frombf16(unsigned short h)
+{
+  word v;
+
+  v.u = (unsigned int)h<<16;
+  return v.f;
+}
+
+// message words of a packed message of n floats
+int halowords(int n)
+{
+  return (h_fmt==3 ? h_nplane : 0) + (n+1)/2;
+}
+
+int haloinit(int HALOFMT, int rank)
+{
+  if(HALOFMT<0 || HALOFMT>3)
+  {
+     if(rank==0) printf("HALOFMT must be 0, 1, 2 or 3\n");
+     return -1;
+  }
+  h_fmt    = HALOFMT;
+  h_nplane = 12*loop;
+  h_err    = h_max     = 0.0;
+  h_bytes  = h_bytes32 = 0.0;
+  if(rank==0 && h_fmt>0)
+     printf("halo messages in %s%s\n", h_name[h_fmt], (h_fmt==3 ? ", one scale per ghost plane" : ""));
+  return 0;
+}
+
+// packed message msg of n floats to the encoded message enc
+void haloenc(float *msg, float *enc, int n)
+{
+  unsigned short *q;
+  float  *scale = enc, m, r;
+  int    p, i, bad, plen = n/h_nplane;
+  double err = 0.0, vmax = 0.0;
+
+  q = (unsigned short *)(enc + (h_fmt==3 ? h_nplane : 0));
+  if(h_fmt==3)
+  {
+     for(p=0;p<h_nplane;p++)
+     {
+        m   = 0.0f;
+        bad = 0;
+        for(i=p*plen;i<(p+1)*plen;i++)
+        {
+           if(!isfinite(msg[i]))    bad = 1;
+           else if(fabsf(msg[i])>m) m   = fabsf(msg[i]);
+        }
+        // a non-finite plane arrives as NaN so the health monitor still sees it
+        scale[p] = (bad ? nanf("") : m/32767.0f);
+        for(i=p*plen;i<(p+1)*plen;i++)
+        {
+           q[i] = (unsigned short)(short)(scale[p]>0.0f ? lrintf(msg[i]/scale[p]) : 0);
+           r    = (short)q[i]*scale[p];
+           if(fabs(r-msg[i])>err) err = fabs(r-msg[i]);
+           if(fabsf(msg[i])>vmax) vmax = fabsf(msg[i]);
+        }
+     }
+  }
+  else
+     for(i=0;i<n;i++)
+     {
+        q[i] = (h_fmt==1 ? tohalf(msg[i]) : tobf16(msg[i]));
+        r    = (h_fmt==1 ? fromhalf(q[i]) : frombf16(q[i]));
+        if(fabs(r-msg[i])>err) err = fabs(r-msg[i]);
+        if(fabsf(msg[i])>vmax) vmax = fabsf(msg[i]);
+     }
+  if(err>h_err)   h_err = err;
+  if(vmax>h_max)  h_max = vmax;
+  h_bytes   += sizeof(float)*halowords(n);
+  h_bytes32 += sizeof(float)*n;
+  return;
+}
+
+// encoded message enc to the packed message msg of n floats
+void halodec(float *enc, float *msg, int n)
+{
+  unsigned short *q;
+  int    p, i, plen = n/h_nplane;
+
+  q = (unsigned short *)(enc + (h_fmt==3 ? h_nplane : 0));
+  if(h_fmt==3)
+  {
+     for(p=0;p<h_nplane;p++)
+        for(i=p*plen;i<(p+1)*plen;i++)
+           msg[i] = (short)q[i]*enc[p];
+  }
+  else if(h_fmt==1)
+     for(i=0;i<n;i++)
+        msg[i] = fromhalf(q[i]);
+  else
+     for(i=0;i<n;i++)
+        msg[i] = frombf16(q[i]);
+  return;
+}
+
+// accuracy and traffic of the reduced halos against the fp32 exchange
+void haloclose(int rank, MPI_Comm MCW)
+{
+  double a[2] = {h_err, h_max}, b[2] = {h_bytes, h_bytes32}, amax[2], bsum[2];
+
+  if(h_fmt==0)
+     return;
+  MPI_Reduce(a, amax, 2, MPI_DOUBLE, MPI_MAX, 0, MCW);
+  MPI_Reduce(b, bsum, 2, MPI_DOUBLE, MPI_SUM, 0, MCW);
+  // nothing sent when pmcl3d_create failed after haloinit
+  if(rank==0 && bsum[1]>0.0)
+     printf("halo %s: max round-trip error %e of max |v| %e (relative %e), %.1f MB sent instead of %.1f MB\n",
+            h_name[h_fmt], amax[0], amax[1], (amax[1]>0.0 ? amax[0]/amax[1] : 0.0), bsum[0]/1.0e6, bsum[1]/1.0e6);
+  h_fmt = 0;
+  return;
+}
@@ -47,3 +47,67 @@ int writeCHK(char *chkfile, int ntiskp, float dt, float dh,
 
 return 0;
 }
+
+// filetype of one output batch: rec_nxt*rec_nyt*rec_nzt block of the rec_NX*rec_NY*rec_NZ lattice,
+// WRITE_STEP times
+void recfiletype(int rec_NX, int rec_NY, int rec_NZ, int rec_nxt, int rec_nyt, int rec_nzt,
+                 int WRITE_STEP, MPI_Datatype *filetype)
+{
+  int i, maxNX_NY_NZ_WS;
+  int *ones;
+  MPI_Aint *dispArray;
+  MPI_Datatype rowtype, planetype, steptype;
+
+  maxNX_NY_NZ_WS = (rec_NX>rec_NY?rec_NX:rec_NY);
+  maxNX_NY_NZ_WS = (maxNX_NY_NZ_WS>rec_NZ?maxNX_NY_NZ_WS:rec_NZ);
+  maxNX_NY_NZ_WS = (maxNX_NY_NZ_WS>WRITE_STEP?maxNX_NY_NZ_WS:WRITE_STEP);
+  ones      = (int *)malloc(sizeof(int)*maxNX_NY_NZ_WS);
+  dispArray = (MPI_Aint *)malloc(sizeof(MPI_Aint)*maxNX_NY_NZ_WS);
+  for(i=0;i<maxNX_NY_NZ_WS;++i){
+    ones[i] = 1;
+  }
+
+  MPI_Type_contiguous(rec_nxt, MPI_FLOAT, &rowtype);
+  for(i=0;i<rec_nyt;i++){
+    dispArray[i] = sizeof(float);
+    dispArray[i] = dispArray[i]*rec_NX*i;
+  }
+  MPI_Type_create_hindexed(rec_nyt, ones, dispArray, rowtype, &planetype);
+  for(i=0;i<rec_nzt;i++){
+    dispArray[i] = sizeof(float);
+    dispArray[i] = dispArray[i]*rec_NY*rec_NX*i;
+  }
+  MPI_Type_create_hindexed(rec_nzt, ones, dispArray, planetype, &steptype);
+  for(i=0;i<WRITE_STEP;i++){
+    dispArray[i] = sizeof(float);
+    dispArray[i] = dispArray[i]*rec_NZ*rec_NY*rec_NX*i;
+  }
+  MPI_Type_create_hindexed(WRITE_STEP, ones, dispArray, steptype, filetype);
+  MPI_Type_commit(filetype);
+  MPI_Type_free(&rowtype);
+  MPI_Type_free(&planetype);
+  MPI_Type_free(&steptype);
+  free(ones);
+  free(dispArray);
+  return;
+}
+
+// collective write of one output batch on the output communicator
+int writeout(char *filename, MPI_Comm MCO, MPI_Offset displacement, MPI_Datatype filetype,
+             MPI_Info info, float *buf, int count)
+{
+  int err;
+  MPI_File   fh;
+  MPI_Status filestatus;
+
+  err = MPI_File_open(MCO,filename,MPI_MODE_CREATE|MPI_MODE_WRONLY,info,&fh);
+  if(err!=MPI_SUCCESS)
+  {
+     printf("can't open output file %s\n", filename);
+     return -1;
+  }
+  err = MPI_File_set_view(fh, displacement, MPI_FLOAT, filetype, "native", info);
+  err = MPI_File_write_all(fh, buf, count, MPI_FLOAT, &filestatus);
+  err = MPI_File_close(&fh);
+  return err;
+}
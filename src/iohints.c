@@ -0,0 +1,206 @@
+/**
+@section LICENSE
+Copyright (c) 2013-2016, Regents of the University of California
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+********************************************************************************
+* iohints.c                                                                    *
+* MPI-IO hints per file class                                                  *
+*                                                                              *
+* The IOHINTS file has one section per file class with key = value lines,      *
+* passed unchanged to MPI_Info_set ('#' starts a comment):                     *
+*                                                                              *
+*  [media]                                                                     *
+*  cb_nodes = 64                                                               *
+*  [output]                                                                    *
+*  romio_cb_write = enable                                                     *
+*  striping_factor = 32                                                        *
+*                                                                              *
+* [media] is the collective media read in inimesh, [output] the SX/SY/SZ       *
+* batches and SIDX. Classes without a section use MPI_INFO_NULL.               *
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "pmcl3d.h"
+
+static char *trim(char *s)
+{
+  char *e;
+
+  while(isspace((unsigned char)*s)) s++;
+  e = s + strlen(s);
+  while(e>s && isspace((unsigned char)e[-1])) e--;
+  *e = '\0';
+  return s;
+}
+
+int iohints(char *IOHINTS, int rank, MPI_Comm MCW, MPI_Info *mediainfo, MPI_Info *outinfo)
+{
+  FILE     *fp;
+  char     *text = NULL, *line, *next, *eq, *key;
+  long     len = 0;
+  MPI_Info *cur = NULL;
+
+  *mediainfo = MPI_INFO_NULL;
+  *outinfo   = MPI_INFO_NULL;
+  if(!IOHINTS[0]) return 0;
+
+  // rank 0 reads the whole file, the others get its length first
+  if(rank==0)
+  {
+     fp = fopen(IOHINTS, "r");
+     if(!fp)
+     {
+        printf("can't open I/O hints file %s\n", IOHINTS);
+        len = -1;
+     }
+     else
+     {
+        if(fseek(fp, 0, SEEK_END) || (len = ftell(fp))<0 || fseek(fp, 0, SEEK_SET))
+           len = -1;
+        else
+        {
+           text = (char *)malloc(len+1);
+           if(fread(text, 1, len, fp)!=(size_t)len) len = -1;
+        }
+        if(len<0) printf("can't read I/O hints file %s\n", IOHINTS);
+        fclose(fp);
+     }
+  }
+  MPI_Bcast(&len, 1, MPI_LONG, 0, MCW);
+  if(len<0)
+  {
+     free(text);
+     return -1;
+  }
+  if(rank!=0) text = (char *)malloc(len+1);
+  MPI_Bcast(text, (int)len, MPI_CHAR, 0, MCW);
+  text[len] = '\0';
+
+  for(line=text;line!=NULL;line=next)
+  {
+     next = strchr(line, '\n');
+     if(next) *next++ = '\0';
+     if(strchr(line, '#')) *strchr(line, '#') = '\0';
+     line = trim(line);
+     if(!line[0]) continue;
+     if(line[0]=='[')
+     {
+        if(strncmp(line, "[media]", 7)==0)       cur = mediainfo;
+        else if(strncmp(line, "[output]", 8)==0) cur = outinfo;
+        else
+        {
+           if(rank==0) printf("I/O hints: unknown section %s ignored\n", line);
+           cur = NULL;
+        }
+        continue;
+     }
+     eq = strchr(line, '=');
+     if(!eq || !cur) continue;
+     *eq = '\0';
+     key = trim(line);
+     if(*cur==MPI_INFO_NULL) MPI_Info_create(cur);
+     MPI_Info_set(*cur, key, trim(eq+1));
+     if(rank==0) printf("I/O hints: %s %s = %s\n", (cur==mediainfo ? "media" : "output"), key, trim(eq+1));
+  }
+  free(text);
+  return 0;
+}
+
+// tries hint combinations for one output batch on OUT/iotune.tmp and reports the fastest
+void iotune(char *OUT, int IOTUNE, MPI_Comm MCO, MPI_Offset displacement, MPI_Datatype filetype, int count)
+{
+  static const char *cbwrite[3] = {NULL, "enable", "disable"};
+  static const char *dswrite[2] = {NULL, "disable"};
+  static const char *stripe[3]  = {NULL, "16", "64"};
+  int    i, a, b, c, d, r, rank, size, ncb, best = -1;
+  long   total;
+  int    cbnodes[3];
+  char   filename[60], value[20];
+  double t, tmin, tbest = 0.0;
+  float  *buf;
+  MPI_Info info;
+
+  MPI_Comm_rank(MCO, &rank);
+  MPI_Comm_size(MCO, &size);
+  cbnodes[0] = 0;
+  cbnodes[1] = (size/8>1 ? size/8 : 1);
+  cbnodes[2] = (size/2>1 ? size/2 : 1);
+  ncb = (size>1 ? 3 : 1);
+  buf = (float *)calloc(count>0 ? count : 1, sizeof(float));
+  total = count;
+  MPI_Allreduce(MPI_IN_PLACE, &total, 1, MPI_LONG, MPI_SUM, MCO);
+  sprintf(filename, "%s/iotune.tmp", OUT);
+  if(rank==0) printf("I/O tuning on %s, %d ranks, %ld floats per batch, %d repetitions\n", filename, size, total, IOTUNE);
+
+  for(i=0,a=0;a<3;a++)
+    for(b=0;b<ncb;b++)
+      for(c=0;c<2;c++)
+        for(d=0;d<3;d++,i++)
+        {
+           MPI_Info_create(&info);
+           if(cbwrite[a]) MPI_Info_set(info, "romio_cb_write", (char *)cbwrite[a]);
+           if(b>0)
+           {
+              sprintf(value, "%d", cbnodes[b]);
+              MPI_Info_set(info, "cb_nodes", value);
+           }
+           if(dswrite[c]) MPI_Info_set(info, "romio_ds_write", (char *)dswrite[c]);
+           if(stripe[d]) MPI_Info_set(info, "striping_factor", (char *)stripe[d]);
+
+           // striping only applies when the file is created
+           tmin = 0.0;
+           for(r=0;r<IOTUNE;r++)
+           {
+              if(rank==0) MPI_File_delete(filename, MPI_INFO_NULL);
+              MPI_Barrier(MCO);
+              t = -MPI_Wtime();
+              writeout(filename, MCO, displacement, filetype, info, buf, count);
+              t += MPI_Wtime();
+              MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE, MPI_MAX, MCO);
+              if(r==0 || t<tmin) tmin = t;
+           }
+           MPI_Info_free(&info);
+           if(rank==0)
+              printf("I/O tuning %2d: romio_cb_write=%-7s cb_nodes=%-5d romio_ds_write=%-7s striping_factor=%-3s %10.6f s\n",
+                     i, (cbwrite[a] ? cbwrite[a] : "-"), cbnodes[b], (dswrite[c] ? dswrite[c] : "-"),
+                     (stripe[d] ? stripe[d] : "-"), tmin);
+           if(best<0 || tmin<tbest)
+           {
+              best  = i;
+              tbest = tmin;
+           }
+        }
+  if(rank==0) MPI_File_delete(filename, MPI_INFO_NULL);
+
+  // the winner as an IOHINTS section
+  if(rank==0)
+  {
+     a = best/(ncb*6);
+     b = (best/6)%ncb;
+     c = (best/3)%2;
+     d = best%3;
+     printf("I/O tuning: best %d (%f s, %f MB/s). IOHINTS:\n[output]\n", best, tbest,
+            (double)total*sizeof(float)/tbest/1.0e6);
+     if(cbwrite[a]) printf("romio_cb_write = %s\n", cbwrite[a]);
+     if(b>0)        printf("cb_nodes = %d\n", cbnodes[b]);
+     if(dswrite[c]) printf("romio_ds_write = %s\n", dswrite[c]);
+     if(stripe[d])  printf("striping_factor = %s\n", stripe[d]);
+  }
+  free(buf);
+  return;
+}
@@ -0,0 +1,308 @@
+/**
+@section LICENSE
+Copyright (c) 2013-2016, Regents of the University of California
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*
+********************************************************************************
+* jobpack.c                                                                    *
+* many small pmcl3d runs in one MPI allocation                                 *
+*                                                                              *
+* mpirun -np 1+N jobpack <job list>                                            *
+*                                                                              *
+* Every line of the job list is one run, '#' starts a comment:                 *
+*   <ranks> <directory> <pmcl3d options>                                       *
+* e.g. "4 site017 -X 64 -Y 64 -Z 128 -x 2 -y 2 --INVEL media.bin -o out ...".  *
+* <ranks> must be PX*PY of the options. The run works in <directory>, so its   *
+* relative paths (INVEL, INSRC, -o, -c, LOGDIR, ...) are its own, and its      *
+* stdout goes to <directory>/pmcl3d.out.                                       *
+*                                                                              *
+* Rank 0 only schedules: in list order it starts every queued run that fits    *
+* the free ranks, on the lowest free ranks, and waits for a run to finish      *
+* before looking again. The ranks of a run build their own communicator with   *
+* MPI_Comm_create_group, which involves them only, and hand it to              *
+* pmcl3d_create, see pmcl3d_api.h.                                             *
+*                                                                              *
+* A malformed line, a run that needs more ranks than there are workers, and a  *
+* run whose options or setup fail in pmcl3d_create are reported as FAILED;     *
+* their ranks go back to the pool and the other runs go on. Only an MPI_Abort  *
+* while a run steps (an output write error, MONACTION 2) still ends the whole  *
+* allocation.                                                                  *
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <mpi.h>
+#include "pmcl3d_api.h"
+
+#define JOBLINE  4096
+#define JOBARGS  256
+#define TAG_JOB  1                  // rank 0 -> worker: job, ranks, member ranks
+#define TAG_ARGS 2                  // rank 0 -> worker: directory and options
+#define TAG_DONE 3                  // worker -> rank 0: job, result
+
+typedef struct {
+  int    np;                        // ranks of the run
+  int    line;                      // line in the job list
+  char   *args;                     // directory and options
+  int    state;                     // 0 queued, 1 running, 2 done
+  int    ret;                       // 0 ended, 1 stopped by the monitor, -1 failed
+  int    leader;                    // world rank of the run's rank 0
+  double t0, t1;
+} packjob;
+
+// the runs of the job list file, a malformed line is a run of 0 ranks; NULL on failure
+static packjob *readjobs(const char *name, int *njob)
+{
+  FILE    *fp;
+  char    line[JOBLINE], *p, *e;
+  packjob *job = NULL;
+  int     n = 0, max = 0, nl = 0;
+
+  fp = fopen(name, "r");
+  if(!fp)
+  {
+     printf("can't open job list %s\n", name);
+     return NULL;
+  }
+  while(fgets(line, sizeof(line), fp))
+  {
+     nl++;
+     if((p = strchr(line, '#'))) *p = '\0';
+     if((p = strchr(line, '\n'))) *p = '\0';
+     for(p=line+strlen(line);p>line && (p[-1]==' ' || p[-1]=='\t');*--p='\0');
+     for(p=line;*p==' ' || *p=='\t';p++);
+     if(!*p) continue;
+     if(n==max)
+     {
+        max = (max ? 2*max : 64);
+        job = (packjob *)realloc(job, sizeof(packjob)*max);
+     }
+     memset(&job[n], 0, sizeof(packjob));
+     job[n].np   = (int)strtol(p, &e, 10);
+     job[n].line = nl;
+     if(e==p) job[n].np = 0;
+     for(p=e;*p==' ' || *p=='\t';p++);
+     if(job[n].np<1 || !*p)
+     {
+        printf("job list %s line %d: expected <ranks> <directory> <options>\n", name, nl);
+        job[n++].np = 0;
+        continue;
+     }
+     job[n++].args = strdup(p);
+  }
+  fclose(fp);
+  if(n==0)
+     printf("job list %s has no runs\n", name);
+  *njob = n;
+  return job;
+}
+
+// rank 0: hands out the runs and collects their results
+static int schedule(packjob *job, int njob, int size)
+{
+  int    *isfree, *msg, nfree = size-1, ndone = 0, nfail = 0;
+  int    i, j, n, res[2];
+  double t0 = MPI_Wtime(), busy = 0.0;
+  MPI_Status st;
+
+  isfree = (int *)malloc(sizeof(int)*size);
+  msg    = (int *)malloc(sizeof(int)*(size+1));
+  for(i=1;i<size;i++) isfree[i] = 1;
+  for(j=0;j<njob;j++)
+     if(job[j].np<1 || job[j].np>size-1)
+     {
+        if(job[j].np<1)
+           printf("job %d (line %d) FAILED, not a run\n", j, job[j].line);
+        else
+           printf("job %d (line %d) FAILED, needs %d ranks, only %d workers\n", j, job[j].line, job[j].np, size-1);
+        job[j].state = 2;
+        job[j].ret   = -1;
+        ndone++;
+        nfail++;
+     }
+  printf("jobpack: %d runs on %d worker ranks\n", njob, size-1);
+
+  while(ndone<njob)
+  {
+     for(j=0;j<njob && nfree>0;j++)
+     {
+        if(job[j].state!=0 || job[j].np>nfree) continue;
+        msg[0] = j;
+        msg[1] = job[j].np;
+        for(i=1,n=0;n<job[j].np;i++)
+           if(isfree[i])
+           {
+              isfree[i]  = 0;
+              msg[2+n++] = i;
+           }
+        for(n=0;n<job[j].np;n++)
+        {
+           MPI_Send(msg, 2+job[j].np, MPI_INT, msg[2+n], TAG_JOB, MPI_COMM_WORLD);
+           MPI_Send(job[j].args, strlen(job[j].args)+1, MPI_CHAR, msg[2+n], TAG_ARGS, MPI_COMM_WORLD);
+        }
+        nfree       -= job[j].np;
+        job[j].state  = 1;
+        job[j].leader = msg[2];
+        job[j].t0     = MPI_Wtime();
+        printf("job %d (line %d) started on %d ranks, %d-%d%s: %s\n", j, job[j].line, job[j].np, msg[2],
+               msg[1+job[j].np], (msg[1+job[j].np]-msg[2]+1>job[j].np ? " with gaps" : ""), job[j].args);
+        fflush(stdout);
+     }
+
+     // every rank of a run reports, the run is over once its rank 0 has
+     MPI_Recv(res, 2, MPI_INT, MPI_ANY_SOURCE, TAG_DONE, MPI_COMM_WORLD, &st);
+     isfree[st.MPI_SOURCE] = 1;
+     nfree++;
+     j = res[0];
+     if(st.MPI_SOURCE!=job[j].leader) continue;
+     job[j].state = 2;
+     job[j].ret   = res[1];
+     job[j].t1    = MPI_Wtime();
+     busy        += job[j].np*(job[j].t1-job[j].t0);
+     ndone++;
+     if(res[1]<0) nfail++;
+     printf("job %d (line %d) %s after %.1f s, %d runs left\n", j, job[j].line,
+            (res[1]<0 ? "FAILED" : (res[1] ? "stopped by the monitor" : "done")), job[j].t1-job[j].t0, njob-ndone);
+     fflush(stdout);
+  }
+
+  // the last runs' ranks may still be on their way back
+  while(nfree<size-1)
+  {
+     MPI_Recv(res, 2, MPI_INT, MPI_ANY_SOURCE, TAG_DONE, MPI_COMM_WORLD, &st);
+     nfree++;
+  }
+  msg[0] = -1;
+  for(i=1;i<size;i++)
+     MPI_Send(msg, 2, MPI_INT, i, TAG_JOB, MPI_COMM_WORLD);
+  t0 = MPI_Wtime()-t0;
+  printf("jobpack: %d runs, %d failed, %.1f s, workers busy %.0f%%\n", njob, nfail, t0,
+         (t0>0.0 && size>1 ? 100.0*busy/(t0*(size-1)) : 0.0));
+  free(msg);
+  free(isfree);
+  return (nfail ? -1 : 0);
+}
+
+// a worker rank: runs its part of every run it is given until rank 0 says stop
+static void work(int rank, int size)
+{
+  char     args[JOBLINE], home[JOBLINE], *argv[JOBARGS], *p;
+  int      *msg, argc, res[2], err, fd, out;
+  MPI_Group world, grp;
+  MPI_Comm comm;
+  MPI_Status st;
+  pmcl3d_sim *sim;
+
+  msg = (int *)malloc(sizeof(int)*(size+1));
+  if(!getcwd(home, sizeof(home)))
+     home[0] = '\0';
+  out = dup(1);
+  MPI_Comm_group(MPI_COMM_WORLD, &world);
+  while(1)
+  {
+     MPI_Recv(msg, size+1, MPI_INT, 0, TAG_JOB, MPI_COMM_WORLD, &st);
+     if(msg[0]<0) break;
+     MPI_Recv(args, JOBLINE, MPI_CHAR, 0, TAG_ARGS, MPI_COMM_WORLD, &st);
+     MPI_Group_incl(world, msg[1], msg+2, &grp);
+     MPI_Comm_create_group(MPI_COMM_WORLD, grp, msg[0], &comm);
+     MPI_Group_free(&grp);
+
+     // pmcl3d argv from the options, the first word is the directory
+     argv[0] = "pmcl3d";
+     argc    = 0;
+     for(p=strtok(args, " \t");p && argc<JOBARGS-1;p=strtok(NULL, " \t"))
+        argv[argc++] = p;
+     argv[argc] = NULL;
+
+     // the run's rank 0 starts a fresh pmcl3d.out before the others append
+     err = chdir(argv[0]);
+     fflush(stdout);
+     fd  = -1;
+     if(!err && rank==msg[2])
+        err = ((fd = open("pmcl3d.out", O_WRONLY|O_CREAT|O_TRUNC, 0644))<0);
+     MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MAX, comm);
+     if(!err && rank!=msg[2])
+        fd = open("pmcl3d.out", O_WRONLY|O_CREAT|O_APPEND, 0644);
+     if(fd>=0)
+     {
+        dup2(fd, 1);
+        close(fd);
+     }
+
+     res[0] = msg[0];
+     res[1] = -1;
+     if(err)
+     {
+        if(rank==msg[2]) printf("job %d: can't work in %s\n", msg[0], argv[0]);
+     }
+     else
+     {
+        argv[0] = "pmcl3d";
+        sim     = pmcl3d_create(argc, argv, comm);
+        if(sim)
+        {
+           pmcl3d_run(sim, 0);
+           res[1] = (pmcl3d_current_step(sim)>0 && pmcl3d_current_step(sim)<pmcl3d_total_steps(sim));
+           pmcl3d_destroy(sim);
+        }
+     }
+     fflush(stdout);
+     dup2(out, 1);
+     if(home[0] && chdir(home))
+        printf("rank %d can't return to %s\n", rank, home);
+     MPI_Comm_free(&comm);
+     MPI_Send(res, 2, MPI_INT, 0, TAG_DONE, MPI_COMM_WORLD);
+  }
+  MPI_Group_free(&world);
+  close(out);
+  free(msg);
+  return;
+}
+
+int main(int argc, char **argv)
+{
+    packjob *job = NULL;
+    int     rank, size, njob = 0, err = 0, j;
+
+    MPI_Init(&argc,&argv);
+    MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+    MPI_Comm_size(MPI_COMM_WORLD,&size);
+    if(rank==0)
+    {
+       if(argc!=2 || size<2)
+          printf("usage: mpirun -np 1+N jobpack <job list>, lines <ranks> <directory> <pmcl3d options>\n");
+       else
+          job = readjobs(argv[1], &njob);
+       err = (job==NULL);
+    }
+    MPI_Bcast(&err, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if(err)
+    {
+       MPI_Finalize();
+       return -1;
+    }
+    if(rank==0)
+    {
+       err = schedule(job, njob, size);
+       for(j=0;j<njob;j++)
+          free(job[j].args);
+       free(job);
+    }
+    else
+       work(rank, size);
+    MPI_Finalize();
+    return (err ? 1 : 0);
+}
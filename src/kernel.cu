@@ -18,6 +18,9 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 
 __constant__ float d_c1;
 __constant__ float d_c2;
+__constant__ float d_c3;
+__constant__ float d_c4;
+__constant__ float d_cz[2][4];
 __constant__ float d_dth;
 __constant__ float d_dt1;
 __constant__ float d_dh1;
@@ -35,12 +38,15 @@ texture<float, 1, cudaReadModeElementType> p_vx1;
 texture<float, 1, cudaReadModeElementType> p_vx2;
 
 extern "C"
-void SetDeviceConstValue(float DH, float DT, int nxt, int nyt, int nzt)
+void SetDeviceConstValue(float DH, float DT, int nxt, int nyt, int nzt, int FDCOEF)
 {
-    float h_c1, h_c2, h_dth, h_dt1, h_dh1;
-    int   slice_1,  slice_2,  yline_1,  yline_2;
-    h_c1  = 9.0/8.0;
-    h_c2  = -1.0/24.0;
+    float h_c[2][4] = {FD_TAYLOR, FD_DRP};
+    float h_cz[2][4] = {FD_TAYLOR, FD_TAYLOR4};
+    float h_dth, h_dt1, h_dh1;
+    int   i, slice_1,  slice_2,  yline_1,  yline_2;
+    // d_cz[0] for z differences in the interior, d_cz[1] in the top FD_FSLAYERS layers
+    for(i=0;i<4;i++)
+       h_cz[0][i] = h_c[FDCOEF][i];
     h_dth = DT/DH;
     h_dt1 = 1.0/DT;
     h_dh1 = 1.0/DH;
@@ -49,8 +55,11 @@ void SetDeviceConstValue(float DH, float DT, int nxt, int nyt, int nzt)
     yline_1  = nzt+2*align;
     yline_2  = (nzt+2*align)*2;
 
-    cudaMemcpyToSymbol(d_c1,      &h_c1,    sizeof(float));
-    cudaMemcpyToSymbol(d_c2,      &h_c2,    sizeof(float));
+    cudaMemcpyToSymbol(d_c1,      &h_c[FDCOEF][0], sizeof(float));
+    cudaMemcpyToSymbol(d_c2,      &h_c[FDCOEF][1], sizeof(float));
+    cudaMemcpyToSymbol(d_c3,      &h_c[FDCOEF][2], sizeof(float));
+    cudaMemcpyToSymbol(d_c4,      &h_c[FDCOEF][3], sizeof(float));
+    cudaMemcpyToSymbol(d_cz,      h_cz,     sizeof(h_cz));
     cudaMemcpyToSymbol(d_dth,     &h_dth,   sizeof(float));
     cudaMemcpyToSymbol(d_dt1,     &h_dt1,   sizeof(float));
     cudaMemcpyToSymbol(d_dh1,     &h_dh1,   sizeof(float));
@@ -163,6 +172,78 @@ void addsrc_H(int i,      int READ_STEP, int dim,    int* psrc,  int npsrc,  cud
     return;
 }
 
+extern "C"
+void addsrci_H(int o,      float* c,      int stride, int dim,    int* psrc,  int npsrc,  cudaStream_t St,
+               float* axx, float* ayy,    float* azz, float* axz, float* ayz, float* axy,
+               float* xx,  float* yy,     float* zz,  float* xy,  float* yz,  float* xz)
+{
+    dim3 grid, block;
+    if(npsrc < 256)
+    {
+       block.x = npsrc;
+       grid.x = 1;
+    }
+    else
+    {
+       block.x = 256;
+       grid.x  = int((npsrc+255)/256);
+    }
+    cudaError_t cerr;
+    addsrci_cu<<<grid, block, 0, St>>>(o,  c[0], c[1], c[2], c[3], stride, dim, psrc, npsrc, axx, ayy, azz, axz, ayz, axy,
+                                       xx, yy,   zz,   xy,   yz,   xz);
+    cerr=cudaGetLastError();
+    if(cerr!=cudaSuccess) printf("CUDA ERROR: addsrci after kernel: %s\n",cudaGetErrorString(cerr));
+    return;
+}
+
+extern "C"
+void drmgather_H(float* buf, int* pos, int n, float* f)
+{
+    dim3 block(256, 1, 1);
+    dim3 grid((n+255)/256, 1, 1);
+    cudaError_t cerr;
+    drmgather_cu<<<grid, block>>>(buf, pos, n, f);
+    cerr=cudaGetLastError();
+    if(cerr!=cudaSuccess) printf("CUDA ERROR: drmgather_H after kernel: %s\n",cudaGetErrorString(cerr));
+    return;
+}
+
+extern "C"
+void drmadd_H(float* f, int* pos, float* val, int n)
+{
+    dim3 block(256, 1, 1);
+    dim3 grid((n+255)/256, 1, 1);
+    cudaError_t cerr;
+    drmadd_cu<<<grid, block>>>(f, pos, val, n);
+    cerr=cudaGetLastError();
+    if(cerr!=cudaSuccess) printf("CUDA ERROR: drmadd_H after kernel: %s\n",cudaGetErrorString(cerr));
+    return;
+}
+
+extern "C"
+void peakv_H(float* pgv, float* u1, float* v1, float* w1, int nxt, int nyt)
+{
+    dim3 block(32, 8, 1);
+    dim3 grid((nxt+31)/32, (nyt+7)/8, 1);
+    cudaError_t cerr;
+    peakv_cu<<<grid, block>>>(pgv, u1, v1, w1);
+    cerr=cudaGetLastError();
+    if(cerr!=cudaSuccess) printf("CUDA ERROR: peakv_H after kernel: %s\n",cudaGetErrorString(cerr));
+    return;
+}
+
+extern "C"
+void monitor_H(double* part, float* u1, float* v1, float* w1, float* d1, int i0, int i1, int j0, int j1, int k0, int k1)
+{
+    dim3 block(256, 1, 1);
+    dim3 grid(j1-j0+1, 1, 1);
+    cudaError_t cerr;
+    monitor_cu<<<grid, block>>>(part, u1, v1, w1, d1, i0, i1, j0, k0, k1);
+    cerr=cudaGetLastError();
+    if(cerr!=cudaSuccess) printf("CUDA ERROR: monitor_H after kernel: %s\n",cudaGetErrorString(cerr));
+    return;
+}
+
 
 __global__ void dvelcx(float* u1,    float* v1,    float* w1,    float* xx, float* yy, float* zz, float* xy, float* xz, float* yz,
                       float* dcrjx, float* dcrjy, float* dcrjz, float* d_1, int s_i,   int e_i)
@@ -175,10 +256,12 @@ __global__ void dvelcx(float* u1,    float* v1,    float* w1,    float* xx, floa
     register float f_xy,    xy_ip1,  xy_ip2,  xy_im1;
     register float f_xz,    xz_ip1,  xz_ip2,  xz_im1;
     register float f_d1,    f_d2,    f_d3,    f_dcrj, f_dcrjy, f_dcrjz, f_yz;
+    const float    *cz;
 
     k    = blockIdx.x*BLOCK_SIZE_Z+threadIdx.x+align;
     j    = blockIdx.y*BLOCK_SIZE_Y+threadIdx.y+2+4*loop;
     i    = e_i;
+    cz   = d_cz[k>=d_nzt+align-FD_FSLAYERS];
     pos  = i*d_slice_1+j*d_yline_1+k;
 
     f_xx    = xx[pos+d_slice_1];
@@ -234,14 +317,20 @@ __global__ void dvelcx(float* u1,    float* v1,    float* w1,    float* xx, floa
 
     	u1[pos]  = (u1[pos] + f_d1*( d_c1*(f_xx        - xx_im1)      + d_c2*(xx_ip1      - xx_im2)
                                    + d_c1*(f_xy        - xy[pos_jm1]) + d_c2*(xy[pos_jp1] - xy[pos_jm2])
-                                   + d_c1*(f_xz        - xz[pos_km1]) + d_c2*(xz[pos_kp1] - xz[pos_km2]) ))*f_dcrj;
+                                   + cz[0]*(f_xz       - xz[pos_km1]) + cz[1]*(xz[pos_kp1] - xz[pos_km2])
+                                   FD8(DA34(d_c3, d_c4, xx, pos, d_slice_1) + DA34(d_c3, d_c4, xy, pos, d_yline_1)
+                                     + DA34(cz[2], cz[3], xz, pos, 1)) ))*f_dcrj;
         v1[pos]  = (v1[pos] + f_d2*( d_c1*(xy_ip1      - f_xy)        + d_c2*(xy_ip2      - xy_im1)
                                    + d_c1*(yy[pos_jp1] - yy[pos])     + d_c2*(yy[pos_jp2] - yy[pos_jm1])
-                                   + d_c1*(f_yz        - yz[pos_km1]) + d_c2*(yz[pos_kp1] - yz[pos_km2]) ))*f_dcrj;
+                                   + cz[0]*(f_yz       - yz[pos_km1]) + cz[1]*(yz[pos_kp1] - yz[pos_km2])
+                                   FD8(DB34(d_c3, d_c4, xy, pos, d_slice_1) + DB34(d_c3, d_c4, yy, pos, d_yline_1)
+                                     + DA34(cz[2], cz[3], yz, pos, 1)) ))*f_dcrj;
 
         w1[pos]  = (w1[pos] + f_d3*( d_c1*(xz_ip1      - f_xz)        + d_c2*(xz_ip2      - xz_im1)
                                    + d_c1*(f_yz        - yz[pos_jm1]) + d_c2*(yz[pos_jp1] - yz[pos_jm2])
-                                   + d_c1*(zz[pos_kp1] - zz[pos])     + d_c2*(zz[pos_kp2] - zz[pos_km1]) ))*f_dcrj;
+                                   + cz[0]*(zz[pos_kp1] - zz[pos])    + cz[1]*(zz[pos_kp2] - zz[pos_km1])
+                                   FD8(DB34(d_c3, d_c4, xz, pos, d_slice_1) + DA34(d_c3, d_c4, yz, pos, d_yline_1)
+                                     + DB34(cz[2], cz[3], zz, pos, 1)) ))*f_dcrj;
         pos      = pos_im1;
     }
 
@@ -260,10 +349,12 @@ __global__ void dvelcy(float* u1,    float* v1,    float* w1,    float* xx,  flo
     register float f_yy,    yy_jp2,  yy_jp1,  yy_jm1;
     register float f_yz,    yz_jp1,  yz_jm1,  yz_jm2;
     register float f_d1,    f_d2,    f_d3,    f_dcrj, f_dcrjx, f_dcrjz, f_xz;
+    const float    *cz;
 
     k     = blockIdx.x*BLOCK_SIZE_Z+threadIdx.x+align;
     i     = blockIdx.y*BLOCK_SIZE_Y+threadIdx.y+2+4*loop;
     j     = e_j;
+    cz    = d_cz[k>=d_nzt+align-FD_FSLAYERS];
     j2    = 4*loop-1;
     pos   = i*d_slice_1+j*d_yline_1+k;
     pos2  = i*4*loop*d_yline_1+j2*d_yline_1+k;
@@ -320,13 +411,19 @@ __global__ void dvelcy(float* u1,    float* v1,    float* w1,    float* xx,  flo
 
         s_u1[pos2] = (u1[pos] + f_d1*( d_c1*(xx[pos]     - xx[pos_im1]) + d_c2*(xx[pos_ip1] - xx[pos_im2])
                                      + d_c1*(f_xy        - xy_jm1)      + d_c2*(xy_jp1      - xy_jm2)
-                                     + d_c1*(f_xz        - xz[pos_km1]) + d_c2*(xz[pos_kp1] - xz[pos_km2]) ))*f_dcrj;
+                                     + cz[0]*(f_xz       - xz[pos_km1]) + cz[1]*(xz[pos_kp1] - xz[pos_km2])
+                                     FD8(DA34(d_c3, d_c4, xx, pos, d_slice_1) + DA34(d_c3, d_c4, xy, pos, d_yline_1)
+                                       + DA34(cz[2], cz[3], xz, pos, 1)) ))*f_dcrj;
         s_v1[pos2] = (v1[pos] + f_d2*( d_c1*(xy[pos_ip1] - f_xy)        + d_c2*(xy[pos_ip2] - xy[pos_im1])
                                      + d_c1*(yy_jp1      - f_yy)        + d_c2*(yy_jp2      - yy_jm1)
-                                     + d_c1*(f_yz        - yz[pos_km1]) + d_c2*(yz[pos_kp1] - yz[pos_km2]) ))*f_dcrj;
+                                     + cz[0]*(f_yz       - yz[pos_km1]) + cz[1]*(yz[pos_kp1] - yz[pos_km2])
+                                     FD8(DB34(d_c3, d_c4, xy, pos, d_slice_1) + DB34(d_c3, d_c4, yy, pos, d_yline_1)
+                                       + DA34(cz[2], cz[3], yz, pos, 1)) ))*f_dcrj;
         s_w1[pos2] = (w1[pos] + f_d3*( d_c1*(xz[pos_ip1] - f_xz)        + d_c2*(xz[pos_ip2] - xz[pos_im1])
                                      + d_c1*(f_yz        - yz_jm1)      + d_c2*(yz_jp1      - yz_jm2)
-                                     + d_c1*(zz[pos_kp1] - zz[pos])     + d_c2*(zz[pos_kp2] - zz[pos_km1]) ))*f_dcrj;
+                                     + cz[0]*(zz[pos_kp1] - zz[pos])    + cz[1]*(zz[pos_kp2] - zz[pos_km1])
+                                     FD8(DB34(d_c3, d_c4, xz, pos, d_slice_1) + DA34(d_c3, d_c4, yz, pos, d_yline_1)
+                                       + DB34(cz[2], cz[3], zz, pos, 1)) ))*f_dcrj;
 
         pos        = pos_jm1;
         pos2       = pos2 - d_yline_1;
@@ -386,10 +483,12 @@ __global__ void dstrqc(float* xx, float* yy,    float* zz,    float* xy,    floa
     register float f_u1, u1_ip1, u1_ip2, u1_im1;
     register float f_v1, v1_im1, v1_ip1, v1_im2;
     register float f_w1, w1_im1, w1_im2, w1_ip1;
+    const float    *cz;
 
     k    = blockIdx.x*BLOCK_SIZE_Z+threadIdx.x+align;
     j    = blockIdx.y*BLOCK_SIZE_Y+threadIdx.y+s_j;
     i    = e_i;
+    cz   = d_cz[k>=d_nzt+align-FD_FSLAYERS];
     pos  = i*d_slice_1+j*d_yline_1+k;
 
     u1_ip1 = u1[pos+d_slice_2];
@@ -504,9 +603,9 @@ __global__ void dstrqc(float* xx, float* yy,    float* zz,    float* xy,    floa
                 v1[pos_kp2] = v1[pos_kp1] - (w1[pos_jp1+1] - w1[pos_kp1]);
 	}
 
-    	vs1      = d_c1*(u1_ip1 - f_u1)        + d_c2*(u1_ip2      - u1_im1);
-        vs2      = d_c1*(f_v1   - v1[pos_jm1]) + d_c2*(v1[pos_jp1] - v1[pos_jm2]);
-        vs3      = d_c1*(f_w1   - w1[pos_km1]) + d_c2*(w1[pos_kp1] - w1[pos_km2]);
+    	vs1      = d_c1*(u1_ip1 - f_u1)        + d_c2*(u1_ip2      - u1_im1)      FD8(DB34(d_c3, d_c4, u1, pos, d_slice_1));
+        vs2      = d_c1*(f_v1   - v1[pos_jm1]) + d_c2*(v1[pos_jp1] - v1[pos_jm2]) FD8(DA34(d_c3, d_c4, v1, pos, d_yline_1));
+        vs3      = cz[0]*(f_w1  - w1[pos_km1]) + cz[1]*(w1[pos_kp1] - w1[pos_km2]) FD8(DA34(cz[2], cz[3], w1, pos, 1));
 
         tmp      = xl*(vs1+vs2+vs3);
         a1       = qpa*(vs1+vs2+vs3);
@@ -522,8 +621,8 @@ __global__ void dstrqc(float* xx, float* yy,    float* zz,    float* xy,    floa
         zz[pos]  = (zz[pos]  + tmp - xm*(vs1+vs2) + vx1*f_r)*f_dcrj;
         r3[pos]  = f_vx2*f_r - h*(vs1+vs2)        + a1;
 
-        vs1      = d_c1*(u1[pos_jp1] - f_u1)   + d_c2*(u1[pos_jp2] - u1[pos_jm1]);
-        vs2      = d_c1*(f_v1        - v1_im1) + d_c2*(v1_ip1      - v1_im2);
+        vs1      = d_c1*(u1[pos_jp1] - f_u1)   + d_c2*(u1[pos_jp2] - u1[pos_jm1]) FD8(DB34(d_c3, d_c4, u1, pos, d_yline_1));
+        vs2      = d_c1*(f_v1        - v1_im1) + d_c2*(v1_ip1      - v1_im2)      FD8(DA34(d_c3, d_c4, v1, pos, d_slice_1));
         f_r      = r4[pos];
         xy[pos]  = (xy[pos]  + xmu1*(vs1+vs2) + vx1*f_r)*f_dcrj;
         r4[pos]  = f_vx2*f_r + h1*(vs1+vs2);
@@ -536,15 +635,15 @@ __global__ void dstrqc(float* xx, float* yy,    float* zz,    float* xy,    floa
         }
         else
         {
-        	vs1     = d_c1*(u1[pos_kp1] - f_u1)   + d_c2*(u1[pos_kp2] - u1[pos_km1]);
-        	vs2     = d_c1*(f_w1        - w1_im1) + d_c2*(w1_ip1      - w1_im2);
+        	vs1     = cz[0]*(u1[pos_kp1] - f_u1)  + cz[1]*(u1[pos_kp2] - u1[pos_km1]) FD8(DB34(cz[2], cz[3], u1, pos, 1));
+        	vs2     = d_c1*(f_w1        - w1_im1) + d_c2*(w1_ip1      - w1_im2)      FD8(DA34(d_c3, d_c4, w1, pos, d_slice_1));
         	f_r     = r5[pos];
         	xz[pos] = (xz[pos]  + xmu2*(vs1+vs2) + vx1*f_r)*f_dcrj;
         	r5[pos] = f_vx2*f_r + h2*(vs1+vs2);
 
 
-        	vs1     = d_c1*(v1[pos_kp1] - f_v1) + d_c2*(v1[pos_kp2] - v1[pos_km1]);
-        	vs2     = d_c1*(w1[pos_jp1] - f_w1) + d_c2*(w1[pos_jp2] - w1[pos_jm1]);
+        	vs1     = cz[0]*(v1[pos_kp1] - f_v1) + cz[1]*(v1[pos_kp2] - v1[pos_km1]) FD8(DB34(cz[2], cz[3], v1, pos, 1));
+        	vs2     = d_c1*(w1[pos_jp1] - f_w1)  + d_c2*(w1[pos_jp2] - w1[pos_jm1])  FD8(DB34(d_c3, d_c4, w1, pos, d_yline_1));
         	f_r     = r6[pos];
         	yz[pos] = (yz[pos]  + xmu3*(vs1+vs2) + vx1*f_r)*f_dcrj;
         	r6[pos] = f_vx2*f_r + h3*(vs1+vs2);
@@ -592,3 +691,108 @@ __global__ void addsrc_cu(int i,      int READ_STEP, int dim,    int* psrc,  int
 
         return;
 }
+
+// addsrc_cu of a coarse source window, interpolated from the samples at o..o+3 with weights c0..c3
+__global__ void addsrci_cu(int o,      float c0,   float c1,   float c2,   float c3,   int stride, int dim, int* psrc, int npsrc,
+                           float* axx, float* ayy, float* azz, float* axz, float* ayz, float* axy,
+                           float* xx,  float* yy,  float* zz,  float* xy,  float* yz,  float* xz)
+{
+        register float vtst;
+        register int idx, idy, idz, j, p, pos;
+        j = blockIdx.x*blockDim.x+threadIdx.x;
+        if(j >= npsrc) return;
+        vtst = (float)d_DT/(d_DH*d_DH*d_DH);
+
+        idx = psrc[j*dim]   + 1 + 4*loop;
+        idy = psrc[j*dim+1] + 1 + 4*loop;
+        idz = psrc[j*dim+2] + align - 1;
+        pos = idx*d_slice_1 + idy*d_yline_1 + idz;
+        p   = j*stride + o;
+
+        xx[pos] = xx[pos] - vtst*(c0*axx[p]+c1*axx[p+1]+c2*axx[p+2]+c3*axx[p+3]);
+        yy[pos] = yy[pos] - vtst*(c0*ayy[p]+c1*ayy[p+1]+c2*ayy[p+2]+c3*ayy[p+3]);
+        zz[pos] = zz[pos] - vtst*(c0*azz[p]+c1*azz[p+1]+c2*azz[p+2]+c3*azz[p+3]);
+        xz[pos] = xz[pos] - vtst*(c0*axz[p]+c1*axz[p+1]+c2*axz[p+2]+c3*axz[p+3]);
+        yz[pos] = yz[pos] - vtst*(c0*ayz[p]+c1*ayz[p+1]+c2*ayz[p+2]+c3*ayz[p+3]);
+        xy[pos] = xy[pos] - vtst*(c0*axy[p]+c1*axy[p+1]+c2*axy[p+2]+c3*axy[p+3]);
+
+        return;
+}
+
+// DRM recorder: compacts the recorded points of one field
+__global__ void drmgather_cu(float* buf, int* pos, int n, float* f)
+{
+        register int j;
+        j = blockIdx.x*blockDim.x+threadIdx.x;
+        if(j >= n) return;
+        buf[j] = f[pos[j]];
+        return;
+}
+
+// DRM injection: adds the corrections of one field, the points are distinct
+__global__ void drmadd_cu(float* f, int* pos, float* val, int n)
+{
+        register int j;
+        j = blockIdx.x*blockDim.x+threadIdx.x;
+        if(j >= n) return;
+        f[pos[j]] += val[j];
+        return;
+}
+
+// peak surface velocity of the library API, x fastest
+__global__ void peakv_cu(float* pgv, float* u1, float* v1, float* w1)
+{
+        register int   i, j, pos;
+        register float v;
+        i = blockIdx.x*blockDim.x+threadIdx.x;
+        j = blockIdx.y*blockDim.y+threadIdx.y;
+        if(i >= d_nxt || j >= d_nyt) return;
+        pos = (i+2+4*loop)*d_slice_1+(j+2+4*loop)*d_yline_1+d_nzt+align-1;
+        v   = sqrtf(u1[pos]*u1[pos]+v1[pos]*v1[pos]+w1[pos]*w1[pos]);
+        if(v > pgv[j*d_nxt+i]) pgv[j*d_nxt+i] = v;
+        return;
+}
+
+// health monitor partials of one y line of the box per block: sum rho|v|^2, max |v|^2, non-finite count
+__global__ void monitor_cu(double* part, float* u1, float* v1, float* w1, float* d1, int i0, int i1, int j0, int k0, int k1)
+{
+        __shared__ double se[256], sv[256], sn[256];
+        register int    i, j, k, pos, t = threadIdx.x;
+        register double uu, e = 0.0, vmax = 0.0, nbad = 0.0;
+
+        j = blockIdx.x+j0;
+        for(i=i0;i<=i1;i++)
+          for(k=k0+t;k<=k1;k+=blockDim.x)
+          {
+             pos = i*d_slice_1+j*d_yline_1+k;
+             uu  = (double)u1[pos]*u1[pos]+(double)v1[pos]*v1[pos]+(double)w1[pos]*w1[pos];
+             if(!isfinite(uu))
+             {
+                nbad += 1.0;
+                continue;
+             }
+             e += d1[pos]*uu;
+             if(uu > vmax) vmax = uu;
+          }
+        se[t] = e;
+        sv[t] = vmax;
+        sn[t] = nbad;
+        __syncthreads();
+        for(k=blockDim.x/2;k>0;k>>=1)
+        {
+           if(t < k)
+           {
+              se[t] += se[t+k];
+              if(sv[t+k] > sv[t]) sv[t] = sv[t+k];
+              sn[t] += sn[t+k];
+           }
+           __syncthreads();
+        }
+        if(t == 0)
+        {
+           part[3*blockIdx.x]   = se[0];
+           part[3*blockIdx.x+1] = sv[0];
+           part[3*blockIdx.x+2] = sn[0];
+        }
+        return;
+}
@@ -34,4 +34,16 @@ __global__ void dstrqc(float* xx, float* yy,    float* zz,    float* xy,    floa
 __global__ void addsrc_cu(int i,      int READ_STEP, int dim,    int* psrc, int npsrc,
                           float* axx, float* ayy,    float* azz, float* axz, float* ayz, float* axy,
                           float* xx,  float* yy,     float* zz,  float* xy,  float* yz,  float* xz);
+
+__global__ void addsrci_cu(int o,      float c0,   float c1,   float c2,   float c3,   int stride, int dim, int* psrc, int npsrc,
+                           float* axx, float* ayy, float* azz, float* axz, float* ayz, float* axy,
+                           float* xx,  float* yy,  float* zz,  float* xy,  float* yz,  float* xz);
+
+__global__ void drmgather_cu(float* buf, int* pos, int n, float* f);
+
+__global__ void drmadd_cu(float* f, int* pos, float* val, int n);
+
+__global__ void peakv_cu(float* pgv, float* u1, float* v1, float* w1);
+
+__global__ void monitor_cu(double* part, float* u1, float* v1, float* w1, float* d1, int i0, int i1, int j0, int k0, int k1);
 #endif
@@ -0,0 +1,547 @@
+/**
+@section LICENSE
+Copyright (c) 2013-2016, Regents of the University of California
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+********************************************************************************
+* kernel_cpu.c                                                                 *
+* host versions of the velocity and stress kernels (--CPU 1)                   *
+*                                                                              *
+* The arithmetic follows kernel.cu statement by statement, so both backends    *
+* give the same wavefield. The fields are bound once with BindHostArrays and   *
+* use the flat layout of the device arrays, or the column bricks of            *
+* --CPUBRICK (grid.c). Either way a kernel addresses column (i,j) and its      *
+* stencil neighbours through the offsets colnbr takes from gridcol, and walks  *
+* k contiguously inside the column.                                            *
+*                                                                              *
+* fstep_C fuses the two kernels into one sweep along i: velocity at plane i    *
+* is followed by stress at plane i-reach (2 for FD_ORDER 4, 4 for 8), the     *
+* last plane whose velocity stencil is then complete. Velocity at plane i      *
+* reads stresses i-reach..i+reach, none of which is updated yet, so the sweep  *
+* stays exact while only a window of 2*reach+1 planes of every field has to    *
+* be in cache.                                                                 *
+*                                                                              *
+* Columns (i,j) are processed in square tiles, walked in Morton order so the   *
+* stencil neighbours of a tile are still cached when the next tile reuses      *
+* them. The tile edge is sized so that a tile with its stencil halo fits the   *
+* per-thread share of L2/L3. OpenMP threads take contiguous segments of the    *
+* curve. fstep_C applies the lag per slab of one tile edge in i: velocity of   *
+* a slab, then stress of the slab reach planes behind.                         *
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "pmcl3d.h"
+
+#define VEL 0
+#define STR 1
+
+static float c1, c2, c3, c4, cz[2][4], dth, dt1, dh1, h_DT, h_DH;
+static int   h_nxt, h_nyt, h_nzt, h_ny, h_nz;
+
+static float *u1, *v1, *w1, *xx, *yy, *zz, *xy, *xz, *yz;
+static float *r1, *r2, *r3, *r4, *r5, *r6;
+static float *d_1, *lam, *mu, *qp, *qs, *vx1, *vx2, *lam_mu;
+static float *dcrjx, *dcrjy, *dcrjz;
+
+static int   tile, ntilemax, *tiles;
+
+void SetHostConstValue(float DH, float DT, int nxt, int nyt, int nzt, int FDCOEF)
+{
+    float c[2][4] = {FD_TAYLOR, FD_DRP}, c4th[4] = FD_TAYLOR4;
+    int   i;
+
+    c1      = c[FDCOEF][0];
+    c2      = c[FDCOEF][1];
+    c3      = c[FDCOEF][2];
+    c4      = c[FDCOEF][3];
+    for(i=0;i<4;i++)
+    {
+       cz[0][i] = c[FDCOEF][i];
+       cz[1][i] = c4th[i];
+    }
+    dth     = DT/DH;
+    dt1     = 1.0/DT;
+    dh1     = 1.0/DH;
+    h_DT    = DT;
+    h_DH    = DH;
+    h_nxt   = nxt;
+    h_nyt   = nyt;
+    h_nzt   = nzt;
+    h_ny    = nyt+4+8*loop;
+    h_nz    = nzt+2*align;
+    return;
+}
+
+void BindHostArrays(Grid3D U1, Grid3D V1,  Grid3D W1,  Grid3D XX,  Grid3D YY,     Grid3D ZZ,    Grid3D XY,    Grid3D XZ,
+                    Grid3D YZ, Grid3D R1,  Grid3D R2,  Grid3D R3,  Grid3D R4,     Grid3D R5,    Grid3D R6,    Grid3D D1,
+                    Grid3D LAM, Grid3D MU, Grid3D QP,  Grid3D QS,  Grid3D VX1,    Grid3D VX2,   Grid3D LAM_MU,
+                    Grid1D DCRJX, Grid1D DCRJY, Grid1D DCRJZ)
+{
+    u1  = &U1[0][0][0];   v1  = &V1[0][0][0];   w1  = &W1[0][0][0];
+    xx  = &XX[0][0][0];   yy  = &YY[0][0][0];   zz  = &ZZ[0][0][0];
+    xy  = &XY[0][0][0];   xz  = &XZ[0][0][0];   yz  = &YZ[0][0][0];
+    r1  = &R1[0][0][0];   r2  = &R2[0][0][0];   r3  = &R3[0][0][0];
+    r4  = &R4[0][0][0];   r5  = &R5[0][0][0];   r6  = &R6[0][0][0];
+    d_1 = &D1[0][0][0];   lam = &LAM[0][0][0];  mu  = &MU[0][0][0];
+    qp  = &QP[0][0][0];   qs  = &QS[0][0][0];
+    vx1 = &VX1[0][0][0];  vx2 = &VX2[0][0][0];  lam_mu = &LAM_MU[0][0][0];
+    dcrjx = DCRJX;        dcrjy = DCRJY;        dcrjz  = DCRJZ;
+    return;
+}
+
+// offsets from column (i,j) to the columns of its stencil: x[4+d] to (i+d,j),
+// y[4+d] to (i,j+d) for d=-4..4 and xy to (i+1,j-1); d*slice, d*yline and
+// slice-yline in the flat layout
+typedef struct { int x[9], y[9], xy; } nbr;
+
+// DA34 and DB34 along the neighbour offsets o, o[d] is the column d away
+#define DA34N(a3,a4,f,p,o) ((a3)*(f[(p)+(o)[2]]-f[(p)+(o)[-3]]) + (a4)*(f[(p)+(o)[3]]-f[(p)+(o)[-4]]))
+#define DB34N(a3,a4,f,p,o) ((a3)*(f[(p)+(o)[3]]-f[(p)+(o)[-2]]) + (a4)*(f[(p)+(o)[4]]-f[(p)+(o)[-3]]))
+
+// offset of column (i,j) with its neighbour offsets in n, see gridcol
+static int colnbr(int i, int j, nbr *n)
+{
+    long c = gridcol(i, j);
+    int  d;
+
+    for(d=-4;d<=4;d++)
+    {
+       n->x[4+d] = (int)(gridcol(i+d, j)-c);
+       n->y[4+d] = (int)(gridcol(i, j+d)-c);
+    }
+    n->xy = (int)(gridcol(i+1, j-1)-c);
+    return (int)c;
+}
+
+// velocity at (i,j,k) from the stresses, see dvelcx
+static inline void dvel(int pos, int k, const nbr *n, float f_dcrj, float *su, float *sv, float *sw)
+{
+    const int *xo = n->x+4, *yo = n->y+4;
+    float f_d1, f_d2, f_d3;
+    const float *z = cz[k>=h_nzt+align-FD_FSLAYERS];
+
+    f_d1  = 0.25*(d_1[pos] + d_1[pos+yo[-1]] + d_1[pos-1]       + d_1[pos+yo[-1]-1]);
+    f_d2  = 0.25*(d_1[pos] + d_1[pos+xo[1]]  + d_1[pos-1]       + d_1[pos+xo[1]-1]);
+    f_d3  = 0.25*(d_1[pos] + d_1[pos+xo[1]]  + d_1[pos+yo[-1]]  + d_1[pos+n->xy]);
+
+    f_d1  = dth/f_d1;
+    f_d2  = dth/f_d2;
+    f_d3  = dth/f_d3;
+
+    *su = (u1[pos] + f_d1*( c1*(xx[pos]        - xx[pos+xo[-1]]) + c2*(xx[pos+xo[1]] - xx[pos+xo[-2]])
+                          + c1*(xy[pos]        - xy[pos+yo[-1]]) + c2*(xy[pos+yo[1]] - xy[pos+yo[-2]])
+                          + z[0]*(xz[pos]      - xz[pos-1])      + z[1]*(xz[pos+1]   - xz[pos-2])
+                          FD8(DA34N(c3, c4, xx, pos, xo) + DA34N(c3, c4, xy, pos, yo) + DA34(z[2], z[3], xz, pos, 1)) ))*f_dcrj;
+    *sv = (v1[pos] + f_d2*( c1*(xy[pos+xo[1]]  - xy[pos])        + c2*(xy[pos+xo[2]] - xy[pos+xo[-1]])
+                          + c1*(yy[pos+yo[1]]  - yy[pos])        + c2*(yy[pos+yo[2]] - yy[pos+yo[-1]])
+                          + z[0]*(yz[pos]      - yz[pos-1])      + z[1]*(yz[pos+1]   - yz[pos-2])
+                          FD8(DB34N(c3, c4, xy, pos, xo) + DB34N(c3, c4, yy, pos, yo) + DA34(z[2], z[3], yz, pos, 1)) ))*f_dcrj;
+    *sw = (w1[pos] + f_d3*( c1*(xz[pos+xo[1]]  - xz[pos])        + c2*(xz[pos+xo[2]] - xz[pos+xo[-1]])
+                          + c1*(yz[pos]        - yz[pos+yo[-1]]) + c2*(yz[pos+yo[1]] - yz[pos+yo[-2]])
+                          + z[0]*(zz[pos+1]    - zz[pos])        + z[1]*(zz[pos+2]   - zz[pos-1])
+                          FD8(DB34N(c3, c4, xz, pos, xo) + DA34N(c3, c4, yz, pos, yo) + DB34(z[2], z[3], zz, pos, 1)) ))*f_dcrj;
+    return;
+}
+
+// velocity of column (i,j)
+static void vel_col(int i, int j)
+{
+    int   k, pos;
+    float f_dcrj = dcrjx[i]*dcrjy[j];
+    nbr   n;
+
+    pos = colnbr(i, j, &n)+align;
+    for(k=align;k<h_nzt+align;k++,pos++)
+       dvel(pos, k, &n, f_dcrj*dcrjz[k], &u1[pos], &v1[pos], &w1[pos]);
+    return;
+}
+
+// stress of column (i,j), see dstrqc
+static void str_col(int i, int j, int NX, int rankx, int ranky)
+{
+    int   k, g_i, pos;
+    int   pos_ip1, pos_im1, pos_jm1, pos_jp1, pos_ik1, pos_jk1, pos_ijk, pos_ijk1, pos_km1;
+    float vs1, vs2, vs3, a1, tmp, vx1f, f_vx1, f_vx2, f_dcrj, f_r;
+    float xl, xm, xmu1, xmu2, xmu3, qpa, h, h1, h2, h3;
+    float f_u1, u1_ip1, u1_ip2, u1_im1;
+    float f_v1, v1_ip1, v1_im1, v1_im2;
+    float f_w1, w1_ip1, w1_im1, w1_im2;
+    const float *z;
+    const int   *xo, *yo;
+    nbr   nb, *n = &nb;
+
+    pos = colnbr(i, j, n)+align;
+    xo  = n->x+4;
+    yo  = n->y+4;
+    for(k=align;k<h_nzt+align;k++,pos++)
+    {
+       z        = cz[k>=h_nzt+align-FD_FSLAYERS];
+       f_vx1    = vx1[pos];
+       f_vx2    = vx2[pos];
+       f_dcrj   = dcrjx[i]*dcrjy[j]*dcrjz[k];
+
+       pos_km1  = pos-1;
+       pos_jm1  = pos+yo[-1];
+       pos_jp1  = pos+yo[1];
+       pos_im1  = pos+xo[-1];
+       pos_ip1  = pos+xo[1];
+       pos_jk1  = pos+yo[-1]-1;
+       pos_ik1  = pos+xo[1]-1;
+       pos_ijk  = pos+n->xy;
+       pos_ijk1 = pos+n->xy-1;
+
+       xl       = 8.0/(  lam[pos]      + lam[pos_ip1] + lam[pos_jm1] + lam[pos_ijk]
+                       + lam[pos_km1]  + lam[pos_ik1] + lam[pos_jk1] + lam[pos_ijk1] );
+       xm       = 16.0/( mu[pos]       + mu[pos_ip1]  + mu[pos_jm1]  + mu[pos_ijk]
+                       + mu[pos_km1]   + mu[pos_ik1]  + mu[pos_jk1]  + mu[pos_ijk1] );
+       xmu1     = 2.0/(  mu[pos]       + mu[pos_km1] );
+       xmu2     = 2.0/(  mu[pos]       + mu[pos_jm1] );
+       xmu3     = 2.0/(  mu[pos]       + mu[pos_ip1] );
+       xl       = xl  +  xm;
+       qpa      = 0.0625*( qp[pos]     + qp[pos_ip1] + qp[pos_jm1] + qp[pos_ijk]
+                         + qp[pos_km1] + qp[pos_ik1] + qp[pos_jk1] + qp[pos_ijk1] );
+       h        = 0.0625*( qs[pos]     + qs[pos_ip1] + qs[pos_jm1] + qs[pos_ijk]
+                         + qs[pos_km1] + qs[pos_ik1] + qs[pos_jk1] + qs[pos_ijk1] );
+       h1       = 0.250*(  qs[pos]     + qs[pos_km1] );
+       h2       = 0.250*(  qs[pos]     + qs[pos_jm1] );
+       h3       = 0.250*(  qs[pos]     + qs[pos_ip1] );
+
+       h        = -xm*h*dh1;
+       h1       = -xmu1*h1*dh1;
+       h2       = -xmu2*h2*dh1;
+       h3       = -xmu3*h3*dh1;
+       qpa      = -qpa*xl*dh1;
+       xm       = xm*dth;
+       xmu1     = xmu1*dth;
+       xmu2     = xmu2*dth;
+       xmu3     = xmu3*dth;
+       xl       = xl*dth;
+       f_vx2    = f_vx2*f_vx1;
+       h        = h*f_vx1;
+       h1       = h1*f_vx1;
+       h2       = h2*f_vx1;
+       h3       = h3*f_vx1;
+       qpa      = qpa*f_vx1;
+
+       xm       = xm+h_DT*h;
+       xmu1     = xmu1+h_DT*h1;
+       xmu2     = xmu2+h_DT*h2;
+       xmu3     = xmu3+h_DT*h3;
+       vx1f     = h_DT*(1+f_vx2);
+
+       u1_ip2   = u1[pos+xo[2]];
+       u1_ip1   = u1[pos_ip1];
+       f_u1     = u1[pos];
+       u1_im1   = u1[pos_im1];
+       v1_ip1   = v1[pos_ip1];
+       f_v1     = v1[pos];
+       v1_im1   = v1[pos_im1];
+       v1_im2   = v1[pos+xo[-2]];
+       w1_ip1   = w1[pos_ip1];
+       f_w1     = w1[pos];
+       w1_im1   = w1[pos_im1];
+       w1_im2   = w1[pos+xo[-2]];
+
+       // free surface: velocity images above the surface
+       if(k == h_nzt+align-1)
+       {
+          u1[pos+1] = f_u1 - (f_w1        - w1_im1);
+          v1[pos+1] = f_v1 - (w1[pos_jp1] - f_w1);
+
+          g_i  = h_nxt*rankx + i - 4*loop - 1;
+          if(g_i<NX)
+             vs1 = u1_ip1 - (w1_ip1 - f_w1);
+          else
+             vs1 = 0.0;
+
+          g_i  = h_nyt*ranky + j - 4*loop - 1;
+          if(g_i>1)
+             vs2 = v1[pos_jm1] - (f_w1 - w1[pos_jm1]);
+          else
+             vs2 = 0.0;
+
+          w1[pos+1] = w1[pos_km1] - lam_mu[i*(h_nyt+4+8*loop) + j]*((vs1         - u1[pos+1]) + (u1_ip1 - f_u1)
+                                                                 + (v1[pos+1] - vs2)       + (f_v1   - v1[pos_jm1]) );
+       }
+       else if(k == h_nzt+align-2)
+       {
+          u1[pos+2] = u1[pos+1] - (w1[pos+1]   - w1[pos_im1+1]);
+          v1[pos+2] = v1[pos+1] - (w1[pos_jp1+1] - w1[pos+1]);
+       }
+
+       vs1      = c1*(u1_ip1 - f_u1)        + c2*(u1_ip2      - u1_im1)          FD8(DB34N(c3, c4, u1, pos, xo));
+       vs2      = c1*(f_v1   - v1[pos_jm1]) + c2*(v1[pos_jp1] - v1[pos+yo[-2]]) FD8(DA34N(c3, c4, v1, pos, yo));
+       vs3      = z[0]*(f_w1 - w1[pos_km1]) + z[1]*(w1[pos+1] - w1[pos-2])        FD8(DA34(z[2], z[3], w1, pos, 1));
+
+       tmp      = xl*(vs1+vs2+vs3);
+       a1       = qpa*(vs1+vs2+vs3);
+       tmp      = tmp+h_DT*a1;
+
+       f_r      = r1[pos];
+       xx[pos]  = (xx[pos]  + tmp - xm*(vs2+vs3) + vx1f*f_r)*f_dcrj;
+       r1[pos]  = f_vx2*f_r - h*(vs2+vs3)        + a1;
+       f_r      = r2[pos];
+       yy[pos]  = (yy[pos]  + tmp - xm*(vs1+vs3) + vx1f*f_r)*f_dcrj;
+       r2[pos]  = f_vx2*f_r - h*(vs1+vs3)        + a1;
+       f_r      = r3[pos];
+       zz[pos]  = (zz[pos]  + tmp - xm*(vs1+vs2) + vx1f*f_r)*f_dcrj;
+       r3[pos]  = f_vx2*f_r - h*(vs1+vs2)        + a1;
+
+       vs1      = c1*(u1[pos_jp1] - f_u1)   + c2*(u1[pos+yo[2]] - u1[pos_jm1]) FD8(DB34N(c3, c4, u1, pos, yo));
+       vs2      = c1*(f_v1        - v1_im1) + c2*(v1_ip1          - v1_im2)      FD8(DA34N(c3, c4, v1, pos, xo));
+       f_r      = r4[pos];
+       xy[pos]  = (xy[pos]  + xmu1*(vs1+vs2) + vx1f*f_r)*f_dcrj;
+       r4[pos]  = f_vx2*f_r + h1*(vs1+vs2);
+
+       if(k == h_nzt+align-1)
+       {
+          zz[pos+1] = -zz[pos];
+          xz[pos]   = 0.0;
+          yz[pos]   = 0.0;
+       }
+       else
+       {
+          vs1     = z[0]*(u1[pos+1] - f_u1) + z[1]*(u1[pos+2] - u1[pos_km1]) FD8(DB34(z[2], z[3], u1, pos, 1));
+          vs2     = c1*(f_w1      - w1_im1) + c2*(w1_ip1    - w1_im2)      FD8(DA34N(c3, c4, w1, pos, xo));
+          f_r     = r5[pos];
+          xz[pos] = (xz[pos]  + xmu2*(vs1+vs2) + vx1f*f_r)*f_dcrj;
+          r5[pos] = f_vx2*f_r + h2*(vs1+vs2);
+
+          vs1     = z[0]*(v1[pos+1] - f_v1) + z[1]*(v1[pos+2]       - v1[pos_km1]) FD8(DB34(z[2], z[3], v1, pos, 1));
+          vs2     = c1*(w1[pos_jp1] - f_w1) + c2*(w1[pos+yo[2]] - w1[pos_jm1]) FD8(DB34N(c3, c4, w1, pos, yo));
+          f_r     = r6[pos];
+          yz[pos] = (yz[pos]  + xmu3*(vs1+vs2) + vx1f*f_r)*f_dcrj;
+          r6[pos] = f_vx2*f_r + h3*(vs1+vs2);
+
+          if(k == h_nzt+align-2)
+          {
+             zz[pos+3] = -zz[pos];
+             xz[pos+2] = -xz[pos];
+             yz[pos+2] = -yz[pos];
+          }
+          else if(k == h_nzt+align-3)
+          {
+             xz[pos+4] = -xz[pos];
+             yz[pos+4] = -yz[pos];
+          }
+       }
+    }
+    return;
+}
+
+// interleaves the bits of the tile coordinates
+static unsigned int morton(unsigned int ti, unsigned int tj)
+{
+    unsigned int key = 0, b;
+
+    for(b=0;b<16;b++)
+       key |= ((ti>>b)&1)<<(2*b+1) | ((tj>>b)&1)<<(2*b);
+    return key;
+}
+
+static int cmpkey(const void *a, const void *b)
+{
+    unsigned int ka = ((const unsigned int *)a)[0], kb = ((const unsigned int *)b)[0];
+    return (ka>kb)-(ka<kb);
+}
+
+// picks the tile edge and sizes the tile list, returns the edge in columns
+int SetHostTiles(int CPUTILE)
+{
+    long l2 = 0, l3 = 0, cache, colbytes;
+    int  nth = 1;
+
+#ifdef _OPENMP
+    nth = omp_get_max_threads();
+#endif
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    l2  = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    l3  = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+    if(l2<=0) l2 = 1<<20;
+    cache = (l3/nth > l2 ? l3/nth : l2);
+
+    // 24 fields per column; a tile of edge t reads (t+2*reach)^2 columns
+    colbytes = 24*sizeof(float)*(h_nzt+2*align);
+    tile     = CPUTILE;
+    if(tile<=0)
+       tile = (int)sqrt((double)cache/colbytes) - 2*reach;
+    if(tile<2) tile = 2;
+
+    ntilemax = ((h_nxt+4+8*loop)/tile+2)*((h_nyt+4+8*loop)/tile+2);
+    free(tiles);
+    tiles    = (int *)malloc(sizeof(int)*2*ntilemax);
+    return tile;
+}
+
+// runs the velocity or stress kernel on columns [s_i,e_i]x[s_j,e_j] tile by tile
+static void sweep(int kernel, int s_i, int e_i, int s_j, int e_j, int NX, int rankx, int ranky)
+{
+    int n, ni, nj, t, i, j, i0, j0;
+
+    if(e_i<s_i || e_j<s_j) return;
+    ni = (e_i-s_i)/tile+1;
+    nj = (e_j-s_j)/tile+1;
+    for(n=0,i=0;i<ni;i++)
+      for(j=0;j<nj;j++,n++)
+      {
+         tiles[2*n]   = morton(i, j);
+         tiles[2*n+1] = i*nj+j;
+      }
+    qsort(tiles, n, 2*sizeof(int), cmpkey);
+
+    // static schedule: every thread gets one contiguous segment of the curve
+#pragma omp parallel for schedule(static) private(i, j, i0, j0)
+    for(t=0;t<n;t++)
+    {
+       i0 = s_i+tiles[2*t+1]/nj*tile;
+       j0 = s_j+tiles[2*t+1]%nj*tile;
+       for(i=i0;i<i0+tile && i<=e_i;i++)
+         for(j=j0;j<j0+tile && j<=e_j;j++)
+           if(kernel==VEL)
+              vel_col(i, j);
+           else
+              str_col(i, j, NX, rankx, ranky);
+    }
+    return;
+}
+
+void dvelcx_C(int s_i, int e_i)
+{
+    sweep(VEL, s_i, e_i, 2+4*loop, h_nyt+1+4*loop, 0, 0, 0);
+    return;
+}
+
+// velocity of the j lines s_j..e_j into s_u1/s_v1/s_w1, layout of dvelcy
+void dvelcy_C(int s_j, int e_j, float *s_u1, float *s_v1, float *s_w1, int rank)
+{
+    int i, j, k, pos, pos2;
+    nbr n;
+
+    if(rank<0) return;
+#pragma omp parallel for private(j, k, pos, pos2, n)
+    for(i=2+4*loop;i<h_nxt+2+4*loop;i++)
+      for(j=s_j;j<=e_j;j++)
+      {
+         pos  = colnbr(i, j, &n)+align;
+         pos2 = i*4*loop*h_nz+(j-s_j)*h_nz+align;
+         for(k=align;k<h_nzt+align;k++,pos++,pos2++)
+            dvel(pos, k, &n, dcrjx[i]*dcrjy[j]*dcrjz[k], &s_u1[pos2], &s_v1[pos2], &s_w1[pos2]);
+      }
+    return;
+}
+
+// received y halos into the ghost j lines, see update_boundary_y
+void update_bound_y_C(float *F_m, float *B_m, int rank_F, int rank_B)
+{
+    int i, j, pos, posj, h_offset, nbytes;
+
+    h_offset = (4*loop)*(h_nxt+4+8*loop)*(h_nzt+2*align);
+    nbytes   = sizeof(float)*h_nzt;
+    for(i=2+4*loop;i<h_nxt+2+4*loop;i++)
+      for(j=0;j<4*loop;j++)
+      {
+         posj = i*4*loop*h_nz+j*h_nz+align;
+         if(rank_F>=0)
+         {
+            pos = gridcol(i, 2+j)+align;
+            memcpy(u1+pos, F_m+posj,            nbytes);
+            memcpy(v1+pos, F_m+h_offset+posj,   nbytes);
+            memcpy(w1+pos, F_m+2*h_offset+posj, nbytes);
+         }
+         if(rank_B>=0)
+         {
+            pos = gridcol(i, h_nyt+4*loop+2+j)+align;
+            memcpy(u1+pos, B_m+posj,            nbytes);
+            memcpy(v1+pos, B_m+h_offset+posj,   nbytes);
+            memcpy(w1+pos, B_m+2*h_offset+posj, nbytes);
+         }
+      }
+    return;
+}
+
+void dstrqc_C(int s_i, int e_i, int s_j, int e_j, int NX, int rankx, int ranky)
+{
+    sweep(STR, s_i, e_i, s_j, e_j, NX, rankx, ranky);
+    return;
+}
+
+// fused sweep: velocity of planes s_i..e_i and stress of planes s_i-reach..e_i+reach,
+// velocity of planes s_i-2*reach..s_i-1 and e_i+1..e_i+2*reach must be updated already
+void fstep_C(int s_i, int e_i, int s_j, int e_j, int NX, int rankx, int ranky)
+{
+    int i, e;
+
+    for(i=s_i;i<=e_i;i+=tile)
+    {
+       e = (i+tile-1<e_i ? i+tile-1 : e_i);
+       sweep(VEL, i,       e,       2+4*loop, h_nyt+1+4*loop, NX, rankx, ranky);
+       sweep(STR, i-reach, e-reach, s_j,      e_j,            NX, rankx, ranky);
+    }
+    sweep(STR, e_i-reach+1, e_i+reach, s_j, e_j, NX, rankx, ranky);
+    return;
+}
+
+// 4*loop yz planes from plane i0 to the flat message h_m, or back if toGrid
+static void xplanes(float *h_m, int i0, int toGrid)
+{
+    int   i, j, h_offset = (4*loop)*h_ny*h_nz;
+    long  c;
+    float *m;
+
+    for(i=i0;i<i0+4*loop;i++)
+      for(j=0;j<h_ny;j++)
+      {
+         c = gridcol(i, j);
+         m = h_m+((i-i0)*h_ny+j)*h_nz;
+         if(toGrid)
+         {
+            memcpy(u1+c, m,            sizeof(float)*h_nz);
+            memcpy(v1+c, m+h_offset,   sizeof(float)*h_nz);
+            memcpy(w1+c, m+h_offset*2, sizeof(float)*h_nz);
+         }
+         else
+         {
+            memcpy(m,            u1+c, sizeof(float)*h_nz);
+            memcpy(m+h_offset,   v1+c, sizeof(float)*h_nz);
+            memcpy(m+h_offset*2, w1+c, sizeof(float)*h_nz);
+         }
+      }
+    return;
+}
+
+// x halo planes to and from the message buffers, see Cpy2Host_VX and Cpy2Device_VX
+void Cpy2Buf_VX_C(float *h_m, int rank, int flag)
+{
+    if(rank<0 || flag<1 || flag>2)
+       return;
+    xplanes(h_m, (flag==Left ? 2+4*loop : h_nxt+2), 0);
+    return;
+}
+
+void Cpy2Grid_VX_C(float *L_m, float *R_m, int rank_L, int rank_R)
+{
+    if(rank_L>=0)
+       xplanes(L_m, 2, 1);
+    if(rank_R>=0)
+       xplanes(R_m, h_nxt+4*loop+2, 1);
+    return;
+}
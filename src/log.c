@@ -0,0 +1,242 @@
+/**
+@section LICENSE
+Copyright (c) 2013-2016, Regents of the University of California
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*
+********************************************************************************
+* log.c                                                                        *
+* rank-aggregated run log (--LOGLEVEL, --LOGRANKS, --LOGDIR)                   *
+*                                                                              *
+* Levels: LV_ERROR, LV_INFO (summaries), LV_DETAIL (per-rank state) and        *
+* LV_DEBUG (per-step source traffic). A message reaches stdout if its level    *
+* is at most LOGLEVEL; errors always do.                                       *
+*                                                                              *
+* logrank: a message of this rank only. Below LV_ERROR it is printed only by   *
+* the ranks in LOGRANKS ("0", "0-3,17", "all"), prefixed with the rank.        *
+*                                                                              *
+* logall: collective over the run communicator. Rank 0 gathers the text of     *
+* every rank and prints each distinct text once with the ranks that sent it,   *
+* e.g. "[ranks 0-1,3 of 4] nxt,nyt,nzt=16,16,256". An empty text is not sent.  *
+*                                                                              *
+* With LOGDIR every message of every level and rank is also appended to        *
+* LOGDIR/<node>.log, one write per message so ranks of a node don't mix lines. *
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pmcl3d.h"
+
+#define LOGLINE 256
+
+static int      l_level = LV_INFO, l_rank = 0, l_size = 1, l_print = 1, l_fd = -1;
+static MPI_Comm l_comm = MPI_COMM_NULL;
+
+// 1 if rank is in the list spec, "all" or comma separated ranks and ranges a-b
+static int inranks(const char *spec, int rank)
+{
+  const char *p = spec;
+  char *e;
+  long  a, b;
+
+  if(!strcmp(spec, "all"))
+     return 1;
+  while(*p)
+  {
+     a = strtol(p, &e, 10);
+     if(e==p) return 0;
+     b = a;
+     if(*e=='-')
+     {
+        p = e+1;
+        b = strtol(p, &e, 10);
+        if(e==p) return 0;
+     }
+     if(rank>=a && rank<=b) return 1;
+     p = (*e==',' ? e+1 : e);
+     if(*e && *e!=',') return 0;
+  }
+  return 0;
+}
+
+static void tofile(int level, const char *msg)
+{
+  char line[LOGLINE+32];
+  int  n;
+
+  if(l_fd<0) return;
+  n = snprintf(line, sizeof(line), "%d %d %s%s", l_rank, level, msg, (msg[0] && msg[strlen(msg)-1]=='\n' ? "" : "\n"));
+  if(n>(int)sizeof(line)-1) n = sizeof(line)-1;
+  n = write(l_fd, line, n);
+  return;
+}
+
+int loginit(int LOGLEVEL, char *LOGRANKS, char *LOGDIR, int rank, int size, MPI_Comm MCW)
+{
+  char   name[MPI_MAX_PROCESSOR_NAME], *path;
+  int    len, err = 0;
+  size_t plen;
+
+  logclose();
+  l_level = LOGLEVEL;
+  l_rank  = rank;
+  l_size  = size;
+  l_comm  = MCW;
+  l_print = inranks(LOGRANKS, rank);
+  if(LOGDIR[0])
+  {
+     if(rank==0 && mkdir(LOGDIR, 0755) && errno!=EEXIST)
+        err = 1;
+     MPI_Bcast(&err, 1, MPI_INT, 0, MCW);
+     if(err)
+     {
+        if(rank==0) printf("can't create log directory %s\n", LOGDIR);
+        return -1;
+     }
+     // LOGDIR/<node>.log
+     MPI_Get_processor_name(name, &len);
+     plen = strlen(LOGDIR)+len+6;
+     path = (char *)malloc(plen);
+     if(snprintf(path, plen, "%s/%s.log", LOGDIR, name)<(int)plen)
+        l_fd = open(path, O_WRONLY|O_CREAT|O_APPEND, 0644);
+     err  = (l_fd<0);
+     MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MAX, MCW);
+     if(err && l_fd<0)
+        printf("rank %d can't open %s\n", rank, path);
+     free(path);
+     if(err)
+     {
+        if(l_fd>=0) close(l_fd);
+        l_fd = -1;
+        return -1;
+     }
+     if(rank==0) printf("per-node logs in %s, lines are: rank level message\n", LOGDIR);
+  }
+  return 0;
+}
+
+void logrank(int level, const char *fmt, ...)
+{
+  char    msg[LOGLINE];
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(msg, sizeof(msg), fmt, ap);
+  va_end(ap);
+  tofile(level, msg);
+  if(level<=l_level && (level==LV_ERROR || l_print))
+  {
+     printf("[rank %d] %s", l_rank, msg);
+     if(msg[0] && msg[strlen(msg)-1]!='\n') printf("\n");
+  }
+  return;
+}
+
+static int cmptext(const void *a, const void *b)
+{
+  return strcmp((const char *)a, (const char *)b);
+}
+
+// "0-1,3" for the sorted ranks r[0..n-1]
+static void ranklist(char *s, int len, int *r, int n)
+{
+  int i, j, m = 0;
+
+  s[0] = '\0';
+  for(i=0;i<n && m<len-24;i=j+1)
+  {
+     for(j=i;j+1<n && r[j+1]==r[j]+1;j++);
+     m += snprintf(s+m, len-m, (j>i ? "%s%d-%d" : "%s%d"), (i ? "," : ""), r[i], r[j]);
+  }
+  if(i<n) snprintf(s+m, len-m, ",...");
+  return;
+}
+
+void logall(int level, const char *fmt, ...)
+{
+  char    msg[LOGLINE], *all = NULL, *text, *m, list[128];
+  int     *tid, *cnt, *off, *rk, i, n, t, ntext;
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(msg, sizeof(msg), fmt, ap);
+  va_end(ap);
+  if(msg[0]) tofile(level, msg);
+  if(l_rank==0) all = (char *)malloc((size_t)LOGLINE*l_size);
+  MPI_Gather(msg, LOGLINE, MPI_CHAR, all, LOGLINE, MPI_CHAR, 0, l_comm);
+  if(l_rank!=0 || level>l_level)
+  {
+     free(all);
+     return;
+  }
+  // the distinct texts, sorted
+  text = (char *)malloc((size_t)LOGLINE*l_size);
+  for(i=0,ntext=0;i<l_size;i++)
+     if(all[(size_t)LOGLINE*i])
+        memcpy(text+(size_t)LOGLINE*ntext++, all+(size_t)LOGLINE*i, LOGLINE);
+  qsort(text, ntext, LOGLINE, cmptext);
+  for(i=0,n=0;i<ntext;i++)
+     if(n==0 || strcmp(text+(size_t)LOGLINE*i, text+(size_t)LOGLINE*(n-1)))
+        memmove(text+(size_t)LOGLINE*n++, text+(size_t)LOGLINE*i, LOGLINE);
+  ntext = n;
+
+  // ranks of every text in rank order, a counting sort on the text index
+  tid = (int *)malloc(sizeof(int)*l_size);
+  rk  = (int *)malloc(sizeof(int)*l_size);
+  cnt = (int *)calloc(ntext+1, sizeof(int));
+  off = (int *)calloc(ntext+1, sizeof(int));
+  for(i=0;i<l_size;i++)
+  {
+     m      = all+(size_t)LOGLINE*i;
+     tid[i] = (m[0] ? (int)(((char *)bsearch(m, text, ntext, LOGLINE, cmptext)-text)/LOGLINE) : -1);
+     if(tid[i]>=0) cnt[tid[i]+1]++;
+  }
+  for(t=0;t<ntext;t++)
+     cnt[t+1] += cnt[t];
+  for(i=0;i<l_size;i++)
+     if(tid[i]>=0) rk[cnt[tid[i]]+off[tid[i]]++] = i;
+
+  // one line per text, in the order of the lowest rank that sent it
+  for(i=0;i<l_size;i++)
+  {
+     t = tid[i];
+     if(t<0 || rk[cnt[t]]!=i) continue;
+     n = off[t];
+     m = text+(size_t)LOGLINE*t;
+     ranklist(list, sizeof(list), rk+cnt[t], n);
+     if(n==l_size)
+        printf("[all %d ranks] %s", l_size, m);
+     else
+        printf("[rank%s %s of %d] %s", (n>1 ? "s" : ""), list, l_size, m);
+     if(m[strlen(m)-1]!='\n') printf("\n");
+  }
+  free(off);
+  free(cnt);
+  free(rk);
+  free(tid);
+  free(text);
+  free(all);
+  return;
+}
+
+void logclose()
+{
+  if(l_fd>=0) close(l_fd);
+  l_fd = -1;
+  return;
+}
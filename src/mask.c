@@ -0,0 +1,292 @@
+/**
+@section LICENSE
+Copyright (c) 2013-2016, Regents of the University of California
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+********************************************************************************
+* mask.c                                                                       *
+* surface mask for sparse output                                               *
+*                                                                              *
+* The mask selects a subset of the recording lattice (NBG:NSKP:NED) in x/y.    *
+* It is either a raster of rec_NX*rec_NY bytes (x fastest, nonzero=record) or  *
+* a polygon file with one "x y" vertex per line in global grid indices (as     *
+* NBGX/NBGY), polygons separated by lines starting with '>'.                   *
+* Masked points are written compacted, ordered z level, y, x, and the file     *
+* OUT/SIDX holds the global (x,y,z) grid index of every point in file order.   *
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pmcl3d.h"
+
+// reads polygon vertices on rank 0 and broadcasts them
+// ring[i] is the polygon number of vertex i
+static int readpoly(char *MASK, int rank, MPI_Comm MCW, int *nvtx, float **px, float **py, int **ring)
+{
+  int   n = 0, nmax = 0, r = 0, err = 0;
+  float *x = NULL, *y = NULL;
+  int   *p = NULL;
+  char  line[256];
+  FILE  *file;
+
+  if(rank==0)
+  {
+     file = fopen(MASK,"r");
+     if(!file)
+     {
+        printf("can't open mask file %s\n", MASK);
+        err = 1;
+     }
+     else
+     {
+        while(fgets(line, sizeof(line), file))
+        {
+           if(line[0]=='#') continue;
+           if(line[0]=='>')
+           {
+              if(n>0 && p[n-1]==r) r++;
+              continue;
+           }
+           if(n==nmax)
+           {
+              nmax = nmax ? 2*nmax : 1024;
+              x    = (float *)realloc(x, sizeof(float)*nmax);
+              y    = (float *)realloc(y, sizeof(float)*nmax);
+              p    = (int *)realloc(p, sizeof(int)*nmax);
+           }
+           if(sscanf(line, "%f %f", &x[n], &y[n])==2)
+           {
+              p[n] = r;
+              n++;
+           }
+        }
+        fclose(file);
+     }
+  }
+  MPI_Bcast(&err, 1, MPI_INT, 0, MCW);
+  if(err) return -1;
+  MPI_Bcast(&n, 1, MPI_INT, 0, MCW);
+  if(rank!=0)
+  {
+     x = (float *)malloc(sizeof(float)*(n>0 ? n : 1));
+     y = (float *)malloc(sizeof(float)*(n>0 ? n : 1));
+     p = (int *)malloc(sizeof(int)*(n>0 ? n : 1));
+  }
+  MPI_Bcast(x, n, MPI_FLOAT, 0, MCW);
+  MPI_Bcast(y, n, MPI_FLOAT, 0, MCW);
+  MPI_Bcast(p, n, MPI_INT,   0, MCW);
+  *nvtx = n;
+  *px   = x;
+  *py   = y;
+  *ring = p;
+  return 0;
+}
+
+// even-odd rule over all polygons
+static int inpoly(float gx, float gy, int nvtx, float *x, float *y, int *ring)
+{
+  int i, j, b, e, in = 0;
+
+  for(b=0;b<nvtx;b=e)
+  {
+     for(e=b;e<nvtx && ring[e]==ring[b];e++);
+     for(i=b,j=e-1;i<e;j=i++)
+       if( ((y[i]>gy) != (y[j]>gy)) &&
+           (gx < (x[j]-x[i])*(gy-y[i])/(y[j]-y[i]) + x[i]) )
+         in = !in;
+  }
+  return in;
+}
+
+int inimask(char *MASK, int MASKTYPE, int rank, int *coord, int PX, MPI_Comm MCW,
+            int nxt, int nyt, int nzt, int rec_NX, int rec_NY,
+            int rec_nxt, int rec_nyt, int rec_nzt,
+            int rec_nbgx, int rec_nbgy, int rec_nbgz,
+            int NBGX, int NSKPX, int NBGY, int NSKPY, int NSKPZ,
+            int *nmask, PosInf *mask_pos, PosInf *mask_gidx, PosInf *mask_grid, int *NMASK)
+{
+  int   i, j, k, ix, iy, iz, n, err;
+  int   x0=0, y0=0, npoly=0, nrec2, nglob2;
+  float *polyx=NULL, *polyy=NULL;
+  int   *ring=NULL;
+  unsigned char *tmpmask;
+  PosInf rowcnt, rowoff, pos, gidx, grid;
+  MPI_File     fh;
+  MPI_Datatype readtype;
+  MPI_Status   filestatus;
+  int   rmtype[2], rptype[2], roffset[2];
+
+  nrec2 = rec_nxt*rec_nyt;
+  if(nrec2>0)
+  {
+     // first local point on the recording lattice, as in calcRecordingPoints
+     if(NBGX <= nxt*coord[0]) x0 = (nxt*coord[0]-NBGX)/NSKPX+1;
+     if(NBGY <= nyt*coord[1]) y0 = (nyt*coord[1]-NBGY)/NSKPY+1;
+  }
+  tmpmask = (unsigned char *)malloc(nrec2>0 ? nrec2 : 1);
+
+  if(MASKTYPE==0)
+  {
+     err = MPI_File_open(MCW,MASK,MPI_MODE_RDONLY,MPI_INFO_NULL,&fh);
+     if(err!=MPI_SUCCESS)
+     {
+        if(rank==0) printf("can't open mask file %s\n", MASK);
+        free(tmpmask);
+        return -1;
+     }
+     if(nrec2>0)
+     {
+        rmtype[0]  = rec_NY;
+        rmtype[1]  = rec_NX;
+        rptype[0]  = rec_nyt;
+        rptype[1]  = rec_nxt;
+        roffset[0] = y0;
+        roffset[1] = x0;
+        err = MPI_Type_create_subarray(2, rmtype, rptype, roffset, MPI_ORDER_C, MPI_UNSIGNED_CHAR, &readtype);
+        err = MPI_Type_commit(&readtype);
+        err = MPI_File_set_view(fh, 0, MPI_UNSIGNED_CHAR, readtype, "native", MPI_INFO_NULL);
+     }
+     err = MPI_File_read_all(fh, tmpmask, nrec2, MPI_UNSIGNED_CHAR, &filestatus);
+     err = MPI_File_close(&fh);
+     if(nrec2>0) MPI_Type_free(&readtype);
+  }
+  else
+  {
+     if(readpoly(MASK, rank, MCW, &npoly, &polyx, &polyy, &ring))
+     {
+        free(tmpmask);
+        return -1;
+     }
+     for(iy=0;iy<rec_nyt;iy++)
+       for(ix=0;ix<rec_nxt;ix++)
+         tmpmask[iy*rec_nxt+ix] = inpoly((float)(NBGX+(x0+ix)*NSKPX), (float)(NBGY+(y0+iy)*NSKPY),
+                                         npoly, polyx, polyy, ring);
+     free(polyx);
+     free(polyy);
+     free(ring);
+  }
+
+  // global position of each row segment: all rows above, then the ranks to the left
+  rowcnt = Alloc1P(rec_NY*PX);
+  rowoff = Alloc1P(rec_NY*PX);
+  for(iy=0;iy<rec_nyt;iy++)
+  {
+     n = 0;
+     for(ix=0;ix<rec_nxt;ix++)
+       if(tmpmask[iy*rec_nxt+ix]) n++;
+     rowcnt[(y0+iy)*PX+coord[0]] = n;
+  }
+  MPI_Allreduce(rowcnt, rowoff, rec_NY*PX, MPI_INT, MPI_SUM, MCW);
+  nglob2 = 0;
+  for(i=0;i<rec_NY*PX;i++)
+  {
+     n         = rowoff[i];
+     rowoff[i] = nglob2;
+     nglob2   += n;
+  }
+
+  n = 0;
+  for(i=0;i<nrec2;i++)
+    if(tmpmask[i]) n++;
+  n   = n*rec_nzt;
+  pos  = Alloc1P(n>0 ? n : 1);
+  gidx = Alloc1P(n>0 ? n : 1);
+  grid = Alloc1P(n>0 ? 3*n : 1);
+  n = 0;
+  for(iz=0;iz<rec_nzt;iz++)
+    for(iy=0;iy<rec_nyt;iy++)
+    {
+       j = rowoff[(y0+iy)*PX+coord[0]];
+       for(ix=0;ix<rec_nxt;ix++)
+       {
+          if(!tmpmask[iy*rec_nxt+ix]) continue;
+          i = 2+4*loop + rec_nbgx + ix*NSKPX;
+          k = nzt+align-1 - rec_nbgz - iz*NSKPZ;
+          pos[n]        = gridcol(i, 2+4*loop + rec_nbgy + iy*NSKPY) + k;
+          gidx[n]       = iz*nglob2 + j;
+          grid[3*n]     = NBGX + (x0+ix)*NSKPX;
+          grid[3*n+1]   = NBGY + (y0+iy)*NSKPY;
+          grid[3*n+2]   = rec_nbgz + iz*NSKPZ + 1;
+          j++;
+          n++;
+       }
+    }
+
+  if(rank==0) printf("Surface mask %s: %d of %d recording points per level\n", MASK, nglob2, rec_NX*rec_NY);
+
+  Delloc1P(rowcnt);
+  Delloc1P(rowoff);
+  free(tmpmask);
+  *nmask     = n;
+  *mask_pos  = pos;
+  *mask_gidx = gidx;
+  *mask_grid = grid;
+  *NMASK     = nglob2;
+  return 0;
+}
+
+// filetype of one output batch: nmask scattered floats per step, WRITE_STEP steps of NPTS floats
+void maskfiletype(int nmask, PosInf mask_gidx, long NPTS, int WRITE_STEP, MPI_Datatype oldtype,
+                  MPI_Datatype *filetype)
+{
+  int i, *ones;
+  MPI_Aint extent, lb, *dispArray;
+  MPI_Datatype steptype;
+
+  MPI_Type_get_extent(oldtype, &lb, &extent);
+  ones      = (int *)malloc(sizeof(int)*WRITE_STEP);
+  dispArray = (MPI_Aint *)malloc(sizeof(MPI_Aint)*WRITE_STEP);
+  MPI_Type_create_indexed_block(nmask, 1, mask_gidx, oldtype, &steptype);
+  MPI_Type_commit(&steptype);
+  for(i=0;i<WRITE_STEP;i++)
+  {
+     ones[i]      = 1;
+     dispArray[i] = extent;
+     dispArray[i] = dispArray[i]*NPTS*i;
+  }
+  MPI_Type_create_hindexed(WRITE_STEP, ones, dispArray, steptype, filetype);
+  MPI_Type_commit(filetype);
+  MPI_Type_free(&steptype);
+  free(ones);
+  free(dispArray);
+  return;
+}
+
+// OUT/SIDX: global (x,y,z) grid indices, 3 ints per masked point in file order
+int writemaskindex(char *filename, MPI_Comm MCW, MPI_Info info, int nmask, PosInf mask_gidx, PosInf mask_grid, long NPTS)
+{
+  int err;
+  MPI_Datatype xyz, filetype;
+  MPI_File     fh;
+  MPI_Status   filestatus;
+
+  MPI_Type_contiguous(3, MPI_INT, &xyz);
+  MPI_Type_commit(&xyz);
+  maskfiletype(nmask, mask_gidx, NPTS, 1, xyz, &filetype);
+  err = MPI_File_open(MCW,filename,MPI_MODE_CREATE|MPI_MODE_WRONLY,info,&fh);
+  if(err!=MPI_SUCCESS)
+  {
+     printf("can't open mask index file %s\n", filename);
+     MPI_Type_free(&filetype);
+     MPI_Type_free(&xyz);
+     return -1;
+  }
+  err = MPI_File_set_view(fh, 0, MPI_INT, filetype, "native", info);
+  err = MPI_File_write_all(fh, mask_grid, 3*nmask, MPI_INT, &filestatus);
+  err = MPI_File_close(&fh);
+  MPI_Type_free(&filetype);
+  MPI_Type_free(&xyz);
+  return 0;
+}
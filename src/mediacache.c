@@ -0,0 +1,252 @@
+/**
+@section LICENSE
+Copyright (c) 2013-2016, Regents of the University of California
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*
+********************************************************************************
+* mediacache.c                                                                 *
+* converted media cache (--MEDIACACHE), written by mediapart                   *
+*                                                                              *
+* One file per subdomain, <MEDIACACHE>/media_<x>_<y>.bin for cart coordinates  *
+* (x,y), holds a MediaHeader and the padded d1, mu, lam (and qp, qs with       *
+* NVE=1) exactly as pmcl3d has them after inimesh and mediaswap: Q corrected,  *
+* clamped, inverted and with the ghost planes filled.                          *
+*                                                                              *
+* The header records the decomposition, the FD padding, the options that       *
+* enter the conversion (NVAR, NVE, SoCalQ, FL/FH/FP) and the identity of the   *
+* media file: its size, modification time and inode, and FNV-1a over the size  *
+* and 17 evenly spaced 1 MB blocks. The sampled hash alone misses edits        *
+* between the blocks; an edit in place changes the modification time and a     *
+* replaced file the inode. A run uses the cache only when every rank finds a   *
+* matching header, otherwise it reads and converts the media as before.        *
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "pmcl3d.h"
+
+#define MEDIA_MAGIC   0x4d435741   // "AWCM"
+#define MEDIA_VERSION 2
+#define HASHBLOCK     1048576
+
+// identity of the media file on rank 0, id = hash, size, mtime, inode, all 0 if it can't be read
+static void mediahash(char *INVEL, unsigned long *id, int rank, MPI_Comm MCW)
+{
+  unsigned long h = 14695981039346656037UL;
+  unsigned char *buf;
+  struct stat st;
+  FILE   *f;
+  off_t  size, off;
+  size_t n, i;
+  int    b;
+
+  memset(id, 0, 4*sizeof(unsigned long));
+  if(rank==0)
+  {
+     f = fopen(INVEL, "rb");
+     if(f && fstat(fileno(f), &st)==0)
+     {
+        buf  = (unsigned char *)malloc(HASHBLOCK);
+        size = st.st_size;
+        for(i=0;i<sizeof(size);i++)
+           h = (h^((size>>(8*i))&0xff))*1099511628211UL;
+        for(b=0;b<=16;b++)
+        {
+           off = (size>HASHBLOCK ? (size-HASHBLOCK)/16*b : 0);
+           fseeko(f, off, SEEK_SET);
+           n = fread(buf, 1, HASHBLOCK, f);
+           for(i=0;i<n;i++)
+              h = (h^buf[i])*1099511628211UL;
+        }
+        free(buf);
+        id[0] = h;
+        id[1] = size;
+        id[2] = st.st_mtime;
+        id[3] = st.st_ino;
+     }
+     if(f)
+        fclose(f);
+  }
+  MPI_Bcast(id, 4, MPI_UNSIGNED_LONG, 0, MCW);
+  return;
+}
+
+static void cachename(char *name, char *MEDIACACHE, int *coords)
+{
+  sprintf(name, "%s/media_%d_%d.bin", MEDIACACHE, coords[0], coords[1]);
+  return;
+}
+
+// the fields of a cache header that must match the run, collective over MCW
+void mediakey(MediaHeader *h, char *INVEL, int rank, MPI_Comm MCW, int *coords, int NX, int NY, int NZ,
+              int PX, int PY, int NVAR, int NVE, int SoCalQ, float FL, float FH, float FP)
+{
+  unsigned long id[4];
+
+  mediahash(INVEL, id, rank, MCW);
+  memset(h, 0, sizeof(MediaHeader));
+  h->magic   = MEDIA_MAGIC;
+  h->version = MEDIA_VERSION;
+  h->hash    = id[0];
+  h->fsize   = id[1];
+  h->mtime   = id[2];
+  h->ino     = id[3];
+  h->NX      = NX;
+  h->NY      = NY;
+  h->NZ      = NZ;
+  h->PX      = PX;
+  h->PY      = PY;
+  h->cx      = coords[0];
+  h->cy      = coords[1];
+  h->fdloop  = loop;
+  h->fdalign = align;
+  h->NVAR    = NVAR;
+  h->NVE     = NVE;
+  h->SoCalQ  = SoCalQ;
+  h->FL      = FL;
+  h->FH      = FH;
+  h->FP      = FP;
+  return;
+}
+
+// one padded field column by column, the file keeps the flat order whatever
+// the host layout (--CPUBRICK)
+static int cachefield(FILE *f, MediaHeader *h, Grid3D U, int save)
+{
+  int    i, j, err = 0;
+  int    nx = h->NX/h->PX+4+8*loop, ny = h->NY/h->PY+4+8*loop;
+  size_t nz = h->NZ+2*align;
+
+  for(i=0;i<nx && !err;i++)
+    for(j=0;j<ny && !err;j++)
+      err = (save ? fwrite(U[i][j], sizeof(float), nz, f) : fread(U[i][j], sizeof(float), nz, f))!=nz;
+  return err;
+}
+
+int mediasave(char *MEDIACACHE, MediaHeader *h, Grid3D d1, Grid3D mu, Grid3D lam, Grid3D qp, Grid3D qs)
+{
+  char   name[256];
+  FILE   *f;
+  int    err;
+
+  cachename(name, MEDIACACHE, &h->cx);
+  f = fopen(name, "wb");
+  if(!f)
+  {
+     printf("can't create media cache %s\n", name);
+     return -1;
+  }
+  err = (fwrite(h, sizeof(MediaHeader), 1, f)!=1);
+  err = err || cachefield(f, h, d1, 1);
+  err = err || cachefield(f, h, mu, 1);
+  err = err || cachefield(f, h, lam, 1);
+  if(h->NVE==1)
+  {
+     err = err || cachefield(f, h, qp, 1);
+     err = err || cachefield(f, h, qs, 1);
+  }
+  if(fclose(f) || err)
+  {
+     printf("can't write media cache %s\n", name);
+     return -1;
+  }
+  return 0;
+}
+
+// why a rank's cache file does not match, a missing file ranks lowest
+static const char *cachewhy[8] = {"", "no file", "not a media cache", "different media file", "media file modified",
+                                  "different grid or decomposition", "different FD_ORDER",
+                                  "different NVAR, NVE, SoCalQ or FL/FH/FP"};
+
+// 1 if every rank has a cache matching key, which then receives the stored extremes
+int mediafind(char *MEDIACACHE, MediaHeader *key, int rank, MPI_Comm MCW)
+{
+  char        name[256];
+  FILE        *f;
+  MediaHeader h;
+  int         why = 0, bad, nbad, all, in[2], out[2];
+
+  cachename(name, MEDIACACHE, &key->cx);
+  f = fopen(name, "rb");
+  if(!f)
+     why = 1;
+  else
+  {
+     if(fread(&h, sizeof(MediaHeader), 1, f)!=1 || h.magic!=MEDIA_MAGIC || h.version!=MEDIA_VERSION)
+        why = 2;
+     else if(h.hash!=key->hash || h.fsize!=key->fsize || h.ino!=key->ino)
+        why = 3;
+     else if(h.mtime!=key->mtime)
+        why = 4;
+     else if(h.NX!=key->NX || h.NY!=key->NY || h.NZ!=key->NZ || h.PX!=key->PX || h.PY!=key->PY ||
+             h.cx!=key->cx || h.cy!=key->cy)
+        why = 5;
+     else if(h.fdloop!=key->fdloop || h.fdalign!=key->fdalign)
+        why = 6;
+     else if(h.NVAR!=key->NVAR || h.NVE!=key->NVE || h.SoCalQ!=key->SoCalQ ||
+             h.FL!=key->FL || h.FH!=key->FH || h.FP!=key->FP)
+        why = 7;
+     fclose(f);
+  }
+  // the strongest reason and its first rank, reported once
+  in[0] = why;
+  in[1] = rank;
+  bad   = (why>0);
+  MPI_Allreduce(in, out, 1, MPI_2INT, MPI_MAXLOC, MCW);
+  MPI_Reduce(&bad, &nbad, 1, MPI_INT, MPI_SUM, 0, MCW);
+  all = (out[0]==0);
+  if(!all && rank==0)
+     printf("media cache in %s not used, %d rank(s) without a match, rank %d: %s\n",
+            MEDIACACHE, nbad, out[1], cachewhy[out[0]]);
+  if(all)
+  {
+     memcpy(key, &h, sizeof(MediaHeader));
+     if(rank==0) printf("media from the cache in %s\n", MEDIACACHE);
+  }
+  return all;
+}
+
+// streams the arrays of a cache found by mediafind into place
+int mediaload(char *MEDIACACHE, MediaHeader *h, Grid3D d1, Grid3D mu, Grid3D lam, Grid3D qp, Grid3D qs)
+{
+  char   name[256];
+  FILE   *f;
+  int    err;
+
+  cachename(name, MEDIACACHE, &h->cx);
+  f = fopen(name, "rb");
+  if(!f)
+  {
+     printf("can't open media cache %s\n", name);
+     return -1;
+  }
+  err = fseek(f, sizeof(MediaHeader), SEEK_SET);
+  err = err || cachefield(f, h, d1, 0);
+  err = err || cachefield(f, h, mu, 0);
+  err = err || cachefield(f, h, lam, 0);
+  if(h->NVE==1)
+  {
+     err = err || cachefield(f, h, qp, 0);
+     err = err || cachefield(f, h, qs, 0);
+  }
+  fclose(f);
+  if(err)
+  {
+     printf("can't read media cache %s\n", name);
+     return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,164 @@
+/**
+@section LICENSE
+Copyright (c) 2013-2016, Regents of the University of California
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*
+********************************************************************************
+* mediapart.c                                                                  *
+* media partitioner: converted media cache for one decomposition               *
+*                                                                              *
+* mpirun -np PX*PY mediapart <pmcl3d options> --MEDIACACHE <dir>               *
+*                                                                              *
+* Takes the pmcl3d options of the run (NX/NY/NZ, PX/PY, MEDIASTART 1 or 2,    *
+* INVEL, NVAR, NVE, SoCalQ, FL/FH/FP). Every rank reads and converts its       *
+* subdomain of the global media file with inimesh, fills the ghost planes      *
+* with mediaswap and writes the padded arrays to <dir>, see mediacache.c. A    *
+* run with the same options and --MEDIACACHE <dir> loads them instead of       *
+* converting. The media file needs no per-rank split (MEDIASTART 3): the       *
+* tool is rerun for each new PX/PY.                                            *
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "pmcl3d.h"
+
+int main(int argc, char **argv)
+{
+    float TMAX, DH, DT, ARBC, PHT;
+    int   NPC, ND, NSRC, NST;
+    int   NVE, NVAR, MEDIASTART, IFAULT, READ_STEP, READ_STEP_GPU;
+    int   NX, NY, NZ, PX, PY, IDYNA, SoCalQ;
+    int   NBGX, NEDX, NSKPX, NBGY, NEDY, NSKPY, NBGZ, NEDZ, NSKPZ;
+    int   NTISKP, WRITE_STEP, MASKTYPE, SINKMODE, IOTUNE, CPU, CPUTILE, FDCOEF, DRMSKIP;
+    float FL, FH, FP;
+    char  INSRC[50], INVEL[50], OUT[50], INSRC_I2[50], CHKFILE[50], MASK[50], SINK[50], IOHINTS[50];
+    char  DRMREC[50], DRMIN[50], DRMBOX[50], DRMORIGIN[50];
+    int   MONITOR, MONACTION;
+    float MONGROW;
+    char  HEARTBEAT[50];
+    float ENDTOL;
+    int   ENDWIN, ENDMODE;
+    float SRCDT;
+    int   SRCINTERP;
+    int   HALOFMT;
+    int   FRAMES, FRAMESKIP, FRAMEFMT;
+    float FRAMEVMAX;
+    char  FRAMEOUT[50];
+    int   AUTO;
+    float FMAX, PPW, COURANT, REFL;
+    char  MEDIACACHE[50];
+    int   CPUBRICK;
+    int   CPUREC;
+    int   LOGLEVEL;
+    char  LOGRANKS[50], LOGDIR[50];
+    int   rank, size, err, allerr, nxt, nyt, nzt;
+    int   dim[2], period[2] = {0, 0}, coord[2];
+    int   x_rank_L, x_rank_R, y_rank_F, y_rank_B;
+    float taumax, taumin, vse[2], vpe[2], dde[2];
+    double t0;
+    Grid3D d1, mu, lam, qp = NULL, qs = NULL;
+    MediaHeader h;
+    MPI_Comm MCW, MC1;
+    MPI_Info mediainfo, outinfo;
+
+    MPI_Init(&argc,&argv);
+    MPI_Comm_dup(MPI_COMM_WORLD, &MCW);
+    MPI_Comm_rank(MCW,&rank);
+    MPI_Comm_size(MCW,&size);
+    t0 = MPI_Wtime();
+
+    if(command(argc,argv,&TMAX,&DH,&DT,&ARBC,&PHT,&NPC,&ND,&NSRC,&NST,
+      &NVAR,&NVE,&MEDIASTART,&IFAULT,&READ_STEP,&READ_STEP_GPU,
+      &NTISKP,&WRITE_STEP,&NX,&NY,&NZ,&PX,&PY,
+      &NBGX,&NEDX,&NSKPX,&NBGY,&NEDY,&NSKPY,&NBGZ,&NEDZ,&NSKPZ,
+      &FL,&FH,&FP,&IDYNA,&SoCalQ,INSRC,INVEL,OUT,INSRC_I2,CHKFILE,
+      MASK,&MASKTYPE,SINK,&SINKMODE,IOHINTS,&IOTUNE,&CPU,&CPUTILE,&FDCOEF,
+      DRMREC,DRMIN,DRMBOX,DRMORIGIN,&DRMSKIP,
+      &MONITOR,&MONACTION,&MONGROW,HEARTBEAT,
+      &ENDTOL,&ENDWIN,&ENDMODE,
+      &SRCDT,&SRCINTERP,
+      &HALOFMT,
+      &FRAMES,&FRAMESKIP,&FRAMEVMAX,&FRAMEFMT,FRAMEOUT,
+      &AUTO,&FMAX,&PPW,&COURANT,&REFL,
+      MEDIACACHE,
+      &CPUBRICK,
+      &CPUREC,
+      &LOGLEVEL,LOGRANKS,LOGDIR))
+      MPI_Abort(MCW, -1);
+    if(!MEDIACACHE[0] || (MEDIASTART!=1 && MEDIASTART!=2) || size!=PX*PY)
+    {
+       if(rank==0) printf("mediapart needs --MEDIACACHE, MEDIASTART 1 or 2 and PX*PY=%d ranks, not %d\n", PX*PY, size);
+       MPI_Abort(MCW, -1);
+    }
+    if(rank==0 && mkdir(MEDIACACHE, 0755) && errno!=EEXIST)
+    {
+       printf("can't create %s\n", MEDIACACHE);
+       MPI_Abort(MCW, -1);
+    }
+    if(iohints(IOHINTS, rank, MCW, &mediainfo, &outinfo))
+       MPI_Abort(MCW, -1);
+    if(loginit(LOGLEVEL, LOGRANKS, LOGDIR, rank, size, MCW))
+       MPI_Abort(MCW, -1);
+
+    // same decomposition and neighbours as pmcl3d
+    nxt    = NX/PX;
+    nyt    = NY/PY;
+    nzt    = NZ;
+    dim[0] = PX;
+    dim[1] = PY;
+    MPI_Cart_create(MCW, 2, dim, period, 1, &MC1);
+    MPI_Cart_shift(MC1, 0, 1, &x_rank_L, &x_rank_R);
+    MPI_Cart_shift(MC1, 1, 1, &y_rank_F, &y_rank_B);
+    MPI_Cart_coords(MC1, rank, 2, coord);
+
+    d1  = Alloc3D(nxt+4+8*loop, nyt+4+8*loop, nzt+2*align);
+    mu  = Alloc3D(nxt+4+8*loop, nyt+4+8*loop, nzt+2*align);
+    lam = Alloc3D(nxt+4+8*loop, nyt+4+8*loop, nzt+2*align);
+    if(NVE==1)
+    {
+       qp = Alloc3D(nxt+4+8*loop, nyt+4+8*loop, nzt+2*align);
+       qs = Alloc3D(nxt+4+8*loop, nyt+4+8*loop, nzt+2*align);
+    }
+    inimesh(MEDIASTART, d1, mu, lam, qp, qs, &taumax, &taumin, NVAR, FP, FL, FH,
+            nxt, nyt, nzt, PX, PY, NX, NY, NZ, coord, MCW, IDYNA, NVE, SoCalQ, INVEL,
+            vse, vpe, dde, mediainfo);
+    mediaswap(d1, mu, lam, qp, qs, rank, x_rank_L, x_rank_R, y_rank_F, y_rank_B, nxt, nyt, nzt, MCW);
+
+    mediakey(&h, INVEL, rank, MCW, coord, NX, NY, NZ, PX, PY, NVAR, NVE, SoCalQ, FL, FH, FP);
+    h.taumax = taumax;
+    h.taumin = taumin;
+    h.vse[0] = vse[0];  h.vse[1] = vse[1];
+    h.vpe[0] = vpe[0];  h.vpe[1] = vpe[1];
+    h.dde[0] = dde[0];  h.dde[1] = dde[1];
+    err = mediasave(MEDIACACHE, &h, d1, mu, lam, qp, qs);
+    MPI_Allreduce(&err, &allerr, 1, MPI_INT, MPI_MIN, MCW);
+    if(rank==0)
+    {
+       if(allerr)
+          printf("mediapart: writing %s failed\n", MEDIACACHE);
+       else
+          printf("mediapart: %s for %dx%d subdomains of %dx%dx%d in %s, %.1f s\n", INVEL, PX, PY, nxt, nyt, nzt,
+                 MEDIACACHE, MPI_Wtime()-t0);
+    }
+
+    Delloc3D(d1);
+    Delloc3D(mu);
+    Delloc3D(lam);
+    Delloc3D(qp);
+    Delloc3D(qs);
+    logclose();
+    MPI_Finalize();
+    return (allerr ? -1 : 0);
+}
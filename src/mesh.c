@@ -16,19 +16,178 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 #include <math.h>
 #include "pmcl3d.h"
 
+#define MESHSLABS 8     // the media are read in this many z slabs, one ahead of the conversion
+
+static int          m_open = 0;                 // 1 MPI-IO, 2 stdio
+static int          m_nvar, m_off, m_nuse, m_nzt, m_ks, m_nslab, m_posted;
+static long         m_plane;                    // cells of a z plane
+static char         m_name[256];
+static Grid1D       m_buf[2] = {NULL, NULL}, m_rec = NULL;
+static FILE         *m_file;
+static MPI_File     m_fh;
+static MPI_Datatype m_readtype, m_celltype, m_usetype;
+static MPI_Request  m_req[2];
+
+// posts the collective read of slab b, stdio slabs are read by meshwait
+static void meshslab(int b)
+{
+  int  k0;
+  long n;
+
+  if(m_open!=1 || b>=m_nslab || b<m_posted)
+     return;
+  k0 = b*m_ks;
+  n  = (k0+m_ks<m_nzt ? m_ks : m_nzt-k0)*m_plane*m_nuse;
+  MPI_File_iread_all(m_fh, m_buf[b%2], (int)n, MPI_FLOAT, &m_req[b%2]);
+  m_posted = b+1;
+  return;
+}
+
+// slab b in m_buf[b%2], nuse floats per cell
+static int meshwait(int b)
+{
+  int  k, k0, k1, n;
+  long p;
+
+  if(m_open==1)
+  {
+     MPI_Wait(&m_req[b%2], MPI_STATUS_IGNORE);
+     return 0;
+  }
+  k0 = b*m_ks;
+  k1 = (k0+m_ks<m_nzt ? k0+m_ks : m_nzt);
+  // one z plane at a time
+  for(k=k0;k<k1;k++)
+  {
+     if(!fread(m_rec,sizeof(float),m_nvar*m_plane,m_file))
+     {
+        printf("can't read file %s", m_name);
+        return -1;
+     }
+     for(p=0;p<m_plane;p++)
+       for(n=0;n<m_nuse;n++)
+         m_buf[b%2][((long)(k-k0)*m_plane+p)*m_nuse+n] = m_rec[p*m_nvar+m_off+n];
+  }
+  return 0;
+}
+
+static void meshclose()
+{
+  if(m_open==1)
+  {
+     MPI_File_close(&m_fh);
+     MPI_Type_free(&m_readtype);
+     MPI_Type_free(&m_celltype);
+     MPI_Type_free(&m_usetype);
+  }
+  else if(m_open==2)
+  {
+     fclose(m_file);
+     Delloc1D(m_rec);
+  }
+  Delloc1D(m_buf[0]);
+  Delloc1D(m_buf[1]);
+  m_rec    = NULL;
+  m_buf[0] = m_buf[1] = NULL;
+  m_open   = 0;
+  return;
+}
+
+// opens the media file of MEDIASTART 1-3 and starts reading its first slab, so the
+// caller can set up the source while it arrives; inimesh reads the rest
+int meshopen(int MEDIASTART, int nvar, int NVE, int nxt, int nyt, int nzt, int PX, int PY, int NX, int NY,
+             int NZ, int *coords, MPI_Comm MCW, char *INVEL, MPI_Info mediainfo)
+{
+  int rank, err;
+  int rmtype[3], rptype[3], roffset[3];
+  MPI_Aint usedisp;
+
+  if(MEDIASTART<1 || MEDIASTART>3 || m_open)
+     return 0;
+  // only the nuse variables from m_off on are read, into a compact buffer
+  m_nvar   = nvar;
+  m_off    = (nvar==8 ? 3 : 0);
+  m_nuse   = (nvar>3 && NVE==1 ? 5 : 3);
+  m_nzt    = nzt;
+  m_plane  = (long)nxt*nyt;
+  m_ks     = (nzt+MESHSLABS-1)/MESHSLABS;
+  m_nslab  = (nzt+m_ks-1)/m_ks;
+  m_posted = 0;
+  m_req[0] = m_req[1] = MPI_REQUEST_NULL;
+  if(MEDIASTART<3) sprintf(m_name,"%s",INVEL);
+  else
+  {
+    MPI_Comm_rank(MCW,&rank);
+    sprintf(m_name,"input_rst/mediapart/media%07d.bin",rank);
+    logrank(LV_DETAIL, "reading file=%s", m_name);
+  }
+  if(MEDIASTART==3 || (PX==1 && PY==1))
+  {
+     m_file = fopen(m_name,"rb");
+     if(!m_file)
+     {
+        printf("can't open file %s", m_name);
+        return -1;
+     }
+     m_rec  = Alloc1D(nvar*m_plane);
+     m_open = 2;
+  }
+  else
+  {
+     usedisp = m_off*sizeof(float);
+     // nuse floats at m_off of a cell of nvar floats
+     err = MPI_Type_create_hindexed(1, &m_nuse, &usedisp, MPI_FLOAT, &m_usetype);
+     err = MPI_Type_create_resized(m_usetype, 0, nvar*sizeof(float), &m_celltype);
+     rmtype[0]  = NZ;
+     rmtype[1]  = NY;
+     rmtype[2]  = NX;
+     rptype[0]  = nzt;
+     rptype[1]  = nyt;
+     rptype[2]  = nxt;
+     roffset[0] = 0;
+     roffset[1] = nyt*coords[1];
+     roffset[2] = nxt*coords[0];
+     err = MPI_Type_create_subarray(3, rmtype, rptype, roffset, MPI_ORDER_C, m_celltype, &m_readtype);
+     err = MPI_Type_commit(&m_readtype);
+     err = MPI_File_open(MCW,m_name,MPI_MODE_RDONLY,mediainfo,&m_fh);
+     if(err!=MPI_SUCCESS)
+     {
+        printf("can't open file %s", m_name);
+        MPI_Type_free(&m_readtype);
+        MPI_Type_free(&m_celltype);
+        MPI_Type_free(&m_usetype);
+        return -1;
+     }
+     err = MPI_File_set_view(m_fh, 0, MPI_FLOAT, m_readtype, "native", mediainfo);
+     m_open = 1;
+  }
+  m_buf[0] = Alloc1D(m_nuse*m_plane*m_ks);
+  m_buf[1] = Alloc1D(m_nuse*m_plane*m_ks);
+  meshslab(0);
+  return 0;
+}
+
+// drops a media file opened by meshopen that inimesh will not read
+void meshabort()
+{
+  if(m_open==1)
+  {
+     MPI_Wait(&m_req[0], MPI_STATUS_IGNORE);
+     MPI_Wait(&m_req[1], MPI_STATUS_IGNORE);
+  }
+  if(m_open)
+     meshclose();
+  return;
+}
+
 void inimesh(int MEDIASTART, Grid3D d1, Grid3D mu, Grid3D lam, Grid3D qp, Grid3D qs, float *taumax, float *taumin,
              int nvar, float FP,  float FL, float FH, int nxt, int nyt, int nzt, int PX, int PY, int NX, int NY,
              int NZ, int *coords, MPI_Comm MCW, int IDYNA, int NVE, int SoCalQ, char *INVEL,
-             float *vse, float *vpe, float *dde)
+             float *vse, float *vpe, float *dde, MPI_Info mediainfo)
 {
   int merr;
-  int rank;
-  int i,j,k,err;
+  int i,j,k;
   float vp,vs,dd,pi;
-  int   rmtype[3], rptype[3], roffset[3];
-  MPI_Datatype readtype;
-  MPI_Status   filestatus;
-  MPI_File     fh;
 
   pi      = 4.*atan(1.);
   if(MEDIASTART==0)
@@ -47,6 +206,9 @@ void inimesh(int MEDIASTART, Grid3D d1, Grid3D mu, Grid3D lam, Grid3D qp, Grid3D
        vs=2800.0;
        dd=2500.0;
     }
+    vpe[0] = vpe[1] = vp;
+    vse[0] = vse[1] = vs;
+    dde[0] = dde[1] = dd;
 
     for(i=0;i<nxt+4+8*loop;i++)
       for(j=0;j<nyt+4+8*loop;j++)
@@ -61,7 +223,7 @@ void inimesh(int MEDIASTART, Grid3D d1, Grid3D mu, Grid3D lam, Grid3D qp, Grid3D
   {
       Grid3D tmpvp=NULL, tmpvs=NULL, tmpdd=NULL;
       Grid3D tmppq=NULL, tmpsq=NULL;
-      int var_offset;
+      int    b, ks, nslab;
 
       tmpvp = Alloc3D(nxt, nyt, nzt);
       tmpvs = Alloc3D(nxt, nyt, nzt);
@@ -88,95 +250,6 @@ void inimesh(int MEDIASTART, Grid3D d1, Grid3D mu, Grid3D lam, Grid3D qp, Grid3D
             }
       }
 
-      if(nvar==8)
-      {
-          var_offset=3;
-      }
-      else if(nvar==5)
-      {
-          var_offset=0;
-      }
-      else
-      {
-          var_offset=0;
-      }
-
-      if(MEDIASTART>=1 && MEDIASTART<=3)
-      {
-          char filename[40];
-          if(MEDIASTART<3) sprintf(filename,INVEL);
-          else if(MEDIASTART==3){
-            MPI_Comm_rank(MCW,&rank);
-            sprintf(filename,"input_rst/mediapart/media%07d.bin",rank);
-            if(rank%100==0) printf("Rank=%d, reading file=%s\n",rank,filename);
-          }
-          Grid1D tmpta = Alloc1D(nvar*nxt*nyt*nzt);
-          if(MEDIASTART==3 || (PX==1 && PY==1))
-          {
-             FILE   *file;
-             file = fopen(filename,"rb");
-             if(!file)
-             {
-                printf("can't open file %s", filename);
-                return;
-             }
-             if(!fread(tmpta,sizeof(float),nvar*nxt*nyt*nzt,file))
-             {
-                printf("can't read file %s", filename);
-                return;
-             }
-             //printf("%d) 0-0-0,1-10-3=%f, %f\n",rank,tmpta[0],tmpta[1+10*nxt+3*nxt*nyt]);
-          }
-          else{
-		    rmtype[0]  = NZ;
-    		    rmtype[1]  = NY;
-    		    rmtype[2]  = NX*nvar;
-    		    rptype[0]  = nzt;
-    		    rptype[1]  = nyt;
-    		    rptype[2]  = nxt*nvar;
-    		    roffset[0] = 0;
-    		    roffset[1] = nyt*coords[1];
-    		    roffset[2] = nxt*coords[0]*nvar;
-    		    err = MPI_Type_create_subarray(3, rmtype, rptype, roffset, MPI_ORDER_C, MPI_FLOAT, &readtype);
-    		    err = MPI_Type_commit(&readtype);
-                    err = MPI_File_open(MCW,filename,MPI_MODE_RDONLY,MPI_INFO_NULL,&fh);
-                    err = MPI_File_set_view(fh, 0, MPI_FLOAT, readtype, "native", MPI_INFO_NULL);
-                    err = MPI_File_read_all(fh, tmpta, nvar*nxt*nyt*nzt, MPI_FLOAT, &filestatus);
-                    err = MPI_File_close(&fh);
-          }
-          for(k=0;k<nzt;k++)
-            for(j=0;j<nyt;j++)
-              for(i=0;i<nxt;i++){
-              	tmpvp[i][j][k]=tmpta[(k*nyt*nxt+j*nxt+i)*nvar+var_offset];
-              	tmpvs[i][j][k]=tmpta[(k*nyt*nxt+j*nxt+i)*nvar+var_offset+1];
-               	tmpdd[i][j][k]=tmpta[(k*nyt*nxt+j*nxt+i)*nvar+var_offset+2];
-              	if(nvar>3){
-                	tmppq[i][j][k]=tmpta[(k*nyt*nxt+j*nxt+i)*nvar+var_offset+3];
-                	tmpsq[i][j][k]=tmpta[(k*nyt*nxt+j*nxt+i)*nvar+var_offset+4];
-                }
-                /*if(tmpvp[i][j][k]!=tmpvp[i][j][k] ||
-                    tmpvs[i][j][k]!=tmpvs[i][j][k] ||
-                    tmpdd[i][j][k]!=tmpdd[i][j][k]){
-                      printf("%d) tmpvp,vs,dd is NAN!\n");
-                      MPI_Abort(MPI_COMM_WORLD,1);
-                }*/
-         }
-         //printf("%d) vp,vs,dd[0^3]=%f,%f,%f\n",rank,tmpvp[0][0][0],
-         //   tmpvs[0][0][0], tmpdd[0][0][0]);
-         Delloc1D(tmpta);
-      }
-
-      if(nvar==3 && NVE==1)
-      {
-        for(i=0;i<nxt;i++)
-          for(j=0;j<nyt;j++){
-            for(k=0;k<nzt;k++){
-                 tmpsq[i][j][k]=0.05*tmpvs[i][j][k];
-                 tmppq[i][j][k]=2.0*tmpsq[i][j][k];
-            }
-          }
-      }
-
       float w0=0.0f, ww1=0.0f, w2=0.0f, tmp1=0.0f, tmp2=0.0f;
       float qpinv=0.0f, qsinv=0.0f, vpvs=0.0f;
       if(NVE==1)
@@ -196,58 +269,100 @@ void inimesh(int MEDIASTART, Grid3D d1, Grid3D mu, Grid3D lam, Grid3D qp, Grid3D
       vse[1] = -1.0e10;
       vpe[1] = -1.0e10;
       dde[1] = -1.0e10;
-      for(i=0;i<nxt;i++)
-        for(j=0;j<nyt;j++)
-          for(k=0;k<nzt;k++)
-          {
-             tmpvs[i][j][k] = tmpvs[i][j][k]*(1+ ( log(w2/w0) )/(pi*tmpsq[i][j][k]) );
-             tmpvp[i][j][k] = tmpvp[i][j][k]*(1+ ( log(w2/w0) )/(pi*tmppq[i][j][k]) );
-             if (SoCalQ==1)
-             {
-                vpvs=tmpvp[i][j][k]/tmpvs[i][j][k];
-                if (vpvs<1.45)  tmpvs[i][j][k]=tmpvp[i][j][k]/1.45;
-             }
-             //if(tmpvs[i][j][k]<400.0)
-             if(tmpvs[i][j][k]<200.0)
-             {
-                //tmpvs[i][j][k]=400.0;
-                //tmpvp[i][j][k]=1200.0;
-                tmpvs[i][j][k]=200.0;
-                tmpvp[i][j][k]=600.0;
-             }
-             if(tmpvp[i][j][k]>6500.0){
-                tmpvs[i][j][k]=3752.0;
-                tmpvp[i][j][k]=6500.0;
+
+      // slab b+1 is read while slab b is converted
+      if(meshopen(MEDIASTART, nvar, NVE, nxt, nyt, nzt, PX, PY, NX, NY, NZ, coords, MCW, INVEL, mediainfo))
+         return;
+      ks    = (m_open ? m_ks : nzt);
+      nslab = (nzt+ks-1)/ks;
+      for(b=0;b<nslab;b++)
+      {
+         int k0 = b*ks, k1 = (k0+ks<nzt ? k0+ks : nzt), n;
+         if(m_open)
+         {
+            meshslab(b+1);
+            if(meshwait(b))
+               return;
+            n = m_nuse;
+            for(k=k0;k<k1;k++)
+              for(j=0;j<nyt;j++)
+                for(i=0;i<nxt;i++){
+                  long p = (((long)(k-k0)*nyt+j)*nxt+i)*n;
+                  tmpvp[i][j][k]=m_buf[b%2][p];
+                  tmpvs[i][j][k]=m_buf[b%2][p+1];
+                  tmpdd[i][j][k]=m_buf[b%2][p+2];
+                  if(n>3){
+                    tmppq[i][j][k]=m_buf[b%2][p+3];
+                    tmpsq[i][j][k]=m_buf[b%2][p+4];
+                  }
+                }
+         }
+
+         if(nvar==3 && NVE==1)
+         {
+           for(i=0;i<nxt;i++)
+             for(j=0;j<nyt;j++){
+               for(k=k0;k<k1;k++){
+                    tmpsq[i][j][k]=0.05*tmpvs[i][j][k];
+                    tmppq[i][j][k]=2.0*tmpsq[i][j][k];
+               }
              }
-             if(tmpdd[i][j][k]<1700.0) tmpdd[i][j][k]=1700.0;
-             mu[i+2+4*loop][j+2+4*loop][(nzt+align-1) - k]  = 1./(tmpdd[i][j][k]*tmpvs[i][j][k]*tmpvs[i][j][k]);
-             lam[i+2+4*loop][j+2+4*loop][(nzt+align-1) - k] = 1./(tmpdd[i][j][k]*(tmpvp[i][j][k]*tmpvp[i][j][k]
-                                                                              -2.*tmpvs[i][j][k]*tmpvs[i][j][k]));
-             d1[i+2+4*loop][j+2+4*loop][(nzt+align-1) - k]  = tmpdd[i][j][k];
-             if(NVE==1)
+         }
+
+         for(i=0;i<nxt;i++)
+           for(j=0;j<nyt;j++)
+             for(k=k0;k<k1;k++)
              {
-                if(tmppq[i][j][k]<=0.0)
+                tmpvs[i][j][k] = tmpvs[i][j][k]*(1+ ( log(w2/w0) )/(pi*tmpsq[i][j][k]) );
+                tmpvp[i][j][k] = tmpvp[i][j][k]*(1+ ( log(w2/w0) )/(pi*tmppq[i][j][k]) );
+                if (SoCalQ==1)
                 {
-                   qpinv=0.0;
-                   qsinv=0.0;
+                   vpvs=tmpvp[i][j][k]/tmpvs[i][j][k];
+                   if (vpvs<1.45)  tmpvs[i][j][k]=tmpvp[i][j][k]/1.45;
                 }
-                else
+                //if(tmpvs[i][j][k]<400.0)
+                if(tmpvs[i][j][k]<200.0)
                 {
-                   qpinv=1./tmppq[i][j][k];
-                   qsinv=1./tmpsq[i][j][k];
+                   //tmpvs[i][j][k]=400.0;
+                   //tmpvp[i][j][k]=1200.0;
+                   tmpvs[i][j][k]=200.0;
+                   tmpvp[i][j][k]=600.0;
                 }
-                tmppq[i][j][k]=tmp1*qpinv/(1.0-tmp2*qpinv);
-                tmpsq[i][j][k]=tmp1*qsinv/(1.0-tmp2*qsinv);
-                qp[i+2+4*loop][j+2+4*loop][(nzt+align-1) - k] = tmppq[i][j][k];
-                qs[i+2+4*loop][j+2+4*loop][(nzt+align-1) - k] = tmpsq[i][j][k];
+                if(tmpvp[i][j][k]>6500.0){
+                   tmpvs[i][j][k]=3752.0;
+                   tmpvp[i][j][k]=6500.0;
+                }
+                if(tmpdd[i][j][k]<1700.0) tmpdd[i][j][k]=1700.0;
+                mu[i+2+4*loop][j+2+4*loop][(nzt+align-1) - k]  = 1./(tmpdd[i][j][k]*tmpvs[i][j][k]*tmpvs[i][j][k]);
+                lam[i+2+4*loop][j+2+4*loop][(nzt+align-1) - k] = 1./(tmpdd[i][j][k]*(tmpvp[i][j][k]*tmpvp[i][j][k]
+                                                                                 -2.*tmpvs[i][j][k]*tmpvs[i][j][k]));
+                d1[i+2+4*loop][j+2+4*loop][(nzt+align-1) - k]  = tmpdd[i][j][k];
+                if(NVE==1)
+                {
+                   if(tmppq[i][j][k]<=0.0)
+                   {
+                      qpinv=0.0;
+                      qsinv=0.0;
+                   }
+                   else
+                   {
+                      qpinv=1./tmppq[i][j][k];
+                      qsinv=1./tmpsq[i][j][k];
+                   }
+                   tmppq[i][j][k]=tmp1*qpinv/(1.0-tmp2*qpinv);
+                   tmpsq[i][j][k]=tmp1*qsinv/(1.0-tmp2*qsinv);
+                   qp[i+2+4*loop][j+2+4*loop][(nzt+align-1) - k] = tmppq[i][j][k];
+                   qs[i+2+4*loop][j+2+4*loop][(nzt+align-1) - k] = tmpsq[i][j][k];
+                }
+                if(tmpvs[i][j][k]<vse[0]) vse[0] = tmpvs[i][j][k];
+                if(tmpvs[i][j][k]>vse[1]) vse[1] = tmpvs[i][j][k];
+                if(tmpvp[i][j][k]<vpe[0]) vpe[0] = tmpvp[i][j][k];
+                if(tmpvp[i][j][k]>vpe[1]) vpe[1] = tmpvp[i][j][k];
+                if(tmpdd[i][j][k]<dde[0]) dde[0] = tmpdd[i][j][k];
+                if(tmpdd[i][j][k]>dde[1]) dde[1] = tmpdd[i][j][k];
              }
-             if(tmpvs[i][j][k]<vse[0]) vse[0] = tmpvs[i][j][k];
-             if(tmpvs[i][j][k]>vse[1]) vse[1] = tmpvs[i][j][k];
-             if(tmpvp[i][j][k]<vpe[0]) vpe[0] = tmpvp[i][j][k];
-             if(tmpvp[i][j][k]>vpe[1]) vpe[1] = tmpvp[i][j][k];
-             if(tmpdd[i][j][k]<dde[0]) dde[0] = tmpdd[i][j][k];
-             if(tmpdd[i][j][k]>dde[1]) dde[1] = tmpdd[i][j][k];
-          }
+      }
+      meshclose();
       Delloc3D(tmpvp);
       Delloc3D(tmpvs);
       Delloc3D(tmpdd);
@@ -0,0 +1,335 @@
+/**
+@section LICENSE
+Copyright (c) 2013-2016, Regents of the University of California
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+********************************************************************************
+* monitor.c                                                                    *
+* health monitor of a running simulation (--MONITOR)                           *
+*                                                                              *
+* Every MONITOR steps each rank sums the kinetic energy 1/2 rho |v|^2 dh^3,    *
+* the largest |v| and the number of non-finite velocities of its block, and    *
+* one MPI_Allreduce with a user operator combines them with the slowest and    *
+* fastest rank by their own compute time since the previous check. The run is  *
+* unstable if a velocity is NaN/Inf, or if the kinetic energy grew by more     *
+* than MONGROW since the previous check once the source is over. MONACTION     *
+* then decides: 0 report, 1 end the time loop so the output, CHKFILE and DRM   *
+* record are closed cleanly, 2 MPI_Abort.                                      *
+*                                                                              *
+* Rank 0 rewrites the HEARTBEAT file at every check (step, elapsed time, ETA,  *
+* throughput, energy, status), through a rename so readers never see a        *
+* partial file.                                                                *
+*                                                                              *
+* --ENDTOL ends a run early once it has gone quiet. Every ENDWIN/10 steps,     *
+* rounded up, the kinetic energy of the recording box (ENDMODE 0) or the       *
+* largest |v| on its top layer (ENDMODE 1) is sampled; after the source (step  *
+* > NST) the run ends when the largest of the last 10 or fewer samples, at     *
+* least ENDWIN steps, is below ENDTOL times the largest sample of the run.     *
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pmcl3d.h"
+
+#define MONVALS 6       // energy, max |v|, non-finite, slowest compute time, its rank, fastest compute time
+
+static int      m_every, m_action, m_cpu, m_rank;
+static float    m_grow;
+static char     m_heartbeat[50];
+static MPI_Comm m_comm;
+static MPI_Op   m_op;
+static int      m_nxt, m_nyt, m_nzt;
+static long     m_nt, m_nst;
+static double   m_cell;                 // dh^3
+static double   m_t0, m_tlast;          // wall clock at the start and the last check
+static double   m_clast = 0.0;          // compute seconds of this rank at the last check
+static double   m_elast = -1.0;         // kinetic energy of the last check
+static double   m_last[MONVALS], m_rate;
+static double   *m_part = NULL, *d_m_part = NULL;
+static char     m_status[80] = "running";
+static float    m_endtol;
+static int      m_endmode, m_endevery, m_endnwin, m_endbox[6];
+static long     m_endn;
+static double   m_endwin[10], m_endpeak;   // last m_endnwin <= 10 samples, peak of the run
+
+// combines the MONVALS values of two ranks
+static void monreduce(void *in, void *inout, int *len, MPI_Datatype *type)
+{
+  double *a = (double *)in, *b = (double *)inout;
+  int    i;
+
+  for(i=0;i<*len;i+=MONVALS)
+  {
+     b[i]   += a[i];
+     if(a[i+1]>b[i+1]) b[i+1] = a[i+1];
+     b[i+2] += a[i+2];
+     if(a[i+3]>b[i+3])
+     {
+        b[i+3] = a[i+3];
+        b[i+4] = a[i+4];
+     }
+     if(a[i+5]<b[i+5]) b[i+5] = a[i+5];
+  }
+  return;
+}
+
+// Courant number vp*dt/dh against the limit 1/(sqrt(3)*sum|c_m|) of the staggered scheme
+float cfllimit(int FDCOEF)
+{
+  float c[2][4] = {FD_TAYLOR, FD_DRP};
+  float sum = 0.0;
+  int   m;
+
+  for(m=0;m<4;m++)
+     sum += fabs(c[FDCOEF][m]);
+  return 1.0/(sqrt(3.0)*sum);
+}
+
+float cflcheck(int rank, float vpmax, float DH, float DT, int FDCOEF)
+{
+  float cfl, lim;
+
+  cfl = vpmax*DT/DH;
+  lim = cfllimit(FDCOEF);
+  if(rank==0 && cfl>lim)
+     printf("WARNING: vp*dt/dh = %f exceeds the stability limit %f of FD order %d, the run will blow up\n",
+            cfl, lim, FD_ORDER);
+  return cfl;
+}
+
+// shared by the health monitor and --ENDTOL, MONITOR=0 for the latter only
+int moninit(int MONITOR, int MONACTION, float MONGROW, char *HEARTBEAT, int CPU, int rank, MPI_Comm MCW,
+            int nxt, int nyt, int nzt, float DH, long nt, int NST)
+{
+  m_every  = MONITOR;
+  m_action = MONACTION;
+  m_grow   = MONGROW;
+  m_cpu    = CPU;
+  m_rank   = rank;
+  m_comm   = MCW;
+  m_nxt    = nxt;
+  m_nyt    = nyt;
+  m_nzt    = nzt;
+  m_nt     = nt;
+  m_nst    = NST;
+  m_cell   = (double)DH*DH*DH;
+  m_elast  = -1.0;
+  strcpy(m_status, "running");
+  strcpy(m_heartbeat, HEARTBEAT);
+  if(MONACTION<0 || MONACTION>2 || MONGROW<=1.0)
+  {
+     if(rank==0) printf("MONACTION must be 0, 1 or 2 and MONGROW > 1\n");
+     return -1;
+  }
+  MPI_Op_create(monreduce, 1, &m_op);
+  m_part = (double *)malloc(sizeof(double)*3*nyt);
+  if(!CPU)
+     cudaMalloc((void**)&d_m_part, sizeof(double)*3*nyt);
+  m_t0 = m_tlast = MPI_Wtime();
+  m_clast = 0.0;
+  if(rank==0 && MONITOR>0) printf("health monitor every %d steps, energy growth limit %g, on instability: %s\n", MONITOR, MONGROW,
+                     (MONACTION==0 ? "report" : (MONACTION==1 ? "stop" : "abort")));
+  return 0;
+}
+
+static void heartbeat(long cur_step, double *g, double rate)
+{
+  FILE   *fp;
+  char   tmpname[60];
+  double elapsed = MPI_Wtime()-m_t0;
+
+  if(!m_heartbeat[0]) return;
+  sprintf(tmpname, "%s.tmp", m_heartbeat);
+  fp = fopen(tmpname, "w");
+  if(!fp)
+  {
+     printf("can't write heartbeat file %s\n", tmpname);
+     return;
+  }
+  fprintf(fp, "step %ld of %ld\n", cur_step, m_nt);
+  fprintf(fp, "elapsed %.1f s\n", elapsed);
+  fprintf(fp, "eta %.1f s\n", (cur_step>0 ? elapsed/cur_step*(m_nt-cur_step) : 0.0));
+  fprintf(fp, "steps/s %.3f\n", rate);
+  fprintf(fp, "slowest rank %d %.3f compute steps/s\n", (int)g[4], (g[3]>0.0 ? m_every/g[3] : 0.0));
+  fprintf(fp, "fastest rank %.3f compute steps/s\n", (g[5]>0.0 ? m_every/g[5] : 0.0));
+  fprintf(fp, "kinetic energy %e J\n", g[0]);
+  fprintf(fp, "max |v| %e m/s\n", g[1]);
+  fprintf(fp, "non-finite %.0f\n", g[2]);
+  fprintf(fp, "status %s\n", m_status);
+  fclose(fp);
+  rename(tmpname, m_heartbeat);
+  return;
+}
+
+// sum rho|v|^2, max |v|^2 and the non-finite count over the padded index box
+// i0..i1, j0..j1, k0..k1 (inclusive), the fields are device arrays unless CPU
+static void monbox(double *r, float *u1, float *v1, float *w1, float *d1, int *box)
+{
+  double e = 0.0, vmax = 0.0, nbad = 0.0, uu;
+  long   pos;
+  int    i, j, k;
+
+  if(m_cpu)
+  {
+#pragma omp parallel for private(j,k,pos,uu) reduction(+:e,nbad) reduction(max:vmax)
+     for(i=box[0];i<=box[1];i++)
+       for(j=box[2];j<=box[3];j++)
+         for(k=box[4],pos=gridcol(i,j)+k;k<=box[5];k++,pos++)
+         {
+            uu  = (double)u1[pos]*u1[pos]+(double)v1[pos]*v1[pos]+(double)w1[pos]*w1[pos];
+            if(!isfinite(uu))
+            {
+               nbad += 1.0;
+               continue;
+            }
+            e += (double)d1[pos]*uu;
+            if(uu>vmax) vmax = uu;
+         }
+  }
+  else
+  {
+     monitor_H(d_m_part, u1, v1, w1, d1, box[0], box[1], box[2], box[3], box[4], box[5]);
+     cudaMemcpy(m_part, d_m_part, sizeof(double)*3*(box[3]-box[2]+1), cudaMemcpyDeviceToHost);
+     for(j=0;j<=box[3]-box[2];j++)
+     {
+        e    += m_part[3*j];
+        if(m_part[3*j+1]>vmax) vmax = m_part[3*j+1];
+        nbad += m_part[3*j+2];
+     }
+  }
+  r[0] = e;
+  r[1] = vmax;
+  r[2] = nbad;
+  return;
+}
+
+// one health check, tcomp = compute seconds of this rank so far; returns 1 to end the time loop
+int monstep(long cur_step, float *u1, float *v1, float *w1, float *d1, double tcomp)
+{
+  double loc[MONVALS], g[MONVALS], r[3], t, vv;
+  int    box[6] = {2+4*loop, m_nxt+1+4*loop, 2+4*loop, m_nyt+1+4*loop, align, m_nzt+align-1};
+  int    unstable = 0;
+
+  monbox(r, u1, v1, w1, d1, box);
+  t      = MPI_Wtime();
+  loc[0] = 0.5*r[0]*m_cell;
+  loc[1] = sqrt(r[1]);
+  loc[2] = r[2];
+  loc[3] = tcomp-m_clast;
+  loc[4] = m_rank;
+  loc[5] = tcomp-m_clast;
+  MPI_Allreduce(loc, g, MONVALS, MPI_DOUBLE, m_op, m_comm);
+  vv      = m_every/(t-m_tlast);
+  m_tlast = t;
+  m_clast = tcomp;
+
+  if(g[2]>0.0)
+  {
+     sprintf(m_status, "unstable at step %ld: %.0f non-finite velocities", cur_step, g[2]);
+     unstable = 1;
+  }
+  else if(cur_step>m_nst && m_elast>0.0 && g[0]>m_grow*m_elast)
+  {
+     sprintf(m_status, "unstable at step %ld: kinetic energy grew %.3g times", cur_step, g[0]/m_elast);
+     unstable = 1;
+  }
+  m_elast = g[0];
+  memcpy(m_last, g, sizeof(m_last));
+  m_rate  = vv;
+  if(m_rank==0)
+  {
+     printf("MONITOR step %ld: E=%e J, max|v|=%e m/s, %.2f steps/s, slowest rank %d, ETA %.0f s\n",
+            cur_step, g[0], g[1], vv, (int)g[4], (MPI_Wtime()-m_t0)/cur_step*(m_nt-cur_step));
+     if(unstable) printf("MONITOR: %s\n", m_status);
+     heartbeat(cur_step, g, vv);
+  }
+  if(unstable && m_action==2)
+     MPI_Abort(m_comm, -1);
+  return (unstable && m_action==1);
+}
+
+// box = recording box of this rank in padded indices, i0 > i1 if it has none
+int endinit(float ENDTOL, int ENDWIN, int ENDMODE, int *box)
+{
+  int n;
+
+  if(ENDWIN<1 || ENDMODE<0 || ENDMODE>1)
+  {
+     if(m_rank==0) printf("ENDWIN must be positive and ENDMODE 0 or 1\n");
+     return -1;
+  }
+  m_endtol   = ENDTOL;
+  m_endmode  = ENDMODE;
+  // at most 10 samples in the window, which covers ENDWIN steps or a few more
+  m_endevery = (ENDWIN+9)/10;
+  m_endnwin  = (ENDWIN+m_endevery-1)/m_endevery;
+  m_endn     = 0;
+  m_endpeak  = 0.0;
+  for(n=0;n<6;n++)
+     m_endbox[n] = box[n];
+  // the surface PGV only looks at the top layer of the box
+  if(ENDMODE==1)
+     m_endbox[4] = m_endbox[5];
+  if(m_rank==0) printf("run ends when the %s of the last %d steps is below %g of its peak, sampled every %d steps\n",
+                       (ENDMODE==0 ? "energy" : "surface PGV"), m_endnwin*m_endevery, ENDTOL, m_endevery);
+  return m_endevery;
+}
+
+// one sample of the end criterion; returns 1 when the run has gone quiet
+int endstep(long cur_step, float *u1, float *v1, float *w1, float *d1)
+{
+  double r[3] = {0.0, 0.0, 0.0}, loc, g, wmax = 0.0;
+  int    n;
+
+  if(m_endbox[0]<=m_endbox[1] && m_endbox[2]<=m_endbox[3])
+     monbox(r, u1, v1, w1, d1, m_endbox);
+  if(m_endmode==0)
+  {
+     loc = 0.5*r[0]*m_cell;
+     MPI_Allreduce(&loc, &g, 1, MPI_DOUBLE, MPI_SUM, m_comm);
+  }
+  else
+  {
+     loc = sqrt(r[1]);
+     MPI_Allreduce(&loc, &g, 1, MPI_DOUBLE, MPI_MAX, m_comm);
+  }
+  m_endwin[m_endn%m_endnwin] = g;
+  m_endn++;
+  if(g>m_endpeak) m_endpeak = g;
+  for(n=0;n<m_endnwin && n<m_endn;n++)
+     if(m_endwin[n]>wmax) wmax = m_endwin[n];
+  if(cur_step>m_nst && m_endn>=m_endnwin && m_endpeak>0.0 && wmax<m_endtol*m_endpeak)
+  {
+     if(m_rank==0) printf("run ended at step %ld: %s %e below %g of the peak %e\n", cur_step,
+                          (m_endmode==0 ? "energy" : "surface PGV"), wmax, m_endtol, m_endpeak);
+     return 1;
+  }
+  return 0;
+}
+
+// final heartbeat, stopped=1 after an instability, -1 when the run never started
+void monclose(long cur_step, int stopped)
+{
+  if(!stopped) strcpy(m_status, "done");
+  else         strcat(m_status, ", stopped");
+  if(m_rank==0 && m_every>0 && stopped>=0) heartbeat(cur_step, m_last, m_rate);
+  MPI_Op_free(&m_op);
+  free(m_part);
+  if(d_m_part) cudaFree(d_m_part);
+  m_part   = NULL;
+  d_m_part = NULL;
+  return;
+}
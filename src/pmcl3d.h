@@ -23,6 +23,7 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 #include <cuda_runtime.h>
 #include <mpi.h>
 #include "pmcl3d_cons.h"
+#include "sink.h"
 
 #ifdef __RESTRICT
 #define RESTRICT restrict
@@ -37,7 +38,37 @@ typedef float *RESTRICT *RESTRICT *RESTRICT Grid3D;
 typedef float *RESTRICT Grid1D;
 typedef int   *RESTRICT PosInf;
 
-void command(int argc, char **argv,
+// message levels of the run log (log.c)
+enum { LV_ERROR, LV_INFO, LV_DETAIL, LV_DEBUG };
+
+// head of a boundary wavefield record (drm.c)
+typedef struct {
+  int   magic;
+  int   version;
+  long  npts;                      // recorded points
+  int   nrec;                      // records in the file
+  int   skip;                      // time steps per record
+  float dh, dt;                    // grid of the recording run
+  float box[5];                    // x0, x1, y0, y1, z1 (m)
+  int   margin;                    // cells recorded on either side of the box surface
+} DrmHeader;
+
+// head of a converted media cache file (mediacache.c)
+typedef struct {
+  int   magic;
+  int   version;
+  unsigned long hash;              // mediahash of the media file
+  unsigned long fsize, mtime, ino; // stat of the media file
+  int   NX, NY, NZ, PX, PY;
+  int   cx, cy;                    // cart coordinates of the subdomain
+  int   fdloop, fdalign;           // padding of the arrays, loop and align
+  int   NVAR, NVE, SoCalQ;
+  float FL, FH, FP;
+  float taumax, taumin;            // inimesh results
+  float vse[2], vpe[2], dde[2];
+} MediaHeader;
+
+int command(int argc, char **argv,
              float *TMAX, float *DH, float *DT, float *ARBC, float *PHT,
              int *NPC, int *ND, int *NSRC, int *NST, int *NVAR,
              int *NVE, int *MEDIASTART, int *IFAULT,
@@ -49,7 +80,19 @@ void command(int argc, char **argv,
              int *NBGZ, int *NEDZ, int *NSKPZ,
              float *FL, float *FH, float *FP, int *IDYNA, int *SoCalQ,
              char  *INSRC,  char *INVEL, char *OUT, char *INSRC_I2,
-             char  *CHKFILE);
+             char  *CHKFILE, char *MASK, int *MASKTYPE, char *SINK, int *SINKMODE,
+             char  *IOHINTS, int *IOTUNE, int *CPU, int *CPUTILE, int *FDCOEF,
+             char  *DRMREC, char *DRMIN, char *DRMBOX, char *DRMORIGIN, int *DRMSKIP,
+             int   *MONITOR, int *MONACTION, float *MONGROW, char *HEARTBEAT,
+             float *ENDTOL, int *ENDWIN, int *ENDMODE,
+             float *SRCDT, int *SRCINTERP,
+             int *HALOFMT,
+             int *FRAMES, int *FRAMESKIP, float *FRAMEVMAX, int *FRAMEFMT, char *FRAMEOUT,
+             int *AUTO, float *FMAX, float *PPW, float *COURANT, float *REFL,
+             char *MEDIACACHE,
+             int *CPUBRICK,
+             int *CPUREC,
+             int *LOGLEVEL, char *LOGRANKS, char *LOGDIR);
 
 int read_src_ifault_2(int rank, int READ_STEP,
     char *INSRC, char *INSRC_I2,
@@ -71,10 +114,33 @@ void addsrc(int i,      float DH,   float DT,   int NST,    int npsrc,  int READ
             Grid1D axx, Grid1D ayy, Grid1D azz, Grid1D axz, Grid1D ayz, Grid1D axy,
             Grid3D xx,  Grid3D yy,  Grid3D zz,  Grid3D xy,  Grid3D yz,  Grid3D xz);
 
+int inisource_coarse(int      rank,    int     IFAULT, int     NSRC,   int     READ_STEP, int     nstc,    int     hstride,
+                     int     *SRCPROC, int     NZ,     MPI_Comm MCW,   int     nxt,       int     nyt,     int     nzt,
+                     int     *coords,  int     maxdim, int     *NPSRC, PosInf  *ptpsrc,
+                     Grid1D  *ptaxx,   Grid1D  *ptayy, Grid1D  *ptazz, Grid1D  *ptaxz,    Grid1D  *ptayz,  Grid1D *ptaxy,
+                     char    *INSRC,   char    *INSRC_I2);
+
+long srcweights(long n, float DT, float SRCDT, int SRCINTERP, float *c);
+
+void addsrci(int o,      float *c,   float DH,   float DT,   int npsrc,  int stride, int dim, PosInf psrc,
+             Grid1D axx, Grid1D ayy, Grid1D azz, Grid1D axz, Grid1D ayz, Grid1D axy,
+             Grid3D xx,  Grid3D yy,  Grid3D zz,  Grid3D xy,  Grid3D yz,  Grid3D xz);
+
+void mediakey(MediaHeader *h, char *INVEL, int rank, MPI_Comm MCW, int *coords, int NX, int NY, int NZ,
+              int PX, int PY, int NVAR, int NVE, int SoCalQ, float FL, float FH, float FP);
+int  mediasave(char *MEDIACACHE, MediaHeader *h, Grid3D d1, Grid3D mu, Grid3D lam, Grid3D qp, Grid3D qs);
+int  mediafind(char *MEDIACACHE, MediaHeader *key, int rank, MPI_Comm MCW);
+int  mediaload(char *MEDIACACHE, MediaHeader *h, Grid3D d1, Grid3D mu, Grid3D lam, Grid3D qp, Grid3D qs);
+
+int meshopen(int MEDIASTART, int nvar, int NVE, int nxt, int nyt, int nzt, int PX, int PY, int NX, int NY,
+             int NZ, int *coords, MPI_Comm MCW, char *INVEL, MPI_Info mediainfo);
+
+void meshabort();
+
 void inimesh(int MEDIASTART, Grid3D d1, Grid3D mu, Grid3D lam, Grid3D qp, Grid3D qs, float *taumax, float *taumin,
              int nvar, float FP,  float FL, float FH, int nxt, int nyt, int nzt, int PX, int PY, int NX, int NY,
              int NZ, int *coords, MPI_Comm MCW, int IDYNA, int NVE, int SoCalQ, char *INVEL,
-             float *vse, float *vpe, float *dde);
+             float *vse, float *vpe, float *dde, MPI_Info mediainfo);
 
 int writeCHK(char *chkfile, int ntiskp, float dt, float dh,
       int nxt, int nyt, int nzt,
@@ -82,6 +148,16 @@ int writeCHK(char *chkfile, int ntiskp, float dt, float dh,
       float fl, float fh, float fp,
       float *vse, float *vpe, float *dde);
 
+void recfiletype(int rec_NX, int rec_NY, int rec_NZ, int rec_nxt, int rec_nyt, int rec_nzt,
+                 int WRITE_STEP, MPI_Datatype *filetype);
+
+int writeout(char *filename, MPI_Comm MCO, MPI_Offset displacement, MPI_Datatype filetype,
+             MPI_Info info, float *buf, int count);
+
+int iohints(char *IOHINTS, int rank, MPI_Comm MCW, MPI_Info *mediainfo, MPI_Info *outinfo);
+
+void iotune(char *OUT, int IOTUNE, MPI_Comm MCO, MPI_Offset displacement, MPI_Datatype filetype, int count);
+
 void mediaswap(Grid3D d1, Grid3D mu,     Grid3D lam,    Grid3D qp,     Grid3D qs,
                int rank,  int x_rank_L,  int x_rank_R,  int y_rank_F,  int y_rank_B,
                int nxt,   int nyt,       int nzt,       MPI_Comm MCW);
@@ -89,6 +165,7 @@ void mediaswap(Grid3D d1, Grid3D mu,     Grid3D lam,    Grid3D qp,     Grid3D qs
 void tausub( Grid3D tau, float taumin,float taumax);
 
 void inicrj(float ARBC, int *coords, int nxt, int nyt, int nzt, int NX, int NY, int ND, Grid1D dcrjx, Grid1D dcrjy, Grid1D dcrjz);
+float crjrefl(float ARBC, int ND, float DH, float DT, float vp);
 
 void init_texture(int nxt,  int nyt,  int nzt,  Grid3D tau1,  Grid3D tau2,  Grid3D vx1,  Grid3D vx2,
                   int xls,  int xre,  int yls,  int yre);
@@ -104,6 +181,12 @@ void Cpy2Device_source(int npsrc, int READ_STEP,
       float *d_taxx, float *d_tayy, float *d_tazz,
       float *d_taxz, float *d_tayz, float *d_taxy);
 
+void Cpy2Device_srcwin(int npsrc, int win, int hstride, int base,
+      Grid1D taxx, Grid1D tayy, Grid1D tazz,
+      Grid1D taxz, Grid1D tayz, Grid1D taxy,
+      float *d_taxx, float *d_tayy, float *d_tazz,
+      float *d_taxz, float *d_tayz, float *d_taxy);
+
 void Cpy2Host_VX(float* u1, float* v1, float* w1, float* h_m, int nxt, int nyt, int nzt, cudaStream_t St, int rank, int flag);
 
 void Cpy2Host_VY(float* s_u1, float* s_v1, float* s_w1, float* h_m, int nxt, int nzt, cudaStream_t St, int rank);
@@ -121,7 +204,109 @@ void PostSendMsg_X(float* SL_M, float* SR_M, MPI_Comm MCW, MPI_Request* request,
 void PostSendMsg_Y(float* SF_M, float* SB_M, MPI_Comm MCW, MPI_Request* request, int* count, int msg_size,
                    int rank_F,  int rank_B,  int rank,     int flag);
 
+int inimask(char *MASK, int MASKTYPE, int rank, int *coord, int PX, MPI_Comm MCW,
+            int nxt, int nyt, int nzt, int rec_NX, int rec_NY,
+            int rec_nxt, int rec_nyt, int rec_nzt,
+            int rec_nbgx, int rec_nbgy, int rec_nbgz,
+            int NBGX, int NSKPX, int NBGY, int NSKPY, int NSKPZ,
+            int *nmask, PosInf *mask_pos, PosInf *mask_gidx, PosInf *mask_grid, int *NMASK);
+
+void maskfiletype(int nmask, PosInf mask_gidx, long NPTS, int WRITE_STEP, MPI_Datatype oldtype,
+                  MPI_Datatype *filetype);
+
+int writemaskindex(char *filename, MPI_Comm MCW, MPI_Info info, int nmask, PosInf mask_gidx, PosInf mask_grid, long NPTS);
+
+int sinkopen(char *SINK, SinkHeader *hello, PosInf mask_gidx);
+
+int sinkwrite(int fd, SinkHeader *hello, int var, long step, float *buf, long count);
+
+void sinkclose(int fd, SinkHeader *hello);
+
+void SetHostConstValue(float DH, float DT, int nxt, int nyt, int nzt, int FDCOEF);
+int  SetHostTiles(int CPUTILE);
+
+void BindHostArrays(Grid3D U1, Grid3D V1,  Grid3D W1,  Grid3D XX,  Grid3D YY,     Grid3D ZZ,    Grid3D XY,    Grid3D XZ,
+                    Grid3D YZ, Grid3D R1,  Grid3D R2,  Grid3D R3,  Grid3D R4,     Grid3D R5,    Grid3D R6,    Grid3D D1,
+                    Grid3D LAM, Grid3D MU, Grid3D QP,  Grid3D QS,  Grid3D VX1,    Grid3D VX2,   Grid3D LAM_MU,
+                    Grid1D DCRJX, Grid1D DCRJY, Grid1D DCRJZ);
+
+void dvelcx_C(int s_i, int e_i);
+
+void dvelcy_C(int s_j, int e_j, float *s_u1, float *s_v1, float *s_w1, int rank);
+
+void update_bound_y_C(float *F_m, float *B_m, int rank_F, int rank_B);
+
+void dstrqc_C(int s_i, int e_i, int s_j, int e_j, int NX, int rankx, int ranky);
+
+void fstep_C(int s_i, int e_i, int s_j, int e_j, int NX, int rankx, int ranky);
+
+void Cpy2Buf_VX_C(float *h_m, int rank, int flag);
+
+void Cpy2Grid_VX_C(float *L_m, float *R_m, int rank_L, int rank_R);
+
+int drminit(char *DRMREC, char *DRMIN, char *DRMBOX, char *DRMORIGIN, int DRMSKIP, int CPU,
+            int rank, int *coord, MPI_Comm MCW, int NX, int NY, int ND,
+            int nxt, int nyt, int nzt, float DH, float DT, int FDCOEF,
+            int xls, int xre, int yls, int yre,
+            Grid3D d1, Grid3D mu, Grid3D lam, Grid3D qp, Grid3D qs, Grid3D vx1, Grid3D lam_mu,
+            Grid1D dcrjx, Grid1D dcrjy, Grid1D dcrjz);
+
+void drmstep(long cur_step, float **fld);
+
+void drmclose(int rank);
+
+void drmgather_H(float *buf, int *pos, int n, float *f);
+
+void drmadd_H(float *f, int *pos, float *val, int n);
+
+void peakv_H(float *pgv, float *u1, float *v1, float *w1, int nxt, int nyt);
+
+float cfllimit(int FDCOEF);
+float cflcheck(int rank, float vpmax, float DH, float DT, int FDCOEF);
+
+int moninit(int MONITOR, int MONACTION, float MONGROW, char *HEARTBEAT, int CPU, int rank, MPI_Comm MCW,
+            int nxt, int nyt, int nzt, float DH, long nt, int NST);
+
+int monstep(long cur_step, float *u1, float *v1, float *w1, float *d1, double tcomp);
+
+void monclose(long cur_step, int stopped);
+
+int endinit(float ENDTOL, int ENDWIN, int ENDMODE, int *box);
+
+int endstep(long cur_step, float *u1, float *v1, float *w1, float *d1);
+
+void monitor_H(double *part, float *u1, float *v1, float *w1, float *d1, int i0, int i1, int j0, int j1, int k0, int k1);
+
+int haloinit(int HALOFMT, int rank);
+
+int halowords(int n);
+
+void haloenc(float *msg, float *enc, int n);
+
+void halodec(float *enc, float *msg, int n);
+
+void haloclose(int rank, MPI_Comm MCW);
+
+int frameinit(int FRAMESKIP, float FRAMEVMAX, int FRAMEFMT, char *FRAMEOUT, int CPU, int rank, int size, MPI_Comm MCW,
+              int *coord, int NX, int NY, int nxt, int nyt, int nzt);
+
+void framestep(long cur_step, float *u1, float *v1, float *w1);
+
+void frameclose();
+
+int loginit(int LOGLEVEL, char *LOGRANKS, char *LOGDIR, int rank, int size, MPI_Comm MCW);
+
+void logrank(int level, const char *fmt, ...);
+
+void logall(int level, const char *fmt, ...);
+
+void logclose();
+
 Grid3D Alloc3D(int nx, int ny, int nz);
+Grid3D Alloc3DB(int nx, int ny, int nz, int b);
+void   SetFieldLayout(int b, int nrec, int nx, int ny, int nz);
+Grid3D AllocField(void);
+long   gridcol(int i, int j);
 Grid1D Alloc1D(int nx);
 PosInf Alloc1P(int nx);
 
@@ -0,0 +1,105 @@
+/**
+@section LICENSE
+Copyright (c) 2013-2016, Regents of the University of California
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+ /*
+********************************************************************************
+* pmcl3d_api.h                                                                 *
+* simulation handle of libpmcl3d (sim.c)                                       *
+*                                                                              *
+*  MPI_Init(&argc, &argv);                                                     *
+*  sim = pmcl3d_create(argc, argv, MPI_COMM_WORLD);                            *
+*  pmcl3d_output_callback(sim, myoutput, mydata, 0);                           *
+*  pmcl3d_run(sim, 0);                                                         *
+*  pmcl3d_destroy(sim);                                                        *
+*  MPI_Finalize();                                                             *
+*                                                                              *
+* pmcl3d_create takes the command line options of pmcl3d. The buffers handed   *
+* to a callback belong to the simulation and are only valid during the call.   *
+* Callbacks are called on the ranks that own the data, never collectively.     *
+* comm may be any communicator of PX*PY ranks; the simulation never uses       *
+* MPI_COMM_WORLD, so several can run side by side, see jobpack.c.              *
+********************************************************************************
+*/
+
+#ifndef _PMCL3D_API_H
+#define _PMCL3D_API_H
+
+#include <mpi.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct pmcl3d_sim pmcl3d_sim;
+
+// one output batch of one rank, the SX/SY/SZ file contents before MPI-IO
+typedef struct {
+  long  step;                       // time step the batch is named after
+  int   nstep;                      // time steps per batch (WRITE_STEP)
+  long  count;                      // floats per component, nstep*points
+  const float *vx, *vy, *vz;        // step, z, y, x order of the local block
+  int   rec_NX, rec_NY, rec_NZ;     // global recording lattice
+  int   rec_nxt, rec_nyt, rec_nzt;  // local block of the lattice
+  int   x0, y0;                     // offset of the local block in the lattice
+  int   nmask;                      // masked points, 0 if unmasked
+  const int *gidx;                  // lattice index of each masked point
+} pmcl3d_output;
+
+// local map of the peak surface velocity, max over time of |(u,v,w)|
+typedef struct {
+  long  step;                       // last time step included
+  int   nx, ny;                     // local block, x fastest
+  int   x0, y0;                     // offset of the block in the NX x NY surface
+  int   NX, NY;
+  const float *pgv;
+} pmcl3d_peak;
+
+typedef void (*pmcl3d_output_fn)(const pmcl3d_output *out, void *user);
+typedef void (*pmcl3d_station_fn)(long step, int n, const int *id,
+                                  const float *vx, const float *vy, const float *vz, void *user);
+typedef void (*pmcl3d_peak_fn)(const pmcl3d_peak *peak, void *user);
+
+// collective over comm, NULL on failure
+pmcl3d_sim *pmcl3d_create(int argc, char **argv, MPI_Comm comm);
+
+// one time step, 0 when the run is complete or was stopped by the health monitor (--MONITOR)
+int  pmcl3d_step(pmcl3d_sim *sim);
+
+// nsteps time steps or to the end of the run if nsteps<=0, returns the steps taken
+long pmcl3d_run(pmcl3d_sim *sim, long nsteps);
+
+long pmcl3d_current_step(pmcl3d_sim *sim);
+// the last time step once --ENDTOL has ended the run
+long pmcl3d_total_steps(pmcl3d_sim *sim);
+
+// collective over comm, closes the output and frees the handle
+void pmcl3d_destroy(pmcl3d_sim *sim);
+
+// every output batch, files=0 skips the SX/SY/SZ files
+void pmcl3d_output_callback(pmcl3d_sim *sim, pmcl3d_output_fn fn, void *user, int files);
+
+// velocity at a grid point (1-based, z=1 is the surface) every time step, returns the station id;
+// stations are added on all ranks before the first step
+int  pmcl3d_add_station(pmcl3d_sim *sim, int x, int y, int z);
+void pmcl3d_station_callback(pmcl3d_sim *sim, pmcl3d_station_fn fn, void *user);
+
+// peak surface velocity, tracked every time step and handed over once after the last one,
+// also when --ENDTOL or --MONITOR ended the run, or at pmcl3d_destroy for a run left early
+void pmcl3d_peak_callback(pmcl3d_sim *sim, pmcl3d_peak_fn fn, void *user);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,422 @@
+/**
+@section LICENSE
+Copyright (c) 2013-2016, Regents of the University of California
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+********************************************************************************
+* postproc.c                                                                   *
+* post-processor for the SX/SY/SZ surface output of pmcl3d                     *
+*                                                                              *
+* mpirun -np N postproc [options] -- <pmcl3d options of the run>               *
+*                                                                              *
+* The pmcl3d options (TMAX, DT, NTISKP, WRITE_STEP, NBG/NED/NSKP, OUT, MASK)   *
+* describe the batch files, OUT/NSTEP the end of a run stopped early by       *
+* --ENDTOL or --MONITOR. Each rank owns a contiguous range of recording       *
+* points and streams the batches one at a time, so memory is bounded by one    *
+* batch plus the per-point accumulators.                                       *
+*                                                                              *
+* Name         Type          Description                                       *
+* ------------ ------------- ------------------------------------------------- *
+*  TS           <INTEGER>     write time series TSX/TSY/TSZ (1) or not (0)     *
+*  TILE         <INTEGER>     tile edge of the time series layout, 1 = station *
+*  FREQ         <STRING>      comma separated frequencies for Fourier maps     *
+*  PPOUT        <STRING>      output directory (default OUT)                   *
+*                                                                              *
+* Outputs in PPOUT:                                                            *
+*  TSX,TSY,TSZ  NT samples per point, points in tile order                     *
+*  PGV,PGA      peak horizontal velocity/acceleration, one float per point     *
+*  FAS          horizontal Fourier amplitude, NPTS floats per frequency        *
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include "pmcl3d.h"
+
+#define MAXFREQ 64
+
+// position of lattice point (x,y,z) in the tiled time series file
+static long tileslot(long x, long y, long z, int rec_NX, int rec_NY, int TILE)
+{
+  long tx, ty, w, h;
+
+  tx = x/TILE;
+  ty = y/TILE;
+  w  = (rec_NX-tx*TILE < TILE ? rec_NX-tx*TILE : TILE);
+  h  = (rec_NY-ty*TILE < TILE ? rec_NY-ty*TILE : TILE);
+  return z*rec_NX*rec_NY + ty*TILE*rec_NX + tx*TILE*h + (y-ty*TILE)*w + (x-tx*TILE);
+}
+
+// file views need ascending displacements: local points are written in slot order
+typedef struct { long slot; int i; } TSSlot;
+
+static int cmpslot(const void *a, const void *b)
+{
+  long sa = ((const TSSlot *)a)->slot, sb = ((const TSSlot *)b)->slot;
+  return (sa > sb) - (sa < sb);
+}
+
+static int readbatch(char *filename, MPI_Comm MCW, MPI_Offset displacement, MPI_Datatype filetype,
+                     float *buf, int count)
+{
+  int err;
+  MPI_File   fh;
+  MPI_Status filestatus;
+
+  err = MPI_File_open(MCW,filename,MPI_MODE_RDONLY,MPI_INFO_NULL,&fh);
+  if(err!=MPI_SUCCESS)
+  {
+     printf("can't open output file %s\n", filename);
+     return -1;
+  }
+  err = MPI_File_set_view(fh, displacement, MPI_FLOAT, filetype, "native", MPI_INFO_NULL);
+  err = MPI_File_read_all(fh, buf, count, MPI_FLOAT, &filestatus);
+  err = MPI_File_close(&fh);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+    float TMAX, DH, DT, ARBC, PHT;
+    int   NPC, ND, NSRC, NST;
+    int   NVE, NVAR, MEDIASTART, IFAULT, READ_STEP, READ_STEP_GPU;
+    int   NX, NY, NZ, PX, PY, IDYNA, SoCalQ;
+    int   NBGX, NEDX, NSKPX, NBGY, NEDY, NSKPY, NBGZ, NEDZ, NSKPZ;
+    int   NTISKP, WRITE_STEP, MASKTYPE, SINKMODE, IOTUNE, CPU, CPUTILE, FDCOEF, DRMSKIP;
+    float FL, FH, FP;
+    char  INSRC[50], INVEL[50], OUT[50], INSRC_I2[50], CHKFILE[50], MASK[50], SINK[50], IOHINTS[50];
+    char  DRMREC[50], DRMIN[50], DRMBOX[50], DRMORIGIN[50];
+    int   MONITOR, MONACTION;
+    float MONGROW;
+    char  HEARTBEAT[50];
+    float ENDTOL;
+    int   ENDWIN, ENDMODE;
+    float SRCDT;
+    int   SRCINTERP;
+    int   HALOFMT;
+    int   FRAMES, FRAMESKIP, FRAMEFMT;
+    float FRAMEVMAX;
+    char  FRAMEOUT[50];
+    int   AUTO;
+    float FMAX, PPW, COURANT, REFL;
+    char  MEDIACACHE[50];
+    int   CPUBRICK;
+    int   CPUREC;
+    int   LOGLEVEL;
+    char  LOGRANKS[50], LOGDIR[50];
+    int   TS = 1, TILE = 1, nfreq = 0;
+    float freq[MAXFREQ];
+    char  PPOUT[50] = "";
+    char  filename[60], *tok;
+    int   rank, size, err, sep, c, i, t, f, b, comp, nshort, ws;
+    int   rec_NX, rec_NY, rec_NZ, rowlen, nrows, r0, nr, npl;
+    long  p, p0, NPTS, nt, NB, NT, n, last_step;
+    float dts, vh, ah, ax, ay, arg;
+    MPI_Comm     MCW;
+    MPI_Offset   displacement, fsize;
+    MPI_Datatype filetype, tstype[2];
+    MPI_File     fh, tsfh[3];
+    MPI_Status   filestatus;
+    MPI_Aint     *tsdisp;
+    TSSlot       *tsord = NULL;
+    FILE   *fp;
+    Grid1D buf[3], tsbuf, last[3], pgv, pga, fre[2], fim[2], fas;
+    float *cs, *sn;
+    static const char *names = "XYZ";
+    static struct option long_options[] = {
+        {"TS", required_argument, NULL, 1},
+        {"TILE", required_argument, NULL, 2},
+        {"FREQ", required_argument, NULL, 3},
+        {"PPOUT", required_argument, NULL, 4},
+        {0, 0, 0, 0}
+    };
+
+    MPI_Init(&argc,&argv);
+    MPI_Comm_dup(MPI_COMM_WORLD, &MCW);
+    MPI_Comm_rank(MCW,&rank);
+    MPI_Comm_size(MCW,&size);
+
+    // postproc options up to "--", the run's pmcl3d options after it
+    for(sep=1;sep<argc;sep++)
+      if(strcmp(argv[sep],"--")==0) break;
+    while((c=getopt_long(sep, argv, "", long_options, NULL)) != -1)
+    {
+        switch (c) {
+            case 1:
+                TS          = atoi(optarg); break;
+            case 2:
+                TILE        = atoi(optarg); break;
+            case 3:
+                for(tok=strtok(optarg,",");tok!=NULL && nfreq<MAXFREQ;tok=strtok(NULL,","))
+                  freq[nfreq++] = atof(tok);
+                break;
+            case 4:
+                strcpy(PPOUT, optarg); break;
+            default:
+                if(rank==0) printf("Usage: %s [--TS <0|1>] [--TILE <tile edge>] [--FREQ <f1,f2,...>] [--PPOUT <dir>] -- <pmcl3d options>\n", argv[0]);
+                MPI_Abort(MCW, -1);
+        }
+    }
+    if(sep<argc) argv[sep] = argv[0];
+    optind = 0;   // full getopt reset, command() parses with its own optstring
+    if(command(argc-sep,argv+sep,&TMAX,&DH,&DT,&ARBC,&PHT,&NPC,&ND,&NSRC,&NST,
+      &NVAR,&NVE,&MEDIASTART,&IFAULT,&READ_STEP,&READ_STEP_GPU,
+      &NTISKP,&WRITE_STEP,&NX,&NY,&NZ,&PX,&PY,
+      &NBGX,&NEDX,&NSKPX,&NBGY,&NEDY,&NSKPY,&NBGZ,&NEDZ,&NSKPZ,
+      &FL,&FH,&FP,&IDYNA,&SoCalQ,INSRC,INVEL,OUT,INSRC_I2,CHKFILE,
+      MASK,&MASKTYPE,SINK,&SINKMODE,IOHINTS,&IOTUNE,&CPU,&CPUTILE,&FDCOEF,
+      DRMREC,DRMIN,DRMBOX,DRMORIGIN,&DRMSKIP,
+      &MONITOR,&MONACTION,&MONGROW,HEARTBEAT,
+      &ENDTOL,&ENDWIN,&ENDMODE,
+      &SRCDT,&SRCINTERP,
+      &HALOFMT,
+      &FRAMES,&FRAMESKIP,&FRAMEVMAX,&FRAMEFMT,FRAMEOUT,
+      &AUTO,&FMAX,&PPW,&COURANT,&REFL,
+      MEDIACACHE,
+      &CPUBRICK,
+      &CPUREC,
+      &LOGLEVEL,LOGRANKS,LOGDIR))
+      MPI_Abort(MCW, -1);
+    if(!PPOUT[0]) strcpy(PPOUT, OUT);
+
+    // same lattice as pmcl3d
+    if(NEDX==-1) NEDX = NX;
+    if(NEDY==-1) NEDY = NY;
+    if(NEDZ==-1) NEDZ = NZ;
+    NEDX = NEDX-(NEDX-NBGX)%NSKPX;
+    NEDY = NEDY-(NEDY-NBGY)%NSKPY;
+    NEDZ = NEDZ-(NEDZ-NBGZ)%NSKPZ;
+    rec_NX = (NEDX-NBGX)/NSKPX+1;
+    rec_NY = (NEDY-NBGY)/NSKPY+1;
+    rec_NZ = (NEDZ-NBGZ)/NSKPZ+1;
+    rowlen = rec_NX;
+    nrows  = rec_NY*rec_NZ;
+    NPTS   = (long)rec_NX*rec_NY*rec_NZ;
+    if(MASK[0])
+    {
+      // compacted output: NPTS from the index file, points stay in file order
+      sprintf(filename, "%s/SIDX", OUT);
+      err = MPI_File_open(MCW,filename,MPI_MODE_RDONLY,MPI_INFO_NULL,&fh);
+      if(err!=MPI_SUCCESS)
+      {
+         if(rank==0) printf("can't open mask index file %s\n", filename);
+         MPI_Abort(MCW, -1);
+      }
+      MPI_File_get_size(fh, &fsize);
+      MPI_File_close(&fh);
+      NPTS   = fsize/(3*sizeof(int));
+      rowlen = 1;
+      nrows  = NPTS;
+      TILE   = 1;
+    }
+    // OUT/NSTEP: last time step and the steps of its short batch, TMAX for older runs
+    nt     = (int)(TMAX/DT) + 1;
+    nshort = 0;
+    if(rank==0)
+    {
+      sprintf(filename, "%s/NSTEP", OUT);
+      fp = fopen(filename, "r");
+      if(fp)
+      {
+        if(fscanf(fp, "%ld %d", &last_step, &nshort)!=2 || last_step<1 || nshort<0 || nshort>=WRITE_STEP)
+        {
+          printf("bad end step record %s\n", filename);
+          MPI_Abort(MCW, -1);
+        }
+        fclose(fp);
+        nt = last_step;
+      }
+    }
+    MPI_Bcast(&nt, 1, MPI_LONG, 0, MCW);
+    MPI_Bcast(&nshort, 1, MPI_INT, 0, MCW);
+    NB  = nt/((long)NTISKP*WRITE_STEP) + (nshort>0);
+    NT  = (NB-(nshort>0))*WRITE_STEP + nshort;
+    dts = NTISKP*DT;
+
+    // contiguous rows of the lattice per rank
+    r0  = (int)(((long)nrows*rank)/size);
+    nr  = (int)(((long)nrows*(rank+1))/size) - r0;
+    npl = nr*rowlen;
+    p0  = (long)r0*rowlen;
+    displacement = sizeof(float)*p0;
+    recfiletype(rowlen, nrows, 1, rowlen, nr, 1, WRITE_STEP, &filetype);
+    if(rank==0) printf("postproc: %ld points, %ld batches of %d samples, last %d, dt=%f, %d frequencies\n",
+                       NPTS, NB, WRITE_STEP, (nshort>0 ? nshort : WRITE_STEP), dts, nfreq);
+
+    for(comp=0;comp<3;comp++)
+    {
+      buf[comp]  = Alloc1D(npl*WRITE_STEP);
+      last[comp] = Alloc1D(npl);
+    }
+    tsbuf = Alloc1D(npl*WRITE_STEP);
+    pgv   = Alloc1D(npl);
+    pga   = Alloc1D(npl);
+    for(comp=0;comp<2;comp++)
+    {
+      fre[comp] = Alloc1D(npl*nfreq);
+      fim[comp] = Alloc1D(npl*nfreq);
+    }
+    cs = (float *)malloc(sizeof(float)*(nfreq*WRITE_STEP+1));
+    sn = (float *)malloc(sizeof(float)*(nfreq*WRITE_STEP+1));
+
+    // time series: WRITE_STEP samples per point and batch, at slot*NT+batch*WRITE_STEP
+    if(TS)
+    {
+      tsdisp = (MPI_Aint *)malloc(sizeof(MPI_Aint)*(npl>0 ? npl : 1));
+      tsord  = (TSSlot *)malloc(sizeof(TSSlot)*(npl>0 ? npl : 1));
+      for(i=0;i<npl;i++)
+      {
+        p = p0+i;
+        if(TILE>1) p = tileslot(p%rec_NX, (p/rec_NX)%rec_NY, p/((long)rec_NX*rec_NY), rec_NX, rec_NY, TILE);
+        tsord[i].slot = p;
+        tsord[i].i    = i;
+      }
+      qsort(tsord, npl, sizeof(TSSlot), cmpslot);
+      for(i=0;i<npl;i++)
+      {
+        tsdisp[i] = sizeof(float);
+        tsdisp[i] = tsdisp[i]*tsord[i].slot*NT;
+      }
+      // full batches and the short last one
+      MPI_Type_create_hindexed_block(npl, WRITE_STEP, tsdisp, MPI_FLOAT, &tstype[0]);
+      MPI_Type_commit(&tstype[0]);
+      MPI_Type_create_hindexed_block(npl, (nshort>0 ? nshort : 1), tsdisp, MPI_FLOAT, &tstype[1]);
+      MPI_Type_commit(&tstype[1]);
+      free(tsdisp);
+      for(comp=0;comp<3;comp++)
+      {
+        sprintf(filename, "%s/TS%c", PPOUT, names[comp]);
+        err = MPI_File_open(MCW,filename,MPI_MODE_CREATE|MPI_MODE_WRONLY,MPI_INFO_NULL,&tsfh[comp]);
+        if(err!=MPI_SUCCESS)
+        {
+           if(rank==0) printf("can't open time series file %s\n", filename);
+           MPI_Abort(MCW, -1);
+        }
+      }
+    }
+
+    for(b=0;b<NB;b++)
+    {
+      // the short last batch is named after the last time step
+      ws = (b==NB-1 && nshort>0 ? nshort : WRITE_STEP);
+      for(comp=0;comp<3;comp++)
+      {
+        if(ws<WRITE_STEP)
+          sprintf(filename, "%s/S%c%07ld", OUT, names[comp], nt);
+        else
+          sprintf(filename, "%s/S%c%07ld", OUT, names[comp], (long)(b+1)*NTISKP*WRITE_STEP);
+        if(readbatch(filename, MCW, displacement, filetype, buf[comp], npl*ws))
+          MPI_Abort(MCW, -1);
+      }
+
+      // peak motion, acceleration by backward difference across batches
+      for(t=0;t<ws;t++)
+        for(i=0;i<npl;i++)
+        {
+          vh = hypot(buf[0][t*npl+i], buf[1][t*npl+i]);
+          ax = (buf[0][t*npl+i] - last[0][i])/dts;
+          ay = (buf[1][t*npl+i] - last[1][i])/dts;
+          ah = hypot(ax, ay);
+          if(vh > pgv[i]) pgv[i] = vh;
+          if(ah > pga[i]) pga[i] = ah;
+          last[0][i] = buf[0][t*npl+i];
+          last[1][i] = buf[1][t*npl+i];
+        }
+
+      // running DFT of the horizontal components
+      for(f=0;f<nfreq;f++)
+        for(t=0;t<ws;t++)
+        {
+          n   = (long)b*WRITE_STEP + t + 1;
+          arg = 2.0*M_PI*freq[f]*fmod(n*dts, 1.0/freq[f]);
+          cs[f*WRITE_STEP+t] = cos(arg)*dts;
+          sn[f*WRITE_STEP+t] = sin(arg)*dts;
+        }
+      for(comp=0;comp<2;comp++)
+        for(f=0;f<nfreq;f++)
+          for(t=0;t<ws;t++)
+            for(i=0;i<npl;i++)
+            {
+              fre[comp][f*npl+i] += buf[comp][t*npl+i]*cs[f*WRITE_STEP+t];
+              fim[comp][f*npl+i] -= buf[comp][t*npl+i]*sn[f*WRITE_STEP+t];
+            }
+
+      if(TS)
+        for(comp=0;comp<3;comp++)
+        {
+          for(t=0;t<ws;t++)
+            for(i=0;i<npl;i++)
+              tsbuf[i*ws+t] = buf[comp][t*npl+tsord[i].i];
+          err = MPI_File_set_view(tsfh[comp], sizeof(float)*(MPI_Offset)b*WRITE_STEP, MPI_FLOAT, tstype[ws<WRITE_STEP],
+                                  "native", MPI_INFO_NULL);
+          err = MPI_File_write_all(tsfh[comp], tsbuf, npl*ws, MPI_FLOAT, &filestatus);
+        }
+      if(rank==0 && (b+1)%10==0) printf("postproc: batch %d of %ld\n", b+1, NB);
+    }
+
+    if(TS)
+    {
+      for(comp=0;comp<3;comp++)
+        MPI_File_close(&tsfh[comp]);
+      MPI_Type_free(&tstype[0]);
+      MPI_Type_free(&tstype[1]);
+      free(tsord);
+    }
+
+    // maps in lattice (or mask file) order
+    sprintf(filename, "%s/PGV", PPOUT);
+    err = MPI_File_open(MCW,filename,MPI_MODE_CREATE|MPI_MODE_WRONLY,MPI_INFO_NULL,&fh);
+    err = MPI_File_write_at_all(fh, displacement, pgv, npl, MPI_FLOAT, &filestatus);
+    err = MPI_File_close(&fh);
+    sprintf(filename, "%s/PGA", PPOUT);
+    err = MPI_File_open(MCW,filename,MPI_MODE_CREATE|MPI_MODE_WRONLY,MPI_INFO_NULL,&fh);
+    err = MPI_File_write_at_all(fh, displacement, pga, npl, MPI_FLOAT, &filestatus);
+    err = MPI_File_close(&fh);
+    if(nfreq>0)
+    {
+      fas = Alloc1D(npl*nfreq);
+      for(i=0;i<npl*nfreq;i++)
+        fas[i] = hypot(hypot(fre[0][i], fim[0][i]), hypot(fre[1][i], fim[1][i]));
+      sprintf(filename, "%s/FAS", PPOUT);
+      err = MPI_File_open(MCW,filename,MPI_MODE_CREATE|MPI_MODE_WRONLY,MPI_INFO_NULL,&fh);
+      for(f=0;f<nfreq;f++)
+        err = MPI_File_write_at_all(fh, displacement + sizeof(float)*(MPI_Offset)f*NPTS, fas+f*npl, npl,
+                                    MPI_FLOAT, &filestatus);
+      err = MPI_File_close(&fh);
+      Delloc1D(fas);
+    }
+    if(rank==0) printf("postproc: done, outputs in %s\n", PPOUT);
+
+    for(comp=0;comp<3;comp++)
+    {
+      Delloc1D(buf[comp]);
+      Delloc1D(last[comp]);
+    }
+    for(comp=0;comp<2;comp++)
+    {
+      Delloc1D(fre[comp]);
+      Delloc1D(fim[comp]);
+    }
+    Delloc1D(tsbuf);
+    Delloc1D(pgv);
+    Delloc1D(pga);
+    free(cs);
+    free(sn);
+    MPI_Type_free(&filetype);
+    MPI_Comm_free(&MCW);
+    MPI_Finalize();
+    return (0);
+}
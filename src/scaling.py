@@ -0,0 +1,179 @@
+#!/usr/bin/env python
+##
+# @section LICENSE
+# Copyright (c) 2013-2016, Regents of the University of California
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification, are pe
+# rmitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice, this list of
+# conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice, this list
+# of conditions and the following disclaimer in the documentation and/or other materials pr
+# ovided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXP
+# RESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERC
+# HANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE CO
+# PYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, E
+# XEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTIT
+# UTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER C
+# AUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INC
+# LUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+# IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+##
+
+##
+# Weak and strong scaling study of pmcl3d under a local mpirun.
+#
+# Runs a canonical problem (homogeneous medium, one point source in the
+# middle of the grid, surface output) for a sweep of PX x PY decompositions
+# and reads the per-phase timers pmcl3d prints at the end of a run:
+#
+#   Phase time max: compute=... halo=... io=... other=... secs per timestep
+#
+# Weak scaling keeps nxt/nyt/nzt per rank fixed, strong scaling keeps
+# NX/NY/NZ fixed. Efficiencies are relative to the first decomposition of
+# the sweep, per phase and in total, using the slowest rank of each phase:
+#
+#   weak:    E = t_ref / t
+#   strong:  E = t_ref * n_ref / (t * n)
+#
+# A phase below 1% of the reference timestep (halo on one rank) has no
+# efficiency; its seconds per timestep are still reported.
+#
+# usage: python scaling.py --exe ./pmcl3d --mode both --decomp 1x1,2x1,2x2
+##
+
+import argparse
+import json
+import math
+import os
+import re
+import subprocess
+import sys
+
+PHASES = ['compute', 'halo', 'io', 'other']
+LINE   = re.compile(r'Phase time max: compute=(\S+) halo=(\S+) io=(\S+) other=(\S+)')
+
+# writes the canonical point source, IFAULT 0 text format
+def source(path, x, y, z, nst, dt):
+    t0 = 20*dt
+    w  = 4*dt
+    with open(path, 'w') as f:
+        f.write('%d %d %d\n' % (x, y, z))
+        for n in range(nst):
+            m = 1.0e15*math.exp(-((n*dt-t0)/w)**2)
+            f.write('%e %e %e %e %e %e\n' % (m, m, m, 0.3*m, 0.2*m, 0.1*m))
+
+def decomps(arg):
+    d = []
+    for s in arg.split(','):
+        px, py = s.lower().split('x')
+        d.append((int(px), int(py)))
+    return d
+
+def run(a, mode, px, py, nx, ny, nz):
+    name = '%s_%dx%d' % (mode, px, py)
+    wd   = os.path.join(a.workdir, name)
+    for sub in ('out', 'ckp'):
+        if not os.path.isdir(os.path.join(wd, sub)):
+            os.makedirs(os.path.join(wd, sub))
+    source(os.path.join(wd, 'src.txt'), nx//2, ny//2, nz//2, a.steps, a.dt)
+    cmd = a.mpirun.split() + ['-np', str(px*py), os.path.abspath(a.exe),
+           '-X', str(nx), '-Y', str(ny), '-Z', str(nz), '-x', str(px), '-y', str(py),
+           '-H', str(a.dh), '-t', str(a.dt), '-T', str(a.steps*a.dt-0.5*a.dt),
+           '-B', '0', '-I', '0', '-S', '1', '-N', str(a.steps), '-R', str(a.steps),
+           '-V', '1', '-D', str(a.nd), '-r', str(a.ntiskp), '-W', str(a.write_step),
+           '--INSRC', 'src.txt', '-o', 'out', '-c', 'ckp/CHKP'] + a.args.split()
+    with open(os.path.join(wd, 'log.txt'), 'w') as log:
+        ret = subprocess.call(cmd, cwd=wd, stdout=log, stderr=subprocess.STDOUT)
+    t = None
+    with open(os.path.join(wd, 'log.txt')) as log:
+        for l in log:
+            m = LINE.search(l)
+            if m:
+                t = dict(zip(PHASES, [float(v) for v in m.groups()]))
+    if ret!=0 or t is None:
+        sys.stderr.write('run %s failed, see %s\n' % (name, os.path.join(wd, 'log.txt')))
+        return None
+    t['total'] = sum(t[p] for p in PHASES)
+    return {'px': px, 'py': py, 'ranks': px*py, 'NX': nx, 'NY': ny, 'NZ': nz, 'time': t}
+
+def efficiency(mode, runs):
+    ref = runs[0]
+    for r in runs:
+        r['efficiency'] = {}
+        for p in PHASES+['total']:
+            t0, t = ref['time'][p], r['time'][p]
+            if t0<0.01*ref['time']['total'] or t<=0.0:
+                e = None
+            elif mode=='weak':
+                e = t0/t
+            else:
+                e = t0*ref['ranks']/(t*r['ranks'])
+            r['efficiency'][p] = e
+
+def table(mode, runs):
+    print('%s scaling' % mode)
+    print('%-7s %5s %-15s %10s %10s %10s %10s %10s  %6s %6s %6s %6s' % ('PXxPY', 'ranks', 'NXxNYxNZ',
+          'compute', 'halo', 'io', 'other', 'total', 'E_comp', 'E_halo', 'E_io', 'E'))
+    for r in runs:
+        e = ['%6.3f' % r['efficiency'][p] if r['efficiency'][p] is not None else '%6s' % '-'
+             for p in ('compute', 'halo', 'io', 'total')]
+        print('%-7s %5d %-15s %10.3e %10.3e %10.3e %10.3e %10.3e  %s' % ('%dx%d' % (r['px'], r['py']), r['ranks'],
+              '%dx%dx%d' % (r['NX'], r['NY'], r['NZ']), r['time']['compute'], r['time']['halo'],
+              r['time']['io'], r['time']['other'], r['time']['total'], ' '.join(e)))
+    print('')
+
+def main():
+    p = argparse.ArgumentParser(description='weak/strong scaling study of pmcl3d')
+    p.add_argument('--exe',        default='./pmcl3d', help='pmcl3d executable')
+    p.add_argument('--mpirun',     default='mpirun',   help='MPI launcher, -np is appended')
+    p.add_argument('--mode',       default='both',     choices=['weak', 'strong', 'both'])
+    p.add_argument('--decomp',     default='1x1,2x1,2x2,4x2', help='PXxPY list, the first is the reference')
+    p.add_argument('--nxt',        type=int, default=64,  help='weak scaling subdomain size in x')
+    p.add_argument('--nyt',        type=int, default=64,  help='weak scaling subdomain size in y')
+    p.add_argument('--nzt',        type=int, default=64,  help='weak scaling subdomain size in z')
+    p.add_argument('--NX',         type=int, default=128, help='strong scaling grid size in x')
+    p.add_argument('--NY',         type=int, default=128, help='strong scaling grid size in y')
+    p.add_argument('--NZ',         type=int, default=64,  help='strong scaling grid size in z')
+    p.add_argument('--steps',      type=int,   default=100)
+    p.add_argument('--dh',         type=float, default=100.0)
+    p.add_argument('--dt',         type=float, default=0.005)
+    p.add_argument('--nd',         type=int,   default=10, help='sponge width')
+    p.add_argument('--ntiskp',     type=int,   default=10, help='output every ntiskp steps')
+    p.add_argument('--write_step', type=int,   default=5,  help='output steps per write')
+    p.add_argument('--args',       default='', help='extra pmcl3d options, e.g. "--CPU 1"')
+    p.add_argument('--workdir',    default='scaling')
+    p.add_argument('--json',       default='scaling.json')
+    a = p.parse_args()
+
+    result = {'decomp': a.decomp, 'steps': a.steps, 'args': a.args}
+    for mode in ('weak', 'strong'):
+        if a.mode not in (mode, 'both'):
+            continue
+        runs = []
+        for px, py in decomps(a.decomp):
+            if mode=='weak':
+                nx, ny, nz = a.nxt*px, a.nyt*py, a.nzt
+            else:
+                nx, ny, nz = a.NX, a.NY, a.NZ
+                if nx%px or ny%py:
+                    sys.stderr.write('%dx%d does not divide %dx%d, skipped\n' % (px, py, nx, ny))
+                    continue
+            r = run(a, mode, px, py, nx, ny, nz)
+            if r:
+                runs.append(r)
+        if runs:
+            efficiency(mode, runs)
+            table(mode, runs)
+        result[mode] = runs
+    with open(a.json, 'w') as f:
+        json.dump(result, f, indent=2)
+    print('wrote %s' % a.json)
+
+if __name__ == '__main__':
+    main()
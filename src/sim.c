@@ -0,0 +1,1867 @@
+/**
+@section LICENSE
+Copyright (c) 2013-2016, Regents of the University of California
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+********************************************************************************
+* sim.c                                                                        *
+* setup, time step and teardown of a simulation behind a pmcl3d_sim handle     *
+*                                                                              *
+* pmcl3d.c is a driver around pmcl3d_create/pmcl3d_run/pmcl3d_destroy. All     *
+* state of the former main() lives in struct pmcl3d_sim; the public calls      *
+* are declared in pmcl3d_api.h.                                                *
+********************************************************************************
+*/
+
+#include <sys/time.h>
+#include <time.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "pmcl3d.h"
+#include "pmcl3d_api.h"
+
+const double   micro = 1.0e-6;
+static const int maxdim = 3;
+
+void SetDeviceConstValue(float DH, float DT, int nxt, int nyt, int nzt, int FDCOEF);
+void BindArrayToTexture(float* vx1, float* vx2, int memsize);
+void UnBindArrayFromTexture();
+void dvelcx_H(float* u1,    float* v1,    float* w1,    float* xx,  float* yy, float* zz, float* xy,       float* xz, float* yz,
+              float* dcrjx, float* dcrjy, float* dcrjz, float* d_1, int nyt,   int nzt,   cudaStream_t St, int s_i,   int e_i);
+void dvelcy_H(float* u1,       float* v1,    float* w1,    float* xx,  float* yy, float* zz, float* xy,   float* xz,   float* yz,
+              float* dcrjx,    float* dcrjy, float* dcrjz, float* d_1, int nxt,   int nzt,   float* s_u1, float* s_v1, float* s_w1,
+              cudaStream_t St, int s_j,      int e_j,      int rank);
+void dstrqc_H(float* xx,       float* yy,     float* zz,    float* xy,    float* xz, float* yz,
+              float* r1,       float* r2,     float* r3,    float* r4,    float* r5, float* r6,
+              float* u1,       float* v1,     float* w1,    float* lam,   float* mu, float* qp,
+              float* qs,       float* dcrjx,  float* dcrjy, float* dcrjz, int nyt,   int nzt,
+              cudaStream_t St, float* lam_mu, int NX,       int rankx,    int ranky, int s_i,
+              int e_i,         int s_j,       int e_j);
+void addsrc_H(int i,      int READ_STEP, int dim,    int* psrc,  int npsrc,  cudaStream_t St,
+              float* axx, float* ayy,    float* azz, float* axz, float* ayz, float* axy,
+              float* xx,  float* yy,     float* zz,  float* xy,  float* yz,  float* xz);
+void addsrci_H(int o,      float* c,      int stride, int dim,    int* psrc,  int npsrc,  cudaStream_t St,
+               float* axx, float* ayy,    float* azz, float* axz, float* ayz, float* axy,
+               float* xx,  float* yy,     float* zz,  float* xy,  float* yz,  float* xz);
+
+void calcRecordingPoints(int *rec_nbgx, int *rec_nedx,
+  int *rec_nbgy, int *rec_nedy, int *rec_nbgz, int *rec_nedz,
+  int *rec_nxt, int *rec_nyt, int *rec_nzt, MPI_Offset *displacement,
+  long int nxt, long int nyt, long int nzt, int rec_NX, int rec_NY, int rec_NZ,
+  int NBGX, int NEDX, int NSKPX, int NBGY, int NEDY, int NSKPY,
+  int NBGZ, int NEDZ, int NSKPZ, int *coord);
+
+double gethrtime()
+{
+    struct timeval TV;
+    int RC = gettimeofday(&TV,NULL);
+
+    if (RC == -1){
+       printf("Bad call to gettimeofday\n");
+       return(-1);
+    }
+
+    return ( ((double)TV.tv_sec ) + micro * ((double)  TV.tv_usec));
+}
+
+// per-phase step and startup timers, LAP charges the time since t to a[p]
+enum { PH_COMP, PH_HALO, PH_IO };
+enum { ST_SOURCE, ST_MEDIA, ST_FIELDS, ST_SETUP, ST_TOTAL };
+#define LAP(a,p,t)   { double t1_ = gethrtime(); (a)[p] += t1_-(t); (t) = t1_; }
+#define PHASE(s,p,t) LAP((s)->tphase, p, t)
+struct pmcl3d_sim {
+//  input parameters
+    float TMAX, DH, DT, ARBC, PHT;
+    int   NPC, ND, NSRC, NST;
+    int   NVE, NVAR, MEDIASTART, IFAULT, READ_STEP, READ_STEP_GPU;
+    int   NX, NY, NZ, PX, PY, IDYNA, SoCalQ;
+    int   NBGX, NEDX, NSKPX, NBGY, NEDY, NSKPY, NBGZ, NEDZ, NSKPZ;
+    int   nxt, nyt, nzt;
+    MPI_Offset displacement;
+    float FL, FH, FP;
+    char  INSRC[50], INVEL[50], OUT[50], INSRC_I2[50], CHKFILE[50];
+    char  MASK[50], SINK[50], IOHINTS[50];
+    int   MASKTYPE, SINKMODE, IOTUNE, CPU, CPUTILE, FDCOEF;
+    char  DRMREC[50], DRMIN[50], DRMBOX[50], DRMORIGIN[50];
+    int   DRMSKIP;
+    int   MONITOR, MONACTION;
+    float MONGROW;
+    char  HEARTBEAT[50];
+    float ENDTOL;
+    int   ENDWIN, ENDMODE;
+    float SRCDT;
+    int   SRCINTERP;
+    int   nstc, srcgw, srchs, srcwin;   // coarse source: samples, device window, host stride, window on the device
+    int   HALOFMT;
+    int   FRAMES, FRAMESKIP, FRAMEFMT;
+    float FRAMEVMAX;
+    char  FRAMEOUT[50];
+    int   AUTO;
+    float FMAX, PPW, COURANT, REFL;
+    char  MEDIACACHE[50];
+    int   CPUBRICK;
+    int   CPUREC;
+    int   LOGLEVEL;
+    char  LOGRANKS[50], LOGDIR[50];
+    float *drmfld[15];
+    float *monfld[4];
+    int   endevery;                 // time steps between samples of the ENDTOL criterion
+    MPI_Info mediainfo, outinfo;
+    int   sinkfd;
+    SinkHeader sinkhello;
+//  host arrays
+    Grid3D u1, v1, w1;
+    Grid3D d1, mu, lam;
+    Grid3D xx, yy, zz, xy, yz, xz;
+    Grid3D r1, r2, r3, r4, r5, r6;
+    Grid3D qp, qs;
+    PosInf tpsrc;
+    PosInf mask_pos, mask_gidx, mask_grid;
+    Grid1D taxx, tayy, tazz, taxz, tayz, taxy;
+    Grid1D Bufx, Bufy, Bufz;
+    Grid3D vx1, vx2, lam_mu;
+    Grid1D dcrjx, dcrjy, dcrjz;
+    FILE  *fchk;
+//  GPU arrays
+    float *d_d1;
+    float *d_u1, *d_v1, *d_w1;
+    float *d_f_u1, *d_f_v1, *d_f_w1;
+    float *d_b_u1, *d_b_v1, *d_b_w1;
+    float *d_dcrjx, *d_dcrjy, *d_dcrjz;
+    float *d_lam, *d_mu, *d_qp, *d_qs;
+    float *d_vx1, *d_vx2;
+    float *d_xx, *d_yy, *d_zz, *d_xy, *d_xz, *d_yz;
+    float *d_r1, *d_r2, *d_r3, *d_r4, *d_r5, *d_r6;
+    float *d_lam_mu;
+    int   *d_tpsrc;
+    float *d_taxx, *d_tayy, *d_tazz, *d_taxz, *d_tayz, *d_taxy;
+//  time stepping
+    int   npsrc;
+    long int nt, cur_step;
+    long int source_step;           // 1-based index in the device source window, addsrc_cu reads source_step-1
+    double time_un;
+    double tphase[3];               // compute, halo and I/O seconds, the rest of a step is other
+    double tstartup[5];             // pmcl3d_create seconds by ST_ phase
+    int   ready;                    // 0 after an output hints benchmark, nothing to run
+    int   stopped;                  // 1 after the health monitor ended the run
+    int   ended;                    // 1 after the ENDTOL criterion ended the run, nt is the last step
+    int   drmopen, monopen, frameopen, haloopen;   // modules set up, closed by closemods
+//  MPI+CUDA
+    cudaStream_t stream_1, stream_2, stream_i;
+    int   rank, size, srcproc;
+    int   coord[2];
+    int   x_rank_L, x_rank_R, y_rank_F, y_rank_B;
+    MPI_Comm MCW, MC1, MCO;
+    MPI_Request request_x[4], request_y[4];
+    MPI_Datatype filetype;
+    int   msg_v_size_x, msg_v_size_y, count_x, count_y;
+    int   xls, xre, xvs, xve, xss1, xse1, xss2, xse2, xss3, xse3;
+    int   yfs, yfe, ybs, ybe, yls, yre;
+    float *SL_vel, *SR_vel, *RL_vel, *RR_vel;   // velocity sent to/received from left and right in x
+    float *SF_vel, *SB_vel, *RF_vel, *RB_vel;   // velocity sent to/received from front and back in y
+    float *SL_enc, *SR_enc, *RL_enc, *RR_enc;   // the same messages encoded with HALOFMT
+    float *SF_enc, *SB_enc, *RF_enc, *RB_enc;
+    int   enc_size_x, enc_size_y;
+//  recording
+    int   WRITE_STEP;
+    int   NTISKP;
+    int   rec_NX, rec_NY, rec_NZ;
+    int   rec_nxt, rec_nyt, rec_nzt;
+    int   rec_nbgx, rec_nedx;       // 0-based indexing, however NBG* is 1-based
+    int   rec_nbgy, rec_nedy;
+    int   rec_nbgz, rec_nedz;
+    int   rec_n;                    // local recording points per output step
+    int   nmask;                    // local masked recording points, all levels
+    int   NMASK;                    // masked recording points per level, all ranks
+    char  filenamebasex[50];
+    char  filenamebasey[50];
+    char  filenamebasez[50];
+//  library callbacks
+    pmcl3d_output_fn  outfn;
+    void  *outuser;
+    int   outfiles;                 // SX/SY/SZ files next to the output callback
+    pmcl3d_station_fn stafn;
+    void  *stauser;
+    int   nsta, nstaloc;            // stations, all and local
+    int   *staid, *stapos, *d_stapos;
+    float *stabuf, *d_stabuf;
+    int   staload;                  // local stations not yet on the device
+    pmcl3d_peak_fn peakfn;
+    void  *peakuser;
+    float *pgv, *d_pgv;
+    int   peaked;                   // 1 after the peak map went to the callback
+};
+
+void pmcl3d_output_callback(pmcl3d_sim *s, pmcl3d_output_fn fn, void *user, int files)
+{
+    s->outfn    = fn;
+    s->outuser  = user;
+    s->outfiles = files;
+    return;
+}
+
+int pmcl3d_add_station(pmcl3d_sim *s, int x, int y, int z)
+{
+    int i, j, k;
+
+    if(x<1 || x>s->NX || y<1 || y>s->NY || z<1 || z>s->NZ)
+    {
+       if(s->rank==0) printf("station %d,%d,%d outside the grid\n", x, y, z);
+       return -1;
+    }
+    i = x-1-s->nxt*s->coord[0];
+    j = y-1-s->nyt*s->coord[1];
+    if(i>=0 && i<s->nxt && j>=0 && j<s->nyt)
+    {
+       k = s->nstaloc++;
+       s->staid  = (int *)realloc(s->staid, sizeof(int)*s->nstaloc);
+       s->stapos = (int *)realloc(s->stapos, sizeof(int)*s->nstaloc);
+       s->stabuf = (float *)realloc(s->stabuf, sizeof(float)*3*s->nstaloc);
+       s->staid[k]  = s->nsta;
+       s->stapos[k] = gridcol(i+2+4*loop, j+2+4*loop)+s->nzt+align-z;
+       s->staload   = 1;
+    }
+    return s->nsta++;
+}
+
+void pmcl3d_station_callback(pmcl3d_sim *s, pmcl3d_station_fn fn, void *user)
+{
+    s->stafn   = fn;
+    s->stauser = user;
+    return;
+}
+
+void pmcl3d_peak_callback(pmcl3d_sim *s, pmcl3d_peak_fn fn, void *user)
+{
+    s->peakfn   = fn;
+    s->peakuser = user;
+    return;
+}
+
+// hands one output batch to the output callback
+static void output(pmcl3d_sim *s, int nstep)
+{
+    pmcl3d_output out;
+
+    out.step    = s->cur_step;
+    out.nstep   = nstep;
+    out.count   = (long)s->rec_n*nstep;
+    out.vx      = s->Bufx;
+    out.vy      = s->Bufy;
+    out.vz      = s->Bufz;
+    out.rec_NX  = s->rec_NX;
+    out.rec_NY  = s->rec_NY;
+    out.rec_NZ  = s->rec_NZ;
+    out.rec_nxt = s->rec_nxt;
+    out.rec_nyt = s->rec_nyt;
+    out.rec_nzt = s->rec_nzt;
+    out.x0      = (s->displacement/sizeof(float))%s->rec_NX;
+    out.y0      = (s->displacement/sizeof(float))/s->rec_NX;
+    out.nmask   = (s->MASK[0] ? s->nmask : 0);
+    out.gidx    = (s->MASK[0] ? s->mask_gidx : NULL);
+    s->outfn(&out, s->outuser);
+    return;
+}
+
+// writes the first nstep time steps of Bufx/Bufy/Bufz as the batch of cur_step,
+// nstep<WRITE_STEP for the last batch of a run that ended early
+static void writebatch(pmcl3d_sim *s, int nstep)
+{
+    char  filename[50];
+    int   err;
+    SinkHeader hdr;
+
+    cudaThreadSynchronize();
+    if((!s->SINK[0] || s->SINKMODE==0) && s->outfiles)
+    {
+      sprintf(filename, "%s%07ld", s->filenamebasex, s->cur_step);
+      err  = writeout(filename, s->MCO, s->displacement, s->filetype, s->outinfo, s->Bufx, s->rec_n*nstep);
+      sprintf(filename, "%s%07ld", s->filenamebasey, s->cur_step);
+      err |= writeout(filename, s->MCO, s->displacement, s->filetype, s->outinfo, s->Bufy, s->rec_n*nstep);
+      sprintf(filename, "%s%07ld", s->filenamebasez, s->cur_step);
+      err |= writeout(filename, s->MCO, s->displacement, s->filetype, s->outinfo, s->Bufz, s->rec_n*nstep);
+      if(err)
+        MPI_Abort(s->MCW, -1);
+    }
+    if(s->sinkfd>=0)
+    {
+      hdr       = s->sinkhello;
+      hdr.nstep = nstep;
+      if(sinkwrite(s->sinkfd, &hdr, 0, s->cur_step, s->Bufx, (long)s->rec_n*nstep) ||
+         sinkwrite(s->sinkfd, &hdr, 1, s->cur_step, s->Bufy, (long)s->rec_n*nstep) ||
+         sinkwrite(s->sinkfd, &hdr, 2, s->cur_step, s->Bufz, (long)s->rec_n*nstep))
+        MPI_Abort(s->MCW, -1);
+    }
+    if(s->outfn)
+      output(s, nstep);
+    return;
+}
+
+// velocity at the local stations after the time step
+static void stations(pmcl3d_sim *s)
+{
+    int i, n = s->nstaloc;
+
+    if(s->CPU)
+    {
+       for(i=0;i<n;i++)
+       {
+          s->stabuf[i]     = (&s->u1[0][0][0])[s->stapos[i]];
+          s->stabuf[n+i]   = (&s->v1[0][0][0])[s->stapos[i]];
+          s->stabuf[2*n+i] = (&s->w1[0][0][0])[s->stapos[i]];
+       }
+    }
+    else
+    {
+       if(s->staload)
+       {
+          cudaFree(s->d_stapos);
+          cudaFree(s->d_stabuf);
+          cudaMalloc((void**)&s->d_stapos, sizeof(int)*n);
+          cudaMalloc((void**)&s->d_stabuf, sizeof(float)*3*n);
+          cudaMemcpy(s->d_stapos, s->stapos, sizeof(int)*n, cudaMemcpyHostToDevice);
+          s->staload = 0;
+       }
+       drmgather_H(s->d_stabuf,     s->d_stapos, n, s->d_u1);
+       drmgather_H(s->d_stabuf+n,   s->d_stapos, n, s->d_v1);
+       drmgather_H(s->d_stabuf+2*n, s->d_stapos, n, s->d_w1);
+       cudaMemcpy(s->stabuf, s->d_stabuf, sizeof(float)*3*n, cudaMemcpyDeviceToHost);
+    }
+    s->stafn(s->cur_step, n, s->staid, s->stabuf, s->stabuf+n, s->stabuf+2*n, s->stauser);
+    return;
+}
+
+// peak surface velocity, updated after every time step
+static void peak(pmcl3d_sim *s)
+{
+    int   i, j, k = s->nzt+align-1;
+    long  n = (long)s->nxt*s->nyt;
+    float v;
+
+    if(!s->pgv)
+    {
+       s->pgv = (float *)calloc(n, sizeof(float));
+       if(!s->CPU)
+       {
+          cudaMalloc((void**)&s->d_pgv, sizeof(float)*n);
+          cudaMemset(s->d_pgv, 0, sizeof(float)*n);
+       }
+    }
+    if(s->CPU)
+    {
+       for(j=0;j<s->nyt;j++)
+         for(i=0;i<s->nxt;i++)
+         {
+            v = sqrt(s->u1[i+2+4*loop][j+2+4*loop][k]*s->u1[i+2+4*loop][j+2+4*loop][k]
+                    +s->v1[i+2+4*loop][j+2+4*loop][k]*s->v1[i+2+4*loop][j+2+4*loop][k]
+                    +s->w1[i+2+4*loop][j+2+4*loop][k]*s->w1[i+2+4*loop][j+2+4*loop][k]);
+            if(v>s->pgv[j*s->nxt+i]) s->pgv[j*s->nxt+i] = v;
+         }
+    }
+    else
+       peakv_H(s->d_pgv, s->d_u1, s->d_v1, s->d_w1, s->nxt, s->nyt);
+    return;
+}
+
+// hands the peak map up to time step step to the peak callback, once per run
+static void peakmap(pmcl3d_sim *s, long int step)
+{
+    pmcl3d_peak map;
+
+    if(!s->CPU)
+      cudaMemcpy(s->pgv, s->d_pgv, sizeof(float)*s->nxt*s->nyt, cudaMemcpyDeviceToHost);
+    map.step = step;
+    map.nx   = s->nxt;
+    map.ny   = s->nyt;
+    map.x0   = s->nxt*s->coord[0];
+    map.y0   = s->nyt*s->coord[1];
+    map.NX   = s->NX;
+    map.NY   = s->NY;
+    map.pgv  = s->pgv;
+    s->peakfn(&map, s->peakuser);
+    s->peaked = 1;
+    return;
+}
+
+// OUT/NSTEP: last time step of the run and the time steps in its short last
+// batch (0 if none), so postproc finds the batches of runs that ended early
+static void endrecord(pmcl3d_sim *s, int nshort)
+{
+    char  filename[sizeof(s->OUT)+8];
+    FILE *fp;
+
+    if(s->rank!=0 || (s->SINK[0] && s->SINKMODE!=0) || !s->outfiles)
+      return;
+    snprintf(filename, sizeof(filename), "%s/NSTEP", s->OUT);
+    fp = fopen(filename, "w");
+    if(!fp || fprintf(fp, "%ld %d\n", s->cur_step, nshort)<0 || fclose(fp))
+    {
+      logrank(LV_ERROR, "can't write %s", filename);
+      MPI_Abort(s->MCW, -1);
+    }
+    return;
+}
+
+// reads the source and uploads its first samples to the device
+static int sourceinit(pmcl3d_sim *s)
+{
+    int      err;
+    long int num_bytes;
+
+    if(s->rank==0) printf("Before inisource\n");
+    if(s->SRCDT>0.0)
+    {
+       // coarse source: the file has nstc samples at SRCDT, the device a window of srcgw of them
+       if(s->SRCINTERP!=1 && s->SRCINTERP!=3)
+       {
+          if(s->rank==0) printf("SRCINTERP must be 1 or 3\n");
+          return -1;
+       }
+       s->nstc   = (int)((s->NST-1)*(double)s->DT/s->SRCDT+1.0e-6)+2;
+       s->srcgw  = (s->READ_STEP_GPU<s->nstc ? s->READ_STEP_GPU : s->nstc);
+       s->srchs  = (s->nstc+s->srcgw-1)/s->srcgw*s->srcgw+3;
+       s->srcwin = -1;
+       if(s->rank==0) printf("coarse source: %d samples at %g s for %d steps at %g s\n", s->nstc, s->SRCDT, s->NST, s->DT);
+       err = inisource_coarse(s->rank, s->IFAULT, s->NSRC, s->READ_STEP, s->nstc, s->srchs, &s->srcproc, s->NZ, s->MCW, s->nxt, s->nyt, s->nzt,
+                              s->coord, maxdim, &s->npsrc, &s->tpsrc, &s->taxx, &s->tayy, &s->tazz, &s->taxz, &s->tayz, &s->taxy,
+                              s->INSRC, s->INSRC_I2);
+    }
+    else
+    err = inisource(s->rank,   s->IFAULT, s->NSRC,  s->READ_STEP, s->NST,   &s->srcproc, s->NZ, s->MCW, s->nxt, s->nyt, s->nzt, s->coord, maxdim, &s->npsrc,
+                    &s->tpsrc, &s->taxx,  &s->tayy, &s->tazz,     &s->taxz, &s->tayz,    &s->taxy, s->INSRC, s->INSRC_I2);
+    if(err)
+       logrank(LV_ERROR, "source initialization failed");
+    err = (err!=0);
+    MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MAX, s->MCW);
+    if(err)
+       return -1;
+    if(s->rank==0) printf("After inisource\n");
+
+    logall(LV_INFO, (s->rank==s->srcproc ? "source rank, npsrc=%d" : ""), s->npsrc);
+    // the host kernels read the source from the host arrays
+    if(s->rank==s->srcproc && !s->CPU)
+    {
+       // a coarse source window holds the samples before and after it for the interpolation
+       num_bytes = sizeof(float)*s->npsrc*(s->SRCDT>0.0 ? s->srcgw+3 : s->READ_STEP_GPU);
+       cudaMalloc((void**)&s->d_taxx, num_bytes);
+       cudaMalloc((void**)&s->d_tayy, num_bytes);
+       cudaMalloc((void**)&s->d_tazz, num_bytes);
+       cudaMalloc((void**)&s->d_taxz, num_bytes);
+       cudaMalloc((void**)&s->d_tayz, num_bytes);
+       cudaMalloc((void**)&s->d_taxy, num_bytes);
+       if(s->SRCDT>0.0)
+       {
+          s->srcwin = 0;
+          Cpy2Device_srcwin(s->npsrc, s->srcgw+3, s->srchs, 0, s->taxx, s->tayy, s->tazz, s->taxz, s->tayz, s->taxy,
+                            s->d_taxx, s->d_tayy, s->d_tazz, s->d_taxz, s->d_tayz, s->d_taxy);
+       }
+       else
+       {
+       cudaMemcpy(s->d_taxx,s->taxx,num_bytes,cudaMemcpyHostToDevice);
+       cudaMemcpy(s->d_tayy,s->tayy,num_bytes,cudaMemcpyHostToDevice);
+       cudaMemcpy(s->d_tazz,s->tazz,num_bytes,cudaMemcpyHostToDevice);
+       cudaMemcpy(s->d_taxz,s->taxz,num_bytes,cudaMemcpyHostToDevice);
+       cudaMemcpy(s->d_tayz,s->tayz,num_bytes,cudaMemcpyHostToDevice);
+       cudaMemcpy(s->d_taxy,s->taxy,num_bytes,cudaMemcpyHostToDevice);
+       }
+       num_bytes = sizeof(int)*s->npsrc*maxdim;
+       cudaMalloc((void**)&s->d_tpsrc, num_bytes);
+       cudaMemcpy(s->d_tpsrc,s->tpsrc,num_bytes,cudaMemcpyHostToDevice);
+    }
+    return 0;
+}
+
+// --AUTO: grid spacing, time step and sponge width for FMAX from the media extremes
+static int autogrid(pmcl3d_sim *s, float *vse, float *vpe)
+{
+    float  lim, cfl, vmin, dhmax, dt, p, refl;
+    int    nd, ndmax;
+
+    if(s->AUTO==0)
+      return 0;
+    if(s->AUTO<0 || s->AUTO>2 || s->FMAX<=0.0 || s->PPW<=0.0 || s->REFL<=0.0 || s->REFL>=1.0)
+    {
+      if(s->rank==0) printf("AUTO must be 0, 1 or 2 and needs FMAX>0, PPW>0 and 0<REFL<1\n");
+      return -1;
+    }
+    lim = cfllimit(s->FDCOEF);
+    cfl = (s->COURANT>0.0 ? s->COURANT : 0.9*lim);
+    if(cfl>lim)
+    {
+      if(s->rank==0) printf("COURANT %f exceeds the stability limit %f\n", cfl, lim);
+      return -1;
+    }
+    // fluid cells have no S wave, the P wave is the shortest there
+    vmin  = (vse[0]>0.0 ? vse[0] : vpe[0]);
+    dhmax = vmin/(s->FMAX*s->PPW);
+    // largest stable step at the given DH, 3 significant digits rounded down
+    dt    = cfl*s->DH/vpe[1];
+    p     = pow(10.0, floor(log10(dt))-2.0);
+    dt    = floor(dt/p+1.0e-3)*p;
+    // the sponge fits in one subdomain and leaves half of the grid undamped
+    ndmax = (s->nxt<s->NX/4 ? s->nxt : s->NX/4);
+    if(s->nyt<ndmax)   ndmax = s->nyt;
+    if(s->NY/4<ndmax)  ndmax = s->NY/4;
+    if(s->nzt/2<ndmax) ndmax = s->nzt/2;
+    for(nd=1;nd<ndmax && crjrefl(s->ARBC, nd, s->DH, dt, vpe[1])>s->REFL;nd++);
+    refl  = crjrefl(s->ARBC, nd, s->DH, dt, vpe[1]);
+
+    if(s->rank==0)
+    {
+      printf("AUTO: vs min %g m/s, vp max %g m/s, FMAX %g Hz at %g points per wavelength\n", vmin, vpe[1], s->FMAX, s->PPW);
+      // cells go with DH^-3 and steps with DH^-1 at a fixed Courant number
+      if(s->DH<dhmax)
+        printf("AUTO: DH %g is %.0f%% finer than the coarsest DH %g, %.2fx the cost of the coarsest grid\n",
+               s->DH, 100.0*(dhmax/s->DH-1.0), dhmax, pow(dhmax/s->DH, 4.0));
+      else
+        printf("AUTO: DH %g is coarser than %g, it resolves only %g Hz at %g points per wavelength\n",
+               s->DH, dhmax, vmin/(s->PPW*s->DH), s->PPW);
+      printf("AUTO: DH is fixed by the mesh, rebuild it at DH %g to use the coarsest grid\n", dhmax);
+      printf("AUTO: DT %g (vp*dt/dh %.3f), largest DT %g at vp*dt/dh %.3f, stability limit %.3f\n",
+             s->DT, vpe[1]*s->DT/s->DH, dt, vpe[1]*dt/s->DH, lim);
+      printf("AUTO: ND %d reflects %.3g at DT %g, ND %d reflects %.3g at DT %g (REFL %g)%s\n",
+             s->ND, crjrefl(s->ARBC, s->ND, s->DH, s->DT, vpe[1]), s->DT, nd, refl, dt, s->REFL,
+             (refl>s->REFL ? ", limited by the grid size" : ""));
+    }
+    if(s->AUTO==1)
+      return 0;
+
+    if(dt!=s->DT)
+    {
+      // the source samples stay at the old DT and are interpolated, NST counts the new steps
+      if(s->SRCDT<=0.0)
+      {
+        s->SRCDT = s->DT;
+        s->NST   = (int)((s->NST>2 ? s->NST-2 : 0)*(double)s->DT/dt+1.0e-6)+1;
+      }
+      else
+        s->NST   = (int)((s->NST-1)*(double)s->DT/dt+1.0e-6)+1;
+      if(s->rank==0)
+        printf("AUTO: DT %g -> %g, source at SRCDT %g over %d steps, output every %g s instead of %g s\n",
+               s->DT, dt, s->SRCDT, s->NST, s->NTISKP*dt, s->NTISKP*s->DT);
+      s->DT = dt;
+      s->nt = (int)(s->TMAX/s->DT) + 1;
+    }
+    if(nd!=s->ND)
+    {
+      if(s->rank==0) printf("AUTO: ND %d -> %d\n", s->ND, nd);
+      s->ND = nd;
+    }
+    return 0;
+}
+
+// closes the drm, monitor, frame and halo modules that are set up, stopped=-1 for a run never started
+static void closemods(pmcl3d_sim *s, int stopped)
+{
+    if(s->drmopen)
+      drmclose(s->rank);
+    if(s->monopen)
+      monclose(s->cur_step-1, stopped);
+    if(s->frameopen)
+      frameclose();
+    if(s->haloopen)
+      haloclose(s->rank, s->MCW);
+    s->drmopen   = 0;
+    s->monopen   = 0;
+    s->frameopen = 0;
+    s->haloopen  = 0;
+    return;
+}
+
+// frees what pmcl3d_create has set up, NULL-safe so a partly created handle can go too
+static void release(pmcl3d_sim *s)
+{
+    closemods(s, -1);
+    if(!s->CPU && s->d_vx1)
+       UnBindArrayFromTexture();
+    Delloc3D(s->u1);
+    Delloc3D(s->v1);
+    Delloc3D(s->w1);
+    Delloc3D(s->xx);
+    Delloc3D(s->yy);
+    Delloc3D(s->zz);
+    Delloc3D(s->xy);
+    Delloc3D(s->yz);
+    Delloc3D(s->xz);
+    Delloc3D(s->vx1);
+    Delloc3D(s->vx2);
+
+    cudaFree(s->d_u1);
+    cudaFree(s->d_v1);
+    cudaFree(s->d_w1);
+    cudaFree(s->d_f_u1);
+    cudaFree(s->d_f_v1);
+    cudaFree(s->d_f_w1);
+    cudaFree(s->d_b_u1);
+    cudaFree(s->d_b_v1);
+    cudaFree(s->d_b_w1);
+    cudaFree(s->d_xx);
+    cudaFree(s->d_yy);
+    cudaFree(s->d_zz);
+    cudaFree(s->d_xy);
+    cudaFree(s->d_yz);
+    cudaFree(s->d_xz);
+    cudaFree(s->d_vx1);
+    cudaFree(s->d_vx2);
+
+    Delloc3D(s->r1);
+    Delloc3D(s->r2);
+    Delloc3D(s->r3);
+    Delloc3D(s->r4);
+    Delloc3D(s->r5);
+    Delloc3D(s->r6);
+    cudaFree(s->d_r1);
+    cudaFree(s->d_r2);
+    cudaFree(s->d_r3);
+    cudaFree(s->d_r4);
+    cudaFree(s->d_r5);
+    cudaFree(s->d_r6);
+    Delloc3D(s->qp);
+    Delloc3D(s->qs);
+    cudaFree(s->d_qp);
+    cudaFree(s->d_qs);
+
+    Delloc1D(s->dcrjx);
+    Delloc1D(s->dcrjy);
+    Delloc1D(s->dcrjz);
+    cudaFree(s->d_dcrjx);
+    cudaFree(s->d_dcrjy);
+    cudaFree(s->d_dcrjz);
+
+    Delloc3D(s->d1);
+    Delloc3D(s->mu);
+    Delloc3D(s->lam);
+    Delloc3D(s->lam_mu);
+    cudaFree(s->d_d1);
+    cudaFree(s->d_mu);
+    cudaFree(s->d_lam);
+    cudaFree(s->d_lam_mu);
+
+    // NULL on the ranks without source points
+    Delloc1D(s->taxx);
+    Delloc1D(s->tayy);
+    Delloc1D(s->tazz);
+    Delloc1D(s->taxz);
+    Delloc1D(s->tayz);
+    Delloc1D(s->taxy);
+    cudaFree(s->d_taxx);
+    cudaFree(s->d_tayy);
+    cudaFree(s->d_tazz);
+    cudaFree(s->d_taxz);
+    cudaFree(s->d_tayz);
+    cudaFree(s->d_taxy);
+    Delloc1P(s->tpsrc);
+    cudaFree(s->d_tpsrc);
+
+    Delloc1D(s->Bufx);
+    Delloc1D(s->Bufy);
+    Delloc1D(s->Bufz);
+    cudaFreeHost(s->SL_vel);
+    cudaFreeHost(s->SR_vel);
+    cudaFreeHost(s->RL_vel);
+    cudaFreeHost(s->RR_vel);
+    cudaFreeHost(s->SF_vel);
+    cudaFreeHost(s->SB_vel);
+    cudaFreeHost(s->RF_vel);
+    cudaFreeHost(s->RB_vel);
+    cudaFreeHost(s->SL_enc);
+    cudaFreeHost(s->SR_enc);
+    cudaFreeHost(s->RL_enc);
+    cudaFreeHost(s->RR_enc);
+    cudaFreeHost(s->SF_enc);
+    cudaFreeHost(s->SB_enc);
+    cudaFreeHost(s->RF_enc);
+    cudaFreeHost(s->RB_enc);
+
+    Delloc1P(s->mask_pos);
+    Delloc1P(s->mask_gidx);
+    Delloc1P(s->mask_grid);
+
+    if(s->sinkfd>=0)
+    {
+      s->sinkhello.step = s->cur_step-1;
+      sinkclose(s->sinkfd, &s->sinkhello);
+    }
+    if(s->mediainfo!=MPI_INFO_NULL)    MPI_Info_free(&s->mediainfo);
+    if(s->outinfo!=MPI_INFO_NULL)      MPI_Info_free(&s->outinfo);
+    if(s->filetype!=MPI_DATATYPE_NULL) MPI_Type_free(&s->filetype);
+    if(s->MCO!=MPI_COMM_NULL)          MPI_Comm_free(&s->MCO);
+    if(s->MC1!=MPI_COMM_NULL)          MPI_Comm_free(&s->MC1);
+    MPI_Comm_free(&s->MCW);
+    logclose();
+    if(s->nstaloc>0)
+    {
+       free(s->staid);
+       free(s->stapos);
+       free(s->stabuf);
+       if(s->d_stapos)
+       {
+          cudaFree(s->d_stapos);
+          cudaFree(s->d_stabuf);
+       }
+    }
+    if(s->pgv)
+    {
+       free(s->pgv);
+       if(s->d_pgv) cudaFree(s->d_pgv);
+    }
+    free(s);
+    return;
+}
+
+// every rank fails if one has: err on any rank releases the handle on all, returns 1
+static int failed(pmcl3d_sim *s, int err)
+{
+    err = (err!=0);
+    MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MAX, s->MCW);
+    if(!err)
+      return 0;
+    meshabort();
+    release(s);
+    return 1;
+}
+
+pmcl3d_sim *pmcl3d_create(int argc, char **argv, MPI_Comm comm)
+{
+    pmcl3d_sim *s;
+    int   i, j, k, err, rank_gpu, tmpSize;
+    int   dim[2], period[2], reorder;
+    long int num_bytes;
+    float taumax, taumin, tauu;
+    Grid3D tau=NULL, tau1=NULL, tau2=NULL;
+    float vse[2], vpe[2], dde[2];
+    double t0 = gethrtime(), t = t0, tst[5];
+    MediaHeader mh;
+    int   cached = 0;
+
+    s = (pmcl3d_sim *)calloc(1, sizeof(pmcl3d_sim));
+    s->sinkfd   = -1;
+    s->x_rank_L = -1;
+    s->x_rank_R = -1;
+    s->y_rank_F = -1;
+    s->y_rank_B = -1;
+    s->outfiles = 1;
+    s->MC1       = MPI_COMM_NULL;
+    s->MCO       = MPI_COMM_NULL;
+    s->filetype  = MPI_DATATYPE_NULL;
+    s->mediainfo = MPI_INFO_NULL;
+    s->outinfo   = MPI_INFO_NULL;
+
+//  variable initialization begins
+    if(command(argc,argv,&s->TMAX,&s->DH,&s->DT,&s->ARBC,&s->PHT,&s->NPC,&s->ND,&s->NSRC,&s->NST,
+      &s->NVAR,&s->NVE,&s->MEDIASTART,&s->IFAULT,&s->READ_STEP,&s->READ_STEP_GPU,
+      &s->NTISKP,&s->WRITE_STEP,&s->NX,&s->NY,&s->NZ,&s->PX,&s->PY,
+      &s->NBGX,&s->NEDX,&s->NSKPX,&s->NBGY,&s->NEDY,&s->NSKPY,&s->NBGZ,&s->NEDZ,&s->NSKPZ,
+      &s->FL,&s->FH,&s->FP,&s->IDYNA,&s->SoCalQ,s->INSRC,s->INVEL,s->OUT,s->INSRC_I2,s->CHKFILE,
+      s->MASK,&s->MASKTYPE,s->SINK,&s->SINKMODE,s->IOHINTS,&s->IOTUNE,&s->CPU,&s->CPUTILE,&s->FDCOEF,
+      s->DRMREC,s->DRMIN,s->DRMBOX,s->DRMORIGIN,&s->DRMSKIP,
+      &s->MONITOR,&s->MONACTION,&s->MONGROW,s->HEARTBEAT,
+      &s->ENDTOL,&s->ENDWIN,&s->ENDMODE,
+      &s->SRCDT,&s->SRCINTERP,
+      &s->HALOFMT,
+      &s->FRAMES,&s->FRAMESKIP,&s->FRAMEVMAX,&s->FRAMEFMT,s->FRAMEOUT,
+      &s->AUTO,&s->FMAX,&s->PPW,&s->COURANT,&s->REFL,
+      s->MEDIACACHE,
+      &s->CPUBRICK,
+      &s->CPUREC,
+      &s->LOGLEVEL,s->LOGRANKS,s->LOGDIR))
+    {
+      free(s);
+      return NULL;
+    }
+
+    sprintf(s->filenamebasex,"%s/SX",s->OUT);
+    sprintf(s->filenamebasey,"%s/SY",s->OUT);
+    sprintf(s->filenamebasez,"%s/SZ",s->OUT);
+
+    //printf("After command.\n");
+    // Below 12 lines are NOT for HPGPU4 machine!
+/*    int local_rank;
+    char* str;
+    if ((str = getenv("MV2_COMM_WORLD_LOCAL_RANK")) != NULL) {
+      local_rank = atoi(str);
+      rank_gpu = local_rank%3;
+    }
+    else{
+      printf("CANNOT READ LOCAL RANK!\n");
+      MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    //printf("%d) After rank_gpu calc.\n",local_rank);
+    cudaSetDevice(rank_gpu);
+    //if(local_rank==0) printf("after cudaSetDevice\n");
+*/
+    // WARNING: Above 12 lines are not for HPGPU4 machine!
+
+    MPI_Comm_rank(comm,&s->rank);
+    MPI_Comm_size(comm,&s->size);
+    MPI_Comm_dup(comm, &s->MCW );
+    if(failed(s, loginit(s->LOGLEVEL, s->LOGRANKS, s->LOGDIR, s->rank, s->size, s->MCW)))
+      return NULL;
+    if(s->PX*s->PY!=s->size)
+    {
+      if(s->rank==0) printf("PX*PY=%d needs as many ranks, not %d\n", s->PX*s->PY, s->size);
+      release(s);
+      return NULL;
+    }
+    MPI_Barrier(s->MCW);
+    s->nxt       = s->NX/s->PX;
+    s->nyt       = s->NY/s->PY;
+    s->nzt       = s->NZ;
+    s->nt        = (int)(s->TMAX/s->DT) + 1;
+    dim[0]    = s->PX;
+    dim[1]    = s->PY;
+    period[0] = 0;
+    period[1] = 0;
+    reorder   = 1;
+    err       = MPI_Cart_create(s->MCW, 2, dim, period, reorder, &s->MC1);
+    err      |= MPI_Cart_shift(s->MC1, 0,  1,  &s->x_rank_L, &s->x_rank_R );
+    err      |= MPI_Cart_shift(s->MC1, 1,  1,  &s->y_rank_F, &s->y_rank_B );
+    err      |= MPI_Cart_coords(s->MC1, s->rank, 2, s->coord);
+    if(err!=MPI_SUCCESS)
+      logrank(LV_ERROR, "can't create the %d x %d process grid", s->PX, s->PY);
+    if(failed(s, err!=MPI_SUCCESS))
+      return NULL;
+    MPI_Barrier(s->MCW);
+    // Below line is only for HPGPU4 machine!
+//    rank_gpu = rank%4;
+    // Below line is for 1 GPU/node systems
+    rank_gpu = 0;
+    cudaSetDevice(rank_gpu);
+
+    logall(LV_INFO, "RS=%d, RSG=%d, NST=%d, IF=%d", s->READ_STEP, s->READ_STEP_GPU, s->NST, s->IFAULT);
+
+    // layout of the host fields, every flat offset below goes through gridcol;
+    // a record holds d1, mu, lam, vx1, vx2 and the 9 wavefields, with attenuation
+    // also qp, qs and r1..r6
+    err = (s->CPUBRICK>1 || s->CPUREC) && (!s->CPU || s->DRMREC[0] || s->DRMIN[0]);
+    if(err && s->rank==0)
+       printf("CPUBRICK and CPUREC need the host kernels (--CPU 1) and no DRM\n");
+    if(failed(s, err))
+       return NULL;
+    if(s->CPUBRICK<1) s->CPUBRICK = 1;
+    SetFieldLayout(s->CPUBRICK, (s->CPUREC ? 14+8*(s->NVE==1) : 1),
+                   s->nxt+4+8*loop, s->nyt+4+8*loop, s->nzt+2*align);
+    if(s->rank==0 && s->CPUBRICK>1) printf("host fields in %d x %d column bricks\n", s->CPUBRICK, s->CPUBRICK);
+    if(s->rank==0 && s->CPUREC)     printf("host fields interleaved in %d-field column records\n", 14+8*(s->NVE==1));
+
+    // same for each processor:
+    if(s->NEDX==-1) s->NEDX = s->NX;
+    if(s->NEDY==-1) s->NEDY = s->NY;
+    if(s->NEDZ==-1) s->NEDZ = s->NZ;
+    // make NED's a record point
+    // for instance if NBGX:NSKPX:NEDX = 1:3:9
+    // then we have 1,4,7 but NEDX=7 is better
+    s->NEDX = s->NEDX-(s->NEDX-s->NBGX)%s->NSKPX;
+    s->NEDY = s->NEDY-(s->NEDY-s->NBGY)%s->NSKPY;
+    s->NEDZ = s->NEDZ-(s->NEDZ-s->NBGZ)%s->NSKPZ;
+    // number of recording points in total
+    s->rec_NX = (s->NEDX-s->NBGX)/s->NSKPX+1;
+    s->rec_NY = (s->NEDY-s->NBGY)/s->NSKPY+1;
+    s->rec_NZ = (s->NEDZ-s->NBGZ)/s->NSKPZ+1;
+
+    // specific to each processor:
+    calcRecordingPoints(&s->rec_nbgx, &s->rec_nedx, &s->rec_nbgy, &s->rec_nedy,
+      &s->rec_nbgz, &s->rec_nedz, &s->rec_nxt, &s->rec_nyt, &s->rec_nzt, &s->displacement,
+      (long int)s->nxt,(long int)s->nyt,(long int)s->nzt, s->rec_NX, s->rec_NY, s->rec_NZ,
+      s->NBGX,s->NEDX,s->NSKPX, s->NBGY,s->NEDY,s->NSKPY, s->NBGZ,s->NEDZ,s->NSKPZ, s->coord);
+    logall(LV_INFO, "NX,NY,NZ=%d,%d,%d nxt,nyt,nzt=%d,%d,%d rec_N=(%d,%d,%d) NBGX,SKP,END=(%d:%d:%d),(%d:%d:%d),(%d:%d:%d)",
+        s->NX,s->NY,s->NZ,s->nxt,s->nyt,s->nzt,s->rec_NX, s->rec_NY, s->rec_NZ,
+        s->NBGX,s->NSKPX,s->NEDX,s->NBGY,s->NSKPY,s->NEDY,s->NBGZ,s->NSKPZ,s->NEDZ);
+    logall(LV_INFO, "rec_nxt,nyt,nzt=%d,%d,%d", s->rec_nxt, s->rec_nyt, s->rec_nzt);
+    logrank(LV_DETAIL, "coord=(%d,%d) rec_nbg,ed=(%d,%d),(%d,%d),(%d,%d) disp=%ld",
+        s->coord[0],s->coord[1],s->rec_nbgx,s->rec_nedx,s->rec_nbgy,s->rec_nedy,s->rec_nbgz,s->rec_nedz,(long int)s->displacement);
+
+    if(failed(s, iohints(s->IOHINTS, s->rank, s->MCW, &s->mediainfo, &s->outinfo)))
+      return NULL;
+    s->rec_n = s->rec_nxt*s->rec_nyt*s->rec_nzt;
+
+    // sparse output: only the masked recording points, compacted in the file
+    if(s->MASK[0])
+    {
+      if(failed(s, inimask(s->MASK, s->MASKTYPE, s->rank, s->coord, s->PX, s->MCW, s->nxt, s->nyt, s->nzt, s->rec_NX, s->rec_NY,
+                 s->rec_nxt, s->rec_nyt, s->rec_nzt, s->rec_nbgx, s->rec_nbgy, s->rec_nbgz,
+                 s->NBGX, s->NSKPX, s->NBGY, s->NSKPY, s->NSKPZ, &s->nmask, &s->mask_pos, &s->mask_gidx, &s->mask_grid, &s->NMASK)))
+        return NULL;
+      s->displacement = 0;
+      s->rec_n        = s->nmask;
+    }
+
+    // output communicator: ranks without recording points never join the output collectives
+    MPI_Comm_split(s->MCW, (s->rec_n>0 ? 0 : MPI_UNDEFINED), s->rank, &s->MCO);
+    err = 0;
+    if(s->rec_n>0)
+    {
+      if(s->MASK[0])
+      {
+        char sidx[sizeof(s->OUT)+8];
+
+        maskfiletype(s->nmask, s->mask_gidx, (long)s->NMASK*s->rec_NZ, s->WRITE_STEP, MPI_FLOAT, &s->filetype);
+        snprintf(sidx, sizeof(sidx), "%s/SIDX", s->OUT);
+        err = writemaskindex(sidx, s->MCO, s->outinfo, s->nmask, s->mask_gidx, s->mask_grid, (long)s->NMASK*s->rec_NZ);
+      }
+      else
+        recfiletype(s->rec_NX, s->rec_NY, s->rec_NZ, s->rec_nxt, s->rec_nyt, s->rec_nzt, s->WRITE_STEP, &s->filetype);
+      MPI_Type_size(s->filetype, &tmpSize);
+      MPI_Comm_rank(s->MCO, &i);
+      if(i==0) printf("filetype size (supposedly=rec_n*WS*4=%d) =%d\n", s->rec_n*s->WRITE_STEP*4,tmpSize);
+      if(s->IOTUNE>0 && !err)
+        iotune(s->OUT, s->IOTUNE, s->MCO, s->displacement, s->filetype, s->rec_n*s->WRITE_STEP);
+
+      // in-transit output to a local consumer
+      if(s->SINK[0] && s->IOTUNE==0 && !err)
+      {
+        memset(&s->sinkhello, 0, sizeof(SinkHeader));
+        s->sinkhello.rank    = s->rank;
+        s->sinkhello.npts    = (s->MASK[0] ? (long)s->NMASK*s->rec_NZ : (long)s->rec_NX*s->rec_NY*s->rec_NZ);
+        s->sinkhello.nstep   = s->WRITE_STEP;
+        s->sinkhello.rec_NX  = s->rec_NX;
+        s->sinkhello.rec_NY  = s->rec_NY;
+        s->sinkhello.rec_NZ  = s->rec_NZ;
+        s->sinkhello.rec_nxt = s->rec_nxt;
+        s->sinkhello.rec_nyt = s->rec_nyt;
+        s->sinkhello.rec_nzt = s->rec_nzt;
+        s->sinkhello.x0      = (s->displacement/sizeof(float))%s->rec_NX;
+        s->sinkhello.y0      = (s->displacement/sizeof(float))/s->rec_NX;
+        s->sinkhello.nmask   = (s->MASK[0] ? s->nmask : 0);
+        s->sinkfd = sinkopen(s->SINK, &s->sinkhello, s->mask_gidx);
+        err = (s->sinkfd<0);
+      }
+    }
+    // the ranks without recording points wait here for the outcome
+    if(failed(s, err))
+      return NULL;
+    // output hints benchmark only
+    if(s->IOTUNE>0)
+    {
+      MPI_Barrier(s->MCW);
+      return s;
+    }
+
+/*
+    fmtype[0]  = WRITE_STEP;
+    //fmtype[1]  = NZ;
+    fmtype[1]  = NY;
+    fmtype[2]  = NX;
+    fptype[0]  = WRITE_STEP;
+    //fptype[1]  = nzt;
+    fptype[1]  = nyt;
+    fptype[2]  = nxt;
+    foffset[0] = 0;
+    //foffset[1] = 0;
+    foffset[1] = nyt*coord[1];
+    foffset[2] = nxt*coord[0];
+    err = MPI_Type_create_subarray(3, fmtype, fptype, foffset, MPI_ORDER_C, MPI_FLOAT, &filetype);
+    err = MPI_Type_commit(&filetype);
+*/
+    logrank(LV_DETAIL, "x_rank_L=%d, x_rank_R=%d, y_rank_F=%d, y_rank_B=%d", s->x_rank_L, s->x_rank_R, s->y_rank_F, s->y_rank_B);
+
+    // stress is also computed in the first reach ghost planes next to a neighbour,
+    // those planes and the next reach interior ones read the received velocity
+    if(s->x_rank_L<0)
+       s->xls = 2+4*loop;
+    else
+       s->xls = 2+4*loop-reach;
+
+    if(s->x_rank_R<0)
+       s->xre = s->nxt+4*loop+1;
+    else
+       s->xre = s->nxt+4*loop+1+reach;
+
+    s->xvs   = 2+4*loop;
+    s->xve   = s->nxt+4*loop+1;
+
+    s->xss1  = s->xls;
+    s->xse1  = s->xvs+reach-1;
+    s->xss2  = s->xvs+reach;
+    s->xse2  = s->xve-reach;
+    s->xss3  = s->xve-reach+1;
+    s->xse3  = s->xre;
+
+    if(s->y_rank_F<0)
+       s->yls = 2+4*loop;
+    else
+       s->yls = 2+4*loop-reach;
+
+    if(s->y_rank_B<0)
+       s->yre = s->nyt+4*loop+1;
+    else
+       s->yre = s->nyt+4*loop+1+reach;
+
+    s->yfs  = 2+4*loop;
+    s->yfe  = 2+8*loop-1;
+    s->ybs  = s->nyt+2;
+    s->ybe  = s->nyt+4*loop+1;
+    LAP(s->tstartup, ST_SETUP, t);
+
+    // converted media from mediapart, only when every rank has a matching file
+    if(s->MEDIACACHE[0] && (s->MEDIASTART==1 || s->MEDIASTART==2))
+    {
+      mediakey(&mh, s->INVEL, s->rank, s->MCW, s->coord, s->NX, s->NY, s->NZ, s->PX, s->PY,
+               s->NVAR, s->NVE, s->SoCalQ, s->FL, s->FH, s->FP);
+      cached = mediafind(s->MEDIACACHE, &mh, s->rank, s->MCW);
+    }
+
+    // the first media slab is read while rank 0 reads and broadcasts the source,
+    // with --AUTO 2 the source waits for the time step derived from the media
+    if(failed(s, !cached && meshopen(s->MEDIASTART, s->NVAR, s->NVE, s->nxt, s->nyt, s->nzt, s->PX, s->PY, s->NX, s->NY, s->NZ,
+                                     s->coord, s->MCW, s->INVEL, s->mediainfo)))
+      return NULL;
+    LAP(s->tstartup, ST_MEDIA, t);
+    if(s->AUTO!=2 && failed(s, sourceinit(s)))
+      return NULL;
+    LAP(s->tstartup, ST_SOURCE, t);
+
+    s->d1     = AllocField();
+    s->mu     = AllocField();
+    s->lam    = AllocField();
+    s->lam_mu = Alloc3D(s->nxt+4+8*loop, s->nyt+4+8*loop, 1);
+
+    if(s->NVE==1)
+    {
+       s->qp   = AllocField();
+       s->qs   = AllocField();
+    }
+
+    if(s->rank==0) printf("Before inimesh\n");
+    if(cached)
+    {
+      // already converted and swapped, streamed straight into place
+      if(failed(s, mediaload(s->MEDIACACHE, &mh, s->d1, s->mu, s->lam, s->qp, s->qs)))
+        return NULL;
+      taumax = mh.taumax;
+      taumin = mh.taumin;
+      memcpy(vse, mh.vse, sizeof(vse));
+      memcpy(vpe, mh.vpe, sizeof(vpe));
+      memcpy(dde, mh.dde, sizeof(dde));
+    }
+    else
+    inimesh(s->MEDIASTART, s->d1, s->mu, s->lam, s->qp, s->qs, &taumax, &taumin, s->NVAR, s->FP, s->FL, s->FH,
+            s->nxt, s->nyt, s->nzt, s->PX, s->PY, s->NX, s->NY, s->NZ, s->coord, s->MCW, s->IDYNA, s->NVE, s->SoCalQ, s->INVEL,
+            vse, vpe, dde, s->mediainfo);
+    if(s->rank==0) printf("After inimesh\n");
+    if(failed(s, autogrid(s, vse, vpe)))
+      return NULL;
+    if(s->rank==0)
+      writeCHK(s->CHKFILE, s->NTISKP, s->DT, s->DH, s->nxt, s->nyt, s->nzt,
+        s->nt, s->ARBC, s->NPC, s->NVE, s->FL, s->FH, s->FP, vse, vpe, dde);
+    cflcheck(s->rank, vpe[1], s->DH, s->DT, s->FDCOEF);
+    LAP(s->tstartup, ST_MEDIA, t);
+    if(s->AUTO==2 && failed(s, sourceinit(s)))
+      return NULL;
+    LAP(s->tstartup, ST_SOURCE, t);
+
+    if(!cached)
+      mediaswap(s->d1, s->mu, s->lam, s->qp, s->qs, s->rank, s->x_rank_L, s->x_rank_R, s->y_rank_F, s->y_rank_B, s->nxt, s->nyt, s->nzt, s->MCW);
+    LAP(s->tstartup, ST_MEDIA, t);
+
+    for(i=s->xls;i<s->xre+1;i++)
+      for(j=s->yls;j<s->yre+1;j++)
+      {
+         float t_xl, t_xl2m;
+         t_xl             = 1.0/s->lam[i][j][s->nzt+align-1];
+         t_xl2m           = 2.0/s->mu[i][j][s->nzt+align-1] + t_xl;
+         s->lam_mu[i][j][0]  = t_xl/t_xl2m;
+      }
+
+    if(!s->CPU)
+    {
+       num_bytes = sizeof(float)*(s->nxt+4+8*loop)*(s->nyt+4+8*loop);
+       cudaMalloc((void**)&s->d_lam_mu, num_bytes);
+       cudaMemcpy(s->d_lam_mu,&s->lam_mu[0][0][0],num_bytes,cudaMemcpyHostToDevice);
+    }
+
+    s->vx1  = AllocField();
+    s->vx2  = AllocField();
+    if(s->NPC==0)
+    {
+	s->dcrjx = Alloc1D(s->nxt+4+8*loop);
+        s->dcrjy = Alloc1D(s->nyt+4+8*loop);
+        s->dcrjz = Alloc1D(s->nzt+2*align);
+
+        for(i=0;i<s->nxt+4+8*loop;i++)
+	   s->dcrjx[i]  = 1.0;
+        for(j=0;j<s->nyt+4+8*loop;j++)
+           s->dcrjy[j]  = 1.0;
+        for(k=0;k<s->nzt+2*align;k++)
+           s->dcrjz[k]  = 1.0;
+
+        inicrj(s->ARBC, s->coord, s->nxt, s->nyt, s->nzt, s->NX, s->NY, s->ND, s->dcrjx, s->dcrjy, s->dcrjz);
+    }
+
+    if(s->NVE==1)
+    {
+        tau  = Alloc3D(2, 2, 2);
+        tau1 = Alloc3D(2, 2, 2);
+        tau2 = Alloc3D(2, 2, 2);
+        tausub(tau, taumin, taumax);
+        float dt1 = 1.0/s->DT;
+        for(i=0;i<2;i++)
+          for(j=0;j<2;j++)
+            for(k=0;k<2;k++)
+            {
+               tauu          = tau[i][j][k];
+               tau1[i][j][k] = 1.0/((tauu*dt1)+(1.0/2.0));
+               tau2[i][j][k] = (tauu*dt1)-(1.0/2.0);
+            }
+
+    	init_texture(s->nxt, s->nyt, s->nzt, tau1, tau2, s->vx1, s->vx2, s->xls, s->xre, s->yls, s->yre);
+
+        Delloc3D(tau);
+        Delloc3D(tau1);
+        Delloc3D(tau2);
+    }
+
+    num_bytes = sizeof(float)*(s->nxt+4+8*loop)*(s->nyt+4+8*loop)*(s->nzt+2*align);
+    if(!s->CPU)
+    {
+       // the host media are staging only, freed once drminit has read them, see below
+       if(s->rank==0) printf("Allocate device media pointers and copy.\n");
+       cudaMalloc((void**)&s->d_d1, num_bytes);
+       cudaMemcpy(s->d_d1,&s->d1[0][0][0],num_bytes,cudaMemcpyHostToDevice);
+       cudaMalloc((void**)&s->d_lam, num_bytes);
+       cudaMemcpy(s->d_lam,&s->lam[0][0][0],num_bytes,cudaMemcpyHostToDevice);
+       cudaMalloc((void**)&s->d_mu, num_bytes);
+       cudaMemcpy(s->d_mu,&s->mu[0][0][0],num_bytes,cudaMemcpyHostToDevice);
+       cudaMalloc((void**)&s->d_qp, num_bytes);
+       cudaMemcpy(s->d_qp,&s->qp[0][0][0],num_bytes,cudaMemcpyHostToDevice);
+       cudaMalloc((void**)&s->d_qs, num_bytes);
+       cudaMemcpy(s->d_qs,&s->qs[0][0][0],num_bytes,cudaMemcpyHostToDevice);
+       cudaMalloc((void**)&s->d_vx1, num_bytes);
+       cudaMemcpy(s->d_vx1,&s->vx1[0][0][0],num_bytes,cudaMemcpyHostToDevice);
+       cudaMalloc((void**)&s->d_vx2, num_bytes);
+       cudaMemcpy(s->d_vx2,&s->vx2[0][0][0],num_bytes,cudaMemcpyHostToDevice);
+       BindArrayToTexture(s->d_vx1, s->d_vx2, num_bytes);
+       if(s->NPC==0)
+       {
+          num_bytes = sizeof(float)*(s->nxt+4+8*loop);
+          cudaMalloc((void**)&s->d_dcrjx, num_bytes);
+          cudaMemcpy(s->d_dcrjx,s->dcrjx,num_bytes,cudaMemcpyHostToDevice);
+          num_bytes = sizeof(float)*(s->nyt+4+8*loop);
+          cudaMalloc((void**)&s->d_dcrjy, num_bytes);
+          cudaMemcpy(s->d_dcrjy,s->dcrjy,num_bytes,cudaMemcpyHostToDevice);
+          num_bytes = sizeof(float)*(s->nzt+2*align);
+          cudaMalloc((void**)&s->d_dcrjz, num_bytes);
+          cudaMemcpy(s->d_dcrjz,s->dcrjz,num_bytes,cudaMemcpyHostToDevice);
+       }
+
+       // velocity and stress start at zero on the device, the host keeps velocity for output only
+       if(s->rank==0) printf("Allocate device velocity and stress pointers.\n");
+       num_bytes = sizeof(float)*(s->nxt+4+8*loop)*(s->nyt+4+8*loop)*(s->nzt+2*align);
+       if(s->rec_n>0 || s->rank==0)
+       {
+          s->u1  = Alloc3D(s->nxt+4+8*loop, s->nyt+4+8*loop, s->nzt+2*align);
+          s->v1  = Alloc3D(s->nxt+4+8*loop, s->nyt+4+8*loop, s->nzt+2*align);
+          s->w1  = Alloc3D(s->nxt+4+8*loop, s->nyt+4+8*loop, s->nzt+2*align);
+       }
+       cudaMalloc((void**)&s->d_u1, num_bytes);
+       cudaMemset(s->d_u1, 0, num_bytes);
+       cudaMalloc((void**)&s->d_v1, num_bytes);
+       cudaMemset(s->d_v1, 0, num_bytes);
+       cudaMalloc((void**)&s->d_w1, num_bytes);
+       cudaMemset(s->d_w1, 0, num_bytes);
+       cudaMalloc((void**)&s->d_xx, num_bytes);
+       cudaMemset(s->d_xx, 0, num_bytes);
+       cudaMalloc((void**)&s->d_yy, num_bytes);
+       cudaMemset(s->d_yy, 0, num_bytes);
+       cudaMalloc((void**)&s->d_zz, num_bytes);
+       cudaMemset(s->d_zz, 0, num_bytes);
+       cudaMalloc((void**)&s->d_xy, num_bytes);
+       cudaMemset(s->d_xy, 0, num_bytes);
+       cudaMalloc((void**)&s->d_xz, num_bytes);
+       cudaMemset(s->d_xz, 0, num_bytes);
+       cudaMalloc((void**)&s->d_yz, num_bytes);
+       cudaMemset(s->d_yz, 0, num_bytes);
+       if(s->NVE==1)
+       {
+          cudaMalloc((void**)&s->d_r1, num_bytes);
+          cudaMemset(s->d_r1, 0, num_bytes);
+          cudaMalloc((void**)&s->d_r2, num_bytes);
+          cudaMemset(s->d_r2, 0, num_bytes);
+          cudaMalloc((void**)&s->d_r3, num_bytes);
+          cudaMemset(s->d_r3, 0, num_bytes);
+          cudaMalloc((void**)&s->d_r4, num_bytes);
+          cudaMemset(s->d_r4, 0, num_bytes);
+          cudaMalloc((void**)&s->d_r5, num_bytes);
+          cudaMemset(s->d_r5, 0, num_bytes);
+          cudaMalloc((void**)&s->d_r6, num_bytes);
+          cudaMemset(s->d_r6, 0, num_bytes);
+       }
+    }
+    else
+    {
+       if(s->rank==0) printf("Allocate host velocity and stress pointers.\n");
+       s->u1  = AllocField();
+       s->v1  = AllocField();
+       s->w1  = AllocField();
+       s->xx  = AllocField();
+       s->yy  = AllocField();
+       s->zz  = AllocField();
+       s->xy  = AllocField();
+       s->yz  = AllocField();
+       s->xz  = AllocField();
+       if(s->NVE==1)
+       {
+          s->r1  = AllocField();
+          s->r2  = AllocField();
+          s->r3  = AllocField();
+          s->r4  = AllocField();
+          s->r5  = AllocField();
+          s->r6  = AllocField();
+       }
+    }
+//  variable initialization ends
+    if(s->rank==0) printf("Allocate buffers of #elements: %d\n",s->rec_n*s->WRITE_STEP);
+    s->Bufx  = Alloc1D(s->rec_n*s->WRITE_STEP);
+    s->Bufy  = Alloc1D(s->rec_n*s->WRITE_STEP);
+    s->Bufz  = Alloc1D(s->rec_n*s->WRITE_STEP);
+    num_bytes = sizeof(float)*3*(4*loop)*(s->nyt+4+8*loop)*(s->nzt+2*align);
+    cudaMallocHost((void**)&s->SL_vel, num_bytes);
+    cudaMallocHost((void**)&s->SR_vel, num_bytes);
+    cudaMallocHost((void**)&s->RL_vel, num_bytes);
+    cudaMallocHost((void**)&s->RR_vel, num_bytes);
+    num_bytes = sizeof(float)*3*(4*loop)*(s->nxt+4+8*loop)*(s->nzt+2*align);
+    cudaMallocHost((void**)&s->SF_vel, num_bytes);
+    cudaMallocHost((void**)&s->SB_vel, num_bytes);
+    cudaMallocHost((void**)&s->RF_vel, num_bytes);
+    cudaMallocHost((void**)&s->RB_vel, num_bytes);
+    num_bytes = sizeof(float)*(4*loop)*(s->nxt+4+8*loop)*(s->nzt+2*align);
+    cudaMalloc((void**)&s->d_f_u1, num_bytes);
+    cudaMalloc((void**)&s->d_f_v1, num_bytes);
+    cudaMalloc((void**)&s->d_f_w1, num_bytes);
+    cudaMalloc((void**)&s->d_b_u1, num_bytes);
+    cudaMalloc((void**)&s->d_b_v1, num_bytes);
+    cudaMalloc((void**)&s->d_b_w1, num_bytes);
+    // the y kernels fill only the interior, zero the rest sent with the message
+    cudaMemset(s->d_f_u1, 0, num_bytes);
+    cudaMemset(s->d_f_v1, 0, num_bytes);
+    cudaMemset(s->d_f_w1, 0, num_bytes);
+    cudaMemset(s->d_b_u1, 0, num_bytes);
+    cudaMemset(s->d_b_v1, 0, num_bytes);
+    cudaMemset(s->d_b_w1, 0, num_bytes);
+    s->msg_v_size_x = 3*(4*loop)*(s->nyt+4+8*loop)*(s->nzt+2*align);
+    s->msg_v_size_y = 3*(4*loop)*(s->nxt+4+8*loop)*(s->nzt+2*align);
+    if(failed(s, haloinit(s->HALOFMT, s->rank)))
+       return NULL;
+    s->haloopen = (s->HALOFMT>0);
+    if(s->HALOFMT)
+    {
+       s->enc_size_x = halowords(s->msg_v_size_x);
+       s->enc_size_y = halowords(s->msg_v_size_y);
+       num_bytes = sizeof(float)*s->enc_size_x;
+       cudaMallocHost((void**)&s->SL_enc, num_bytes);
+       cudaMallocHost((void**)&s->SR_enc, num_bytes);
+       cudaMallocHost((void**)&s->RL_enc, num_bytes);
+       cudaMallocHost((void**)&s->RR_enc, num_bytes);
+       num_bytes = sizeof(float)*s->enc_size_y;
+       cudaMallocHost((void**)&s->SF_enc, num_bytes);
+       cudaMallocHost((void**)&s->SB_enc, num_bytes);
+       cudaMallocHost((void**)&s->RF_enc, num_bytes);
+       cudaMallocHost((void**)&s->RB_enc, num_bytes);
+    }
+    SetDeviceConstValue(s->DH, s->DT, s->nxt, s->nyt, s->nzt, s->FDCOEF);
+    if(s->rank==0) printf("FD order %d, %s coefficients\n", FD_ORDER, (s->FDCOEF ? "DRP" : "Taylor"));
+
+    s->source_step = 1;
+    if(s->rank==s->srcproc)
+    {
+       logrank(LV_DETAIL, "add initial src");
+       if(s->SRCDT>0.0)
+       {
+          float c[4];
+          i = srcweights(0, s->DT, s->SRCDT, s->SRCINTERP, c);
+          if(s->CPU)
+             addsrci(i, c, s->DH, s->DT, s->npsrc, s->srchs, maxdim, s->tpsrc, s->taxx, s->tayy, s->tazz, s->taxz, s->tayz, s->taxy,
+                     s->xx, s->yy, s->zz, s->xy, s->yz, s->xz);
+          else
+             addsrci_H(i, c, s->srcgw+3, maxdim, s->d_tpsrc, s->npsrc, 0, s->d_taxx, s->d_tayy, s->d_tazz, s->d_taxz, s->d_tayz, s->d_taxy,
+                       s->d_xx, s->d_yy, s->d_zz, s->d_xy, s->d_yz, s->d_xz);
+       }
+       else if(s->CPU)
+          addsrc(s->source_step, s->DH, s->DT, s->NST, s->npsrc, s->READ_STEP, maxdim, s->tpsrc, s->taxx, s->tayy, s->tazz, s->taxz, s->tayz, s->taxy,
+                 s->xx, s->yy, s->zz, s->xy, s->yz, s->xz);
+       else
+          addsrc_H(s->source_step, s->READ_STEP_GPU, maxdim, s->d_tpsrc, s->npsrc, 0, s->d_taxx, s->d_tayy, s->d_tazz, s->d_taxz, s->d_tayz, s->d_taxy,
+                   s->d_xx, s->d_yy, s->d_zz, s->d_xy, s->d_yz, s->d_xz);
+    }
+    if(s->CPU)
+    {
+       // edge planes are computed before the fused sweep, see below
+       if(s->nxt<12*loop)
+          logrank(LV_ERROR, "host kernels need nxt >= %d, nxt=%d", 12*loop, s->nxt);
+       if(failed(s, s->nxt<12*loop))
+          return NULL;
+       SetHostConstValue(s->DH, s->DT, s->nxt, s->nyt, s->nzt, s->FDCOEF);
+       i = SetHostTiles(s->CPUTILE);
+       if(s->rank==0) printf("host kernels: %d x %d column tiles\n", i, i);
+       BindHostArrays(s->u1, s->v1, s->w1, s->xx, s->yy, s->zz, s->xy, s->xz, s->yz, s->r1, s->r2, s->r3, s->r4, s->r5, s->r6, s->d1,
+                      s->lam, s->mu, s->qp, s->qs, s->vx1, s->vx2, s->lam_mu, s->dcrjx, s->dcrjy, s->dcrjz);
+    }
+    // domain reduction: boundary wavefield recording and/or injection
+    if(s->DRMREC[0] || s->DRMIN[0])
+    {
+       // a failing drminit leaves files and buffers for drmclose
+       s->drmopen = 1;
+       if(failed(s, drminit(s->DRMREC, s->DRMIN, s->DRMBOX, s->DRMORIGIN, s->DRMSKIP, s->CPU, s->rank, s->coord, s->MCW, s->NX, s->NY, s->ND,
+                  s->nxt, s->nyt, s->nzt, s->DH, s->DT, s->FDCOEF, s->xls, s->xre, s->yls, s->yre,
+                  s->d1, s->mu, s->lam, s->qp, s->qs, s->vx1, s->lam_mu, s->dcrjx, s->dcrjy, s->dcrjz)))
+          return NULL;
+       if(s->CPU)
+       {
+          s->drmfld[0]  = &s->u1[0][0][0];  s->drmfld[1]  = &s->v1[0][0][0];  s->drmfld[2]  = &s->w1[0][0][0];
+          s->drmfld[3]  = &s->xx[0][0][0];  s->drmfld[4]  = &s->yy[0][0][0];  s->drmfld[5]  = &s->zz[0][0][0];
+          s->drmfld[6]  = &s->xy[0][0][0];  s->drmfld[7]  = &s->xz[0][0][0];  s->drmfld[8]  = &s->yz[0][0][0];
+          s->drmfld[9]  = &s->r1[0][0][0];  s->drmfld[10] = &s->r2[0][0][0];  s->drmfld[11] = &s->r3[0][0][0];
+          s->drmfld[12] = &s->r4[0][0][0];  s->drmfld[13] = &s->r5[0][0][0];  s->drmfld[14] = &s->r6[0][0][0];
+       }
+       else
+       {
+          s->drmfld[0]  = s->d_u1;  s->drmfld[1]  = s->d_v1;  s->drmfld[2]  = s->d_w1;
+          s->drmfld[3]  = s->d_xx;  s->drmfld[4]  = s->d_yy;  s->drmfld[5]  = s->d_zz;
+          s->drmfld[6]  = s->d_xy;  s->drmfld[7]  = s->d_xz;  s->drmfld[8]  = s->d_yz;
+          s->drmfld[9]  = s->d_r1;  s->drmfld[10] = s->d_r2;  s->drmfld[11] = s->d_r3;
+          s->drmfld[12] = s->d_r4;  s->drmfld[13] = s->d_r5;  s->drmfld[14] = s->d_r6;
+       }
+    }
+    // the device holds the media from here on
+    if(!s->CPU)
+    {
+       Delloc3D(s->d1);      s->d1     = NULL;
+       Delloc3D(s->mu);      s->mu     = NULL;
+       Delloc3D(s->lam);     s->lam    = NULL;
+       Delloc3D(s->lam_mu);  s->lam_mu = NULL;
+       Delloc3D(s->qp);      s->qp     = NULL;
+       Delloc3D(s->qs);      s->qs     = NULL;
+       Delloc3D(s->vx1);     s->vx1    = NULL;
+       Delloc3D(s->vx2);     s->vx2    = NULL;
+    }
+    // health monitor and the ENDTOL criterion
+    if(s->MONITOR>0 || s->ENDTOL>0.0)
+    {
+       if(failed(s, moninit(s->MONITOR, s->MONACTION, s->MONGROW, s->HEARTBEAT, s->CPU, s->rank, s->MCW,
+                  s->nxt, s->nyt, s->nzt, s->DH, s->nt, s->NST)))
+          return NULL;
+       s->monopen = 1;
+       if(s->CPU)
+       {
+          s->monfld[0] = &s->u1[0][0][0];  s->monfld[1] = &s->v1[0][0][0];
+          s->monfld[2] = &s->w1[0][0][0];  s->monfld[3] = &s->d1[0][0][0];
+       }
+       else
+       {
+          s->monfld[0] = s->d_u1;  s->monfld[1] = s->d_v1;
+          s->monfld[2] = s->d_w1;  s->monfld[3] = s->d_d1;
+       }
+    }
+    if(s->ENDTOL>0.0)
+    {
+       int box[6] = {1, 0, 1, 0, 1, 0};
+       if(s->rec_n>0)
+       {
+          box[0] = 2+4*loop+s->rec_nbgx;          box[1] = 2+4*loop+s->rec_nedx;
+          box[2] = 2+4*loop+s->rec_nbgy;          box[3] = 2+4*loop+s->rec_nedy;
+          box[4] = s->nzt+align-1-s->rec_nedz;    box[5] = s->nzt+align-1-s->rec_nbgz;
+       }
+       s->endevery = endinit(s->ENDTOL, s->ENDWIN, s->ENDMODE, box);
+       if(failed(s, s->endevery<0))
+          return NULL;
+    }
+    // in-situ surface movie frames
+    if(s->FRAMES>0)
+    {
+       if(failed(s, frameinit(s->FRAMESKIP, s->FRAMEVMAX, s->FRAMEFMT, s->FRAMEOUT, s->CPU, s->rank, s->size, s->MCW,
+                    s->coord, s->NX, s->NY, s->nxt, s->nyt, s->nzt)))
+          return NULL;
+       s->frameopen = 1;
+    }
+    cudaStreamCreate(&s->stream_1);
+    cudaStreamCreate(&s->stream_2);
+    cudaStreamCreate(&s->stream_i);
+
+    if(s->rank==0)
+      s->fchk = fopen(s->CHKFILE,"a+");
+    LAP(s->tstartup, ST_FIELDS, t);
+    s->tstartup[ST_TOTAL] = t-t0;
+    MPI_Reduce(s->tstartup, tst, 5, MPI_DOUBLE, MPI_MAX, 0, s->MCW);
+    if(s->rank==0)
+      printf("Startup time max: source=%e media=%e fields=%e other=%e total=%e secs\n",
+             tst[ST_SOURCE], tst[ST_MEDIA], tst[ST_FIELDS], tst[ST_SETUP], tst[ST_TOTAL]);
+    s->cur_step = 1;
+    s->ready    = 1;
+    return s;
+}
+
+// posts the halo receives of both directions, of encoded messages with HALOFMT
+static void recvpost(pmcl3d_sim *s)
+{
+    if(s->HALOFMT)
+    {
+       PostRecvMsg_Y(s->RF_enc, s->RB_enc, s->MCW, s->request_y, &s->count_y, s->enc_size_y, s->y_rank_F, s->y_rank_B);
+       PostRecvMsg_X(s->RL_enc, s->RR_enc, s->MCW, s->request_x, &s->count_x, s->enc_size_x, s->x_rank_L, s->x_rank_R);
+    }
+    else
+    {
+       PostRecvMsg_Y(s->RF_vel, s->RB_vel, s->MCW, s->request_y, &s->count_y, s->msg_v_size_y, s->y_rank_F, s->y_rank_B);
+       PostRecvMsg_X(s->RL_vel, s->RR_vel, s->MCW, s->request_x, &s->count_x, s->msg_v_size_x, s->x_rank_L, s->x_rank_R);
+    }
+    return;
+}
+
+static void sendy(pmcl3d_sim *s)
+{
+    if(s->HALOFMT)
+    {
+       if(s->y_rank_F>=0) haloenc(s->SF_vel, s->SF_enc, s->msg_v_size_y);
+       if(s->y_rank_B>=0) haloenc(s->SB_vel, s->SB_enc, s->msg_v_size_y);
+       PostSendMsg_Y(s->SF_enc, s->SB_enc, s->MCW, s->request_y, &s->count_y, s->enc_size_y, s->y_rank_F, s->y_rank_B, s->rank, Both);
+    }
+    else
+       PostSendMsg_Y(s->SF_vel, s->SB_vel, s->MCW, s->request_y, &s->count_y, s->msg_v_size_y, s->y_rank_F, s->y_rank_B, s->rank, Both);
+    return;
+}
+
+static void sendx(pmcl3d_sim *s)
+{
+    if(s->HALOFMT)
+    {
+       if(s->x_rank_L>=0) haloenc(s->SL_vel, s->SL_enc, s->msg_v_size_x);
+       if(s->x_rank_R>=0) haloenc(s->SR_vel, s->SR_enc, s->msg_v_size_x);
+       PostSendMsg_X(s->SL_enc, s->SR_enc, s->MCW, s->request_x, &s->count_x, s->enc_size_x, s->x_rank_L, s->x_rank_R, s->rank, Both);
+    }
+    else
+       PostSendMsg_X(s->SL_vel, s->SR_vel, s->MCW, s->request_x, &s->count_x, s->msg_v_size_x, s->x_rank_L, s->x_rank_R, s->rank, Both);
+    return;
+}
+
+static void waity(pmcl3d_sim *s)
+{
+    MPI_Status status_y[4];
+
+    MPI_Waitall(s->count_y, s->request_y, status_y);
+    if(s->HALOFMT)
+    {
+       if(s->y_rank_F>=0) halodec(s->RF_enc, s->RF_vel, s->msg_v_size_y);
+       if(s->y_rank_B>=0) halodec(s->RB_enc, s->RB_vel, s->msg_v_size_y);
+    }
+    return;
+}
+
+static void waitx(pmcl3d_sim *s)
+{
+    MPI_Status status_x[4];
+
+    MPI_Waitall(s->count_x, s->request_x, status_x);
+    if(s->HALOFMT)
+    {
+       if(s->x_rank_L>=0) halodec(s->RL_enc, s->RL_vel, s->msg_v_size_x);
+       if(s->x_rank_R>=0) halodec(s->RR_enc, s->RR_vel, s->msg_v_size_x);
+    }
+    return;
+}
+
+int pmcl3d_step(pmcl3d_sim *s)
+{
+    int   i, j, k;
+    long int idtmp, tmpInd, num_bytes;
+    double t;
+    cudaError_t cerr;
+
+    // the time loop only runs with the sponge and anelastic attenuation
+    if(!s->ready || s->stopped || s->NPC!=0 || s->NVE!=1 || s->cur_step>s->nt)
+       return 0;
+
+    s->time_un -= gethrtime();
+    //no overlapping because there is source input
+    if(s->rank==0){
+       printf("Time Step =                   %ld    OF  Total Timesteps = %ld\n", s->cur_step, s->nt);
+       if(s->cur_step==100 || s->cur_step%1000==0)
+         printf("Time per timestep:\t%lf seconds\n",(gethrtime()+s->time_un)/s->cur_step);
+    }
+    cerr = cudaGetLastError();
+    if(cerr!=cudaSuccess) logrank(LV_ERROR, "CUDA ERROR! before timestep: %s", cudaGetErrorString(cerr));
+    //pre-post MPI Message
+    t = gethrtime();
+    recvpost(s);
+    PHASE(s, PH_HALO, t);
+    if(s->CPU)
+    {
+       //velocity in the y boundary lines, straight into the message buffers
+       dvelcy_C(s->yfs, s->yfe, s->SF_vel, s->SF_vel+s->msg_v_size_y/3, s->SF_vel+2*(s->msg_v_size_y/3), s->y_rank_F);
+       dvelcy_C(s->ybs, s->ybe, s->SB_vel, s->SB_vel+s->msg_v_size_y/3, s->SB_vel+2*(s->msg_v_size_y/3), s->y_rank_B);
+       PHASE(s, PH_COMP, t);
+       sendy(s);
+       waity(s);
+       update_bound_y_C(s->RF_vel, s->RB_vel, s->y_rank_F, s->y_rank_B);
+       PHASE(s, PH_HALO, t);
+       //velocity in the planes sent in x, then the fused sweep overlaps the x communication
+       dvelcx_C(s->xvs, s->xvs+4*loop-1);
+       dvelcx_C(s->xve-4*loop+1, s->xve);
+       PHASE(s, PH_COMP, t);
+       Cpy2Buf_VX_C(s->SL_vel, s->x_rank_L, Left);
+       Cpy2Buf_VX_C(s->SR_vel, s->x_rank_R, Right);
+       sendx(s);
+       PHASE(s, PH_HALO, t);
+       fstep_C(s->xvs+4*loop, s->xve-4*loop, s->yls, s->yre, s->NX, s->coord[0], s->coord[1]);
+       PHASE(s, PH_COMP, t);
+       waitx(s);
+       Cpy2Grid_VX_C(s->RL_vel, s->RR_vel, s->x_rank_L, s->x_rank_R);
+       PHASE(s, PH_HALO, t);
+       //stress in the planes next to the x halos
+       dstrqc_C(s->xls, s->xvs+4*loop-reach-1, s->yls, s->yre, s->NX, s->coord[0], s->coord[1]);
+       dstrqc_C(s->xve-4*loop+reach+1, s->xre, s->yls, s->yre, s->NX, s->coord[0], s->coord[1]);
+       if(s->rank==s->srcproc && s->cur_step<s->NST && s->SRCDT>0.0)
+       {
+          float c[4];
+          i = srcweights(s->cur_step, s->DT, s->SRCDT, s->SRCINTERP, c);
+          addsrci(i, c, s->DH, s->DT, s->npsrc, s->srchs, maxdim, s->tpsrc, s->taxx, s->tayy, s->tazz, s->taxz, s->tayz, s->taxy,
+                  s->xx, s->yy, s->zz, s->xy, s->yz, s->xz);
+       }
+       else if(s->rank==s->srcproc && s->cur_step<s->NST)
+          addsrc(s->cur_step%s->READ_STEP+1, s->DH, s->DT, s->NST, s->npsrc, s->READ_STEP, maxdim, s->tpsrc, s->taxx, s->tayy, s->tazz, s->taxz, s->tayz, s->taxy,
+                 s->xx, s->yy, s->zz, s->xy, s->yz, s->xz);
+       PHASE(s, PH_COMP, t);
+    }
+    else
+    {
+       //velocity computation in y boundary, two ghost cell regions
+       dvelcy_H(s->d_u1, s->d_v1, s->d_w1, s->d_xx,   s->d_yy,   s->d_zz,   s->d_xy,       s->d_xz, s->d_yz, s->d_dcrjx, s->d_dcrjy, s->d_dcrjz,
+                s->d_d1, s->nxt,  s->nzt,  s->d_f_u1, s->d_f_v1, s->d_f_w1, s->stream_i,   s->yfs,  s->yfe, s->y_rank_F);
+       dvelcy_H(s->d_u1, s->d_v1, s->d_w1, s->d_xx,   s->d_yy,   s->d_zz,   s->d_xy,       s->d_xz, s->d_yz, s->d_dcrjx, s->d_dcrjy, s->d_dcrjz,
+                s->d_d1, s->nxt,  s->nzt,  s->d_b_u1, s->d_b_v1, s->d_b_w1, s->stream_i,   s->ybs,  s->ybe, s->y_rank_B);
+       Cpy2Host_VY(s->d_f_u1, s->d_f_v1, s->d_f_w1,  s->SF_vel, s->nxt, s->nzt, s->stream_i, s->y_rank_F);
+       Cpy2Host_VY(s->d_b_u1, s->d_b_v1, s->d_b_w1,  s->SB_vel, s->nxt, s->nzt, s->stream_i, s->y_rank_B);
+       cudaThreadSynchronize();
+       PHASE(s, PH_COMP, t);
+       //velocity communication in y direction
+       sendy(s);
+       waity(s);
+       PHASE(s, PH_HALO, t);
+       Cpy2Device_VY(s->d_u1,     s->d_v1,     s->d_w1,     s->d_f_u1, s->d_f_v1, s->d_f_w1, s->d_b_u1, s->d_b_v1, s->d_b_w1, s->RF_vel, s->RB_vel, s->nxt, s->nyt, s->nzt,
+                     s->stream_i, s->stream_i, s->y_rank_F, s->y_rank_B);
+       //velocity computation whole 3D Grid (nxt, nyt, nzt)
+       dvelcx_H(s->d_u1, s->d_v1, s->d_w1, s->d_xx, s->d_yy, s->d_zz, s->d_xy, s->d_xz, s->d_yz, s->d_dcrjx, s->d_dcrjy, s->d_dcrjz,
+                s->d_d1, s->nyt,  s->nzt,  s->stream_i,   s->xvs,  s->xve);
+       Cpy2Host_VX(s->d_u1, s->d_v1, s->d_w1, s->SL_vel, s->nxt, s->nyt, s->nzt, s->stream_i, s->x_rank_L, Left);
+       Cpy2Host_VX(s->d_u1, s->d_v1, s->d_w1, s->SR_vel, s->nxt, s->nyt, s->nzt, s->stream_i, s->x_rank_R, Right);
+       cudaThreadSynchronize();
+       PHASE(s, PH_COMP, t);
+       //velocity communication in x direction
+       sendx(s);
+       waitx(s);
+       PHASE(s, PH_HALO, t);
+       Cpy2Device_VX(s->d_u1, s->d_v1, s->d_w1, s->RL_vel, s->RR_vel, s->nxt, s->nyt, s->nzt, s->stream_i, s->stream_i, s->x_rank_L, s->x_rank_R);
+       //stress computation whole 3D Grid (nxt+4, nyt+4, nzt)
+       dstrqc_H(s->d_xx, s->d_yy, s->d_zz, s->d_xy,    s->d_xz,    s->d_yz,    s->d_r1, s->d_r2, s->d_r3,     s->d_r4,     s->d_r5, s->d_r6,     s->d_u1, s->d_v1, s->d_w1, s->d_lam,
+                s->d_mu, s->d_qp, s->d_qs, s->d_dcrjx, s->d_dcrjy, s->d_dcrjz, s->nyt,  s->nzt,  s->stream_i, s->d_lam_mu, s->NX,   s->coord[0], s->coord[1],   s->xls,  s->xre,
+                s->yls,  s->yre);
+       //update source input
+       if(s->rank==s->srcproc && s->cur_step<s->NST && s->SRCDT>0.0)
+       {
+          float c[4];
+          i = srcweights(s->cur_step, s->DT, s->SRCDT, s->SRCINTERP, c);
+          // next window of the coarse source
+          if(i/s->srcgw != s->srcwin)
+          {
+             s->srcwin = i/s->srcgw;
+             Cpy2Device_srcwin(s->npsrc, s->srcgw+3, s->srchs, s->srcwin*s->srcgw, s->taxx, s->tayy, s->tazz, s->taxz, s->tayz, s->taxy,
+                               s->d_taxx, s->d_tayy, s->d_tazz, s->d_taxz, s->d_tayz, s->d_taxy);
+          }
+          addsrci_H(i-s->srcwin*s->srcgw, c, s->srcgw+3, maxdim, s->d_tpsrc, s->npsrc, s->stream_i, s->d_taxx, s->d_tayy, s->d_tazz, s->d_taxz, s->d_tayz, s->d_taxy,
+                    s->d_xx,       s->d_yy,      s->d_zz,   s->d_xy,    s->d_yz,  s->d_xz);
+       }
+       else if(s->rank==s->srcproc && s->cur_step<s->NST)
+       {
+          ++s->source_step;
+          addsrc_H(s->source_step, s->READ_STEP_GPU, maxdim, s->d_tpsrc, s->npsrc, s->stream_i, s->d_taxx, s->d_tayy, s->d_tazz, s->d_taxz, s->d_tayz, s->d_taxy,
+                   s->d_xx,       s->d_yy,      s->d_zz,   s->d_xy,    s->d_yz,  s->d_xz);
+       }
+       cudaThreadSynchronize();
+       PHASE(s, PH_COMP, t);
+    }
+    //boundary wavefield after the stress update
+    if(s->DRMREC[0] || s->DRMIN[0])
+    {
+       drmstep(s->cur_step, s->drmfld);
+       PHASE(s, PH_IO, t);
+    }
+    //library callbacks on the new velocity
+    if(s->stafn && s->nstaloc>0)
+       stations(s);
+    if(s->peakfn)
+       peak(s);
+    if(s->FRAMES>0 && s->cur_step%s->FRAMES==0)
+    {
+       t = gethrtime();
+       if(s->CPU)
+          framestep(s->cur_step, &s->u1[0][0][0], &s->v1[0][0][0], &s->w1[0][0][0]);
+       else
+          framestep(s->cur_step, s->d_u1, s->d_v1, s->d_w1);
+       PHASE(s, PH_IO, t);
+    }
+
+    t = gethrtime();
+    if(s->cur_step%s->NTISKP == 0){
+     num_bytes = sizeof(float)*(s->nxt+4+8*loop)*(s->nyt+4+8*loop)*(s->nzt+2*align);
+     if(!s->CPU && (s->rec_n>0 || s->rank==0))
+     {
+       cudaMemcpy(&s->u1[0][0][0],s->d_u1,num_bytes,cudaMemcpyDeviceToHost);
+       cudaMemcpy(&s->v1[0][0][0],s->d_v1,num_bytes,cudaMemcpyDeviceToHost);
+       cudaMemcpy(&s->w1[0][0][0],s->d_w1,num_bytes,cudaMemcpyDeviceToHost);
+     }
+     idtmp = ((s->cur_step/s->NTISKP+s->WRITE_STEP-1)%s->WRITE_STEP);
+     idtmp = idtmp*s->rec_n;
+     tmpInd = idtmp;
+     //if(rank==0) printf("idtmp=%ld\n", idtmp);
+     if(s->MASK[0])
+     {
+       for(i=0;i<s->nmask;i++)
+       {
+         s->Bufx[tmpInd] = (&s->u1[0][0][0])[s->mask_pos[i]];
+         s->Bufy[tmpInd] = (&s->v1[0][0][0])[s->mask_pos[i]];
+         s->Bufz[tmpInd] = (&s->w1[0][0][0])[s->mask_pos[i]];
+         tmpInd++;
+       }
+     }
+     else if(s->rec_n>0)
+     // surface: k=nzt+align-1;
+     for(k=s->nzt+align-1 - s->rec_nbgz; k>=s->nzt+align-1 - s->rec_nedz; k=k-s->NSKPZ)
+       for(j=2+4*loop + s->rec_nbgy; j<=2+4*loop + s->rec_nedy; j=j+s->NSKPY)
+         for(i=2+4*loop + s->rec_nbgx; i<=2+4*loop + s->rec_nedx; i=i+s->NSKPX)
+         {
+           //idx = (i-2-4*loop)/NSKPX;
+           //idy = (j-2-4*loop)/NSKPY;
+           //idz = ((nzt+align-1) - k)/NSKPZ;
+           //tmpInd = idtmp + idz*rec_nxt*rec_nyt + idy*rec_nxt + idx;
+           //if(rank==0) printf("%ld:%d,%d,%d\t",tmpInd,i,j,k);
+           s->Bufx[tmpInd] = s->u1[i][j][k];
+           s->Bufy[tmpInd] = s->v1[i][j][k];
+           s->Bufz[tmpInd] = s->w1[i][j][k];
+           tmpInd++;
+         }
+     if((s->cur_step/s->NTISKP)%s->WRITE_STEP == 0 && s->rec_n>0)
+       writebatch(s, s->WRITE_STEP);
+     //else
+       //cudaThreadSynchronize();
+     // write-statistics to chk file:
+     if(s->rank==0){
+       i = s->ND+2+4*loop;
+       j = i;
+       k = s->nzt+align-1-s->ND;
+       fprintf(s->fchk,"%ld :\t%e\t%e\t%e\n",s->cur_step,s->u1[i][j][k],s->v1[i][j][k],s->w1[i][j][k]);
+       fflush(s->fchk);
+     }
+    }
+    //else
+     //cudaThreadSynchronize();
+
+     if((s->cur_step<s->NST-1) && (s->IFAULT == 2) && (s->SRCDT<=0.0) && ((s->cur_step+1)%s->READ_STEP_GPU == 0) && (s->rank==s->srcproc)){
+       logrank(LV_DEBUG, "Read new source from CPU.");
+       if((s->cur_step+1)%s->READ_STEP == 0){
+         logrank(LV_DEBUG, "Read new source from file.");
+         read_src_ifault_2(s->rank, s->READ_STEP,
+           s->INSRC, s->INSRC_I2,
+           maxdim, s->coord, s->NZ,
+           s->nxt, s->nyt, s->nzt,
+           &s->npsrc, &s->srcproc,
+           &s->tpsrc, &s->taxx, &s->tayy, &s->tazz,
+           &s->taxz, &s->tayz, &s->taxy, (s->cur_step+1)/s->READ_STEP+1);
+       }
+       logrank(LV_DEBUG, "SOURCE: taxx,xy,xz:%e,%e,%e",
+           s->taxx[s->cur_step%s->READ_STEP],s->taxy[s->cur_step%s->READ_STEP],s->taxz[s->cur_step%s->READ_STEP]);
+       // Synchronous copy!
+       if(!s->CPU)
+         Cpy2Device_source(s->npsrc, s->READ_STEP_GPU,
+           ((s->cur_step+1)%s->READ_STEP),
+           s->taxx, s->tayy, s->tazz,
+           s->taxz, s->tayz, s->taxy,
+           s->d_taxx, s->d_tayy, s->d_tazz,
+           s->d_taxz, s->d_tayz, s->d_taxy);
+       s->source_step = 0;
+     }
+    PHASE(s, PH_IO, t);
+    /*
+     if((cur_step<NST) && (cur_step%25==0) && (rank==srcproc)){
+       printf("%d) SOURCE: taxx,xy,xz:%e,%e,%e\n",rank,
+           taxx[cur_step],taxy[cur_step],taxz[cur_step]);
+     }*/
+
+    if(s->MONITOR>0 && s->cur_step%s->MONITOR==0)
+       s->stopped = monstep(s->cur_step, s->monfld[0], s->monfld[1], s->monfld[2], s->monfld[3],
+                          s->tphase[PH_COMP]);
+    if(s->ENDTOL>0.0 && !s->stopped && s->cur_step%s->endevery==0 &&
+       endstep(s->cur_step, s->monfld[0], s->monfld[1], s->monfld[2], s->monfld[3]))
+    {
+       if(s->rank==0) fprintf(s->fchk, "RUN ENDED BY ENDTOL AT TIME STEP:\t%ld\n", s->cur_step);
+       s->nt    = s->cur_step;
+       s->ended = 1;
+    }
+    // ended early: write the part of the output batch collected so far
+    i = (s->cur_step/s->NTISKP)%s->WRITE_STEP;
+    if((s->stopped || s->ended) && i>0 && s->rec_n>0)
+    {
+       t = gethrtime();
+       writebatch(s, i);
+       PHASE(s, PH_IO, t);
+    }
+    if(s->cur_step==s->nt || s->stopped)
+    {
+       endrecord(s, (s->stopped || s->ended) ? i : 0);
+       if(s->peakfn)
+         peakmap(s, s->cur_step);
+    }
+
+    s->time_un += gethrtime();
+    s->cur_step++;
+    return 1;
+}
+
+long pmcl3d_run(pmcl3d_sim *s, long nsteps)
+{
+    long n = 0;
+
+    while((nsteps<=0 || n<nsteps) && pmcl3d_step(s))
+       n++;
+    return n;
+}
+
+long pmcl3d_current_step(pmcl3d_sim *s)
+{
+    return s->cur_step-1;
+}
+
+long pmcl3d_total_steps(pmcl3d_sim *s)
+{
+    return s->nt;
+}
+
+void pmcl3d_destroy(pmcl3d_sim *s)
+{
+    double   GFLOPS = 1.0;
+    double   GFLOPS_SUM = 0.0;
+    double   tph[4], tmax[4], tavg[4];
+    long     nstep;
+
+    // output hints benchmark only
+    if(!s->ready)
+    {
+       release(s);
+       return;
+    }
+
+    // a run left before its last time step still gets its peak map
+    if(s->peakfn && s->pgv && !s->peaked)
+       peakmap(s, s->cur_step-1);
+    if(s->rank==0){
+      fprintf(s->fchk,"END\n");
+      fclose(s->fchk);
+    }
+    closemods(s, s->stopped);
+
+    cudaStreamDestroy(s->stream_1);
+    cudaStreamDestroy(s->stream_2);
+    cudaStreamDestroy(s->stream_i);
+    GFLOPS  = 1.0;
+    GFLOPS  = GFLOPS*307.0*(s->xre - s->xls)*(s->yre-s->yls)*s->nzt;
+    GFLOPS  = GFLOPS/(1000*1000*1000);
+    // per time step actually run, ENDTOL and monitor stops included
+    nstep   = pmcl3d_current_step(s);
+    if(nstep<1) nstep = 1;
+    s->time_un = s->time_un/nstep;
+    GFLOPS  = GFLOPS/s->time_un;
+    MPI_Allreduce( &GFLOPS, &GFLOPS_SUM, 1, MPI_DOUBLE, MPI_SUM, s->MCW );
+    // per-phase seconds per timestep, other is what the timed phases leave of the step
+    tph[0] = s->tphase[PH_COMP]/nstep;
+    tph[1] = s->tphase[PH_HALO]/nstep;
+    tph[2] = s->tphase[PH_IO]/nstep;
+    tph[3] = s->time_un-tph[0]-tph[1]-tph[2];
+    MPI_Reduce(tph, tmax, 4, MPI_DOUBLE, MPI_MAX, 0, s->MCW);
+    MPI_Reduce(tph, tavg, 4, MPI_DOUBLE, MPI_SUM, 0, s->MCW);
+    if(s->rank==0)
+    {
+        printf("GPU benchmark size NX=%d, NY=%d, NZ=%d, ReadStep=%d\n", s->NX, s->NY, s->NZ, s->READ_STEP);
+    	printf("GPU computing flops=%1.18f GFLOPS, time = %1.18f secs per timestep\n", GFLOPS_SUM, s->time_un);
+        printf("Phase time max: compute=%e halo=%e io=%e other=%e secs per timestep\n", tmax[0], tmax[1], tmax[2], tmax[3]);
+        printf("Phase time avg: compute=%e halo=%e io=%e other=%e secs per timestep\n",
+               tavg[0]/s->size, tavg[1]/s->size, tavg[2]/s->size, tavg[3]/s->size);
+    }
+//  Main Loop Ends
+
+    release(s);
+    return;
+}
+
+
+// Calculates recording points for each core
+// rec_nbgxyz rec_nedxyz...
+// WARNING: Assumes NPZ = 1! Only surface outputs are needed!
+void calcRecordingPoints(int *rec_nbgx, int *rec_nedx,
+  int *rec_nbgy, int *rec_nedy, int *rec_nbgz, int *rec_nedz,
+  int *rec_nxt, int *rec_nyt, int *rec_nzt, MPI_Offset *displacement,
+  long int nxt, long int nyt, long int nzt, int rec_NX, int rec_NY, int rec_NZ,
+  int NBGX, int NEDX, int NSKPX, int NBGY, int NEDY, int NSKPY,
+  int NBGZ, int NEDZ, int NSKPZ, int *coord){
+
+  *displacement = 0;
+
+  if(NBGX > nxt*(coord[0]+1))     *rec_nxt = 0;
+  else if(NEDX < nxt*coord[0]+1)  *rec_nxt = 0;
+  else{
+    if(nxt*coord[0] >= NBGX){
+      *rec_nbgx = (nxt*coord[0]+NBGX-1)%NSKPX;
+      *displacement += (nxt*coord[0]-NBGX)/NSKPX+1;
+    }
+    else
+      *rec_nbgx = NBGX-nxt*coord[0]-1;  // since rec_nbgx is 0-based
+    if(nxt*(coord[0]+1) <= NEDX)
+      *rec_nedx = (nxt*(coord[0]+1)+NBGX-1)%NSKPX-NSKPX+nxt;
+    else
+      *rec_nedx = NEDX-nxt*coord[0]-1;
+    *rec_nxt = (*rec_nedx-*rec_nbgx)/NSKPX+1;
+  }
+
+  if(NBGY > nyt*(coord[1]+1))     *rec_nyt = 0;
+  else if(NEDY < nyt*coord[1]+1)  *rec_nyt = 0;
+  else{
+    if(nyt*coord[1] >= NBGY){
+      *rec_nbgy = (nyt*coord[1]+NBGY-1)%NSKPY;
+      *displacement += ((nyt*coord[1]-NBGY)/NSKPY+1)*rec_NX;
+    }
+    else
+      *rec_nbgy = NBGY-nyt*coord[1]-1;  // since rec_nbgy is 0-based
+    if(nyt*(coord[1]+1) <= NEDY)
+      *rec_nedy = (nyt*(coord[1]+1)+NBGY-1)%NSKPY-NSKPY+nyt;
+    else
+      *rec_nedy = NEDY-nyt*coord[1]-1;
+    *rec_nyt = (*rec_nedy-*rec_nbgy)/NSKPY+1;
+  }
+
+  if(NBGZ > nzt) *rec_nzt = 0;
+  else{
+    *rec_nbgz = NBGZ-1;  // since rec_nbgz is 0-based
+    *rec_nedz = NEDZ-1;
+    *rec_nzt = (*rec_nedz-*rec_nbgz)/NSKPZ+1;
+  }
+
+  if(*rec_nxt == 0 || *rec_nyt == 0 || *rec_nzt == 0){
+    *rec_nxt = 0;
+    *rec_nyt = 0;
+    *rec_nzt = 0;
+  }
+
+  // displacement assumes NPZ=1!
+  *displacement *= sizeof(float);
+
+  return;
+}
@@ -0,0 +1,115 @@
+/**
+@section LICENSE
+Copyright (c) 2013-2016, Regents of the University of California
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+********************************************************************************
+* sink.c                                                                       *
+* streams the output batches to a local consumer over a Unix domain socket     *
+*                                                                              *
+* Each rank with recording points opens one connection to the socket SINK.     *
+* Writes block while the consumer is behind, so a slow consumer throttles      *
+* the run instead of losing batches.                                           *
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "pmcl3d.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static int sendall(int fd, void *buf, long nbytes)
+{
+  char *p = (char *)buf;
+  long  n;
+
+  while(nbytes>0)
+  {
+     n = send(fd, p, nbytes, MSG_NOSIGNAL);
+     if(n<0)
+     {
+        if(errno==EINTR) continue;
+        return -1;
+     }
+     p      += n;
+     nbytes -= n;
+  }
+  return 0;
+}
+
+int sinkopen(char *SINK, SinkHeader *hello, PosInf mask_gidx)
+{
+  int fd;
+  struct sockaddr_un addr;
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd<0)
+  {
+     printf("%d) can't create output sink socket\n", hello->rank);
+     return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, SINK, sizeof(addr.sun_path)-1);
+  if(connect(fd, (struct sockaddr *)&addr, sizeof(addr))<0)
+  {
+     printf("%d) can't connect to output sink %s\n", hello->rank, SINK);
+     close(fd);
+     return -1;
+  }
+  hello->magic = SINK_MAGIC;
+  hello->type  = SINK_HELLO;
+  hello->count = hello->nmask;
+  if(sendall(fd, hello, sizeof(SinkHeader)) ||
+     (hello->nmask>0 && sendall(fd, mask_gidx, sizeof(int)*hello->nmask)))
+  {
+     printf("%d) output sink %s closed\n", hello->rank, SINK);
+     close(fd);
+     return -1;
+  }
+  return fd;
+}
+
+int sinkwrite(int fd, SinkHeader *hello, int var, long step, float *buf, long count)
+{
+  SinkHeader hdr = *hello;
+
+  hdr.type  = SINK_BATCH;
+  hdr.var   = var;
+  hdr.step  = step;
+  hdr.count = count;
+  if(sendall(fd, &hdr, sizeof(SinkHeader)) || sendall(fd, buf, sizeof(float)*count))
+  {
+     printf("%d) output sink closed at step %ld\n", hello->rank, step);
+     return -1;
+  }
+  return 0;
+}
+
+void sinkclose(int fd, SinkHeader *hello)
+{
+  SinkHeader hdr = *hello;
+
+  hdr.type  = SINK_END;
+  hdr.count = 0;
+  sendall(fd, &hdr, sizeof(SinkHeader));
+  close(fd);
+  return;
+}
@@ -0,0 +1,52 @@
+/**
+@section LICENSE
+Copyright (c) 2013-2016, Regents of the University of California
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+ /*
+********************************************************************************
+* sink.h                                                                       *
+* message layout of the output stream, shared by sink.c and sinkreader.cpp     *
+*                                                                              *
+* Every message is a SinkHeader followed by count payload elements:            *
+*  SINK_HELLO  geometry of one rank, payload = nmask ints of file positions    *
+*              (masked output only)                                            *
+*  SINK_BATCH  one variable of one output batch, payload = count floats in     *
+*              the order of Bufx/Bufy/Bufz                                     *
+*  SINK_END    last message of a rank, step = last time step run, no payload   *
+********************************************************************************
+*/
+
+#ifndef _SINK_H
+#define _SINK_H
+
+#define SINK_MAGIC 0x53505741   // "AWPS"
+#define SINK_HELLO 0
+#define SINK_BATCH 1
+#define SINK_END   2
+
+typedef struct {
+  int  magic;
+  int  type;
+  int  rank;
+  int  var;                        // 0,1,2 = X,Y,Z
+  long step;                       // time step the batch is named after
+  long count;                      // payload elements
+  long npts;                       // recording points per time step, all ranks
+  int  nstep;                      // time steps per batch (WRITE_STEP)
+  int  rec_NX, rec_NY, rec_NZ;     // global recording lattice
+  int  rec_nxt, rec_nyt, rec_nzt;  // local block of the lattice
+  int  x0, y0;                     // offset of the local block in the lattice
+  int  nmask;                      // masked points of this rank, 0 if unmasked
+} SinkHeader;
+
+#endif
@@ -0,0 +1,207 @@
+/**
+@section LICENSE
+Copyright (c) 2013-2016, Regents of the University of California
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+********************************************************************************
+* sinkreader.cpp                                                               *
+* reference consumer of the pmcl3d output stream (--SINK)                      *
+*                                                                              *
+* sinkreader <socket> <nranks> [outdir] [delay_ms]                             *
+*                                                                              *
+* Listens on <socket>, accepts one connection per recording rank and           *
+* assembles every batch of every variable. A completed batch is reported on    *
+* stdout and, with [outdir], written as outdir/S{X,Y,Z}%07ld in the same       *
+* layout as the MPI-IO output. [delay_ms] sleeps after every message to        *
+* stand in for a slow consumer.                                                *
+********************************************************************************
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <map>
+#include <utility>
+#include <vector>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+extern "C" {
+#include "sink.h"
+}
+
+struct Batch {
+  std::vector<float> data;
+  int received;
+};
+
+struct Conn {
+  int fd;
+  SinkHeader hello;
+  std::vector<int> gidx;
+};
+
+static int readall(int fd, void *buf, long nbytes)
+{
+  char *p = (char *)buf;
+  long  n;
+
+  while(nbytes>0)
+  {
+     n = read(fd, p, nbytes);
+     if(n<0 && errno==EINTR) continue;
+     if(n<=0) return -1;
+     p      += n;
+     nbytes -= n;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if(argc<3)
+  {
+     printf("Usage: %s <socket> <nranks> [outdir] [delay_ms]\n", argv[0]);
+     return 1;
+  }
+  const char *path  = argv[1];
+  int  nranks       = atoi(argv[2]);
+  const char *odir  = (argc>3 && argv[3][0] ? argv[3] : NULL);
+  int  delay        = (argc>4 ? atoi(argv[4]) : 0);
+  static const char names[] = "XYZ";
+
+  int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+  unlink(path);
+  if(lfd<0 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr))<0 || listen(lfd, nranks)<0)
+  {
+     printf("can't listen on %s\n", path);
+     return 1;
+  }
+  printf("sinkreader: waiting for %d ranks on %s\n", nranks, path);
+  fflush(stdout);
+
+  std::vector<Conn> conns(nranks);
+  for(int i=0;i<nranks;i++)
+  {
+     conns[i].fd = accept(lfd, NULL, NULL);
+     if(conns[i].fd<0 || readall(conns[i].fd, &conns[i].hello, sizeof(SinkHeader)) ||
+        conns[i].hello.magic!=SINK_MAGIC || conns[i].hello.type!=SINK_HELLO)
+     {
+        printf("bad connection %d\n", i);
+        return 1;
+     }
+     conns[i].gidx.resize(conns[i].hello.nmask);
+     if(conns[i].hello.nmask>0 &&
+        readall(conns[i].fd, &conns[i].gidx[0], sizeof(int)*conns[i].hello.nmask))
+     {
+        printf("bad mask index from rank %d\n", conns[i].hello.rank);
+        return 1;
+     }
+  }
+  close(lfd);
+  unlink(path);
+
+  const SinkHeader &g = conns[0].hello;
+  long npts = g.npts;
+  printf("sinkreader: %d ranks connected, %ld points per step, %d steps per batch\n", nranks, npts, g.nstep);
+
+  std::map<std::pair<long,int>, Batch> pending;
+  std::vector<struct pollfd> pfd(nranks);
+  for(int i=0;i<nranks;i++)
+  {
+     pfd[i].fd     = conns[i].fd;
+     pfd[i].events = POLLIN;
+  }
+  int open = nranks;
+  std::vector<float> payload;
+  while(open>0)
+  {
+     if(poll(&pfd[0], nranks, -1)<0)
+     {
+        if(errno==EINTR) continue;
+        break;
+     }
+     for(int i=0;i<nranks;i++)
+     {
+        if(pfd[i].fd<0 || !(pfd[i].revents & (POLLIN|POLLHUP))) continue;
+        SinkHeader hdr;
+        if(readall(pfd[i].fd, &hdr, sizeof(SinkHeader)) || hdr.magic!=SINK_MAGIC || hdr.type==SINK_END)
+        {
+           close(pfd[i].fd);
+           pfd[i].fd = -1;
+           open--;
+           continue;
+        }
+        payload.resize(hdr.count);
+        if(hdr.count>0 && readall(pfd[i].fd, &payload[0], sizeof(float)*hdr.count))
+        {
+           printf("short batch from rank %d\n", hdr.rank);
+           return 1;
+        }
+
+        // scatter into the global batch, file layout: step, z, y, x
+        const Conn &c = conns[i];
+        Batch &b = pending[std::make_pair(hdr.step, hdr.var)];
+        if(b.data.empty())
+        {
+           b.data.assign(npts*hdr.nstep, 0.0f);
+           b.received = 0;
+        }
+        long nloc = hdr.count/hdr.nstep;
+        for(int t=0;t<hdr.nstep;t++)
+        {
+           float *dst = &b.data[t*npts];
+           const float *src = &payload[t*nloc];
+           if(c.hello.nmask>0)
+             for(long p=0;p<nloc;p++) dst[c.gidx[p]] = src[p];
+           else
+             for(int z=0;z<c.hello.rec_nzt;z++)
+               for(int y=0;y<c.hello.rec_nyt;y++)
+                 memcpy(dst + ((long)z*c.hello.rec_NY + c.hello.y0 + y)*c.hello.rec_NX + c.hello.x0,
+                        src + ((long)z*c.hello.rec_nyt + y)*c.hello.rec_nxt, sizeof(float)*c.hello.rec_nxt);
+        }
+
+        if(++b.received==nranks)
+        {
+           float vmax = 0.0f;
+           for(size_t k=0;k<b.data.size();k++)
+             if(fabs(b.data[k])>vmax) vmax = fabs(b.data[k]);
+           printf("step %7ld S%c  max|v| = %e\n", hdr.step, names[hdr.var], vmax);
+           fflush(stdout);
+           if(odir)
+           {
+              char filename[512];
+              snprintf(filename, sizeof(filename), "%s/S%c%07ld", odir, names[hdr.var], hdr.step);
+              FILE *fp = fopen(filename, "wb");
+              if(fp)
+              {
+                 fwrite(&b.data[0], sizeof(float), b.data.size(), fp);
+                 fclose(fp);
+              }
+           }
+           pending.erase(std::make_pair(hdr.step, hdr.var));
+        }
+        if(delay>0) usleep(1000*delay);
+     }
+  }
+  if(!pending.empty()) printf("sinkreader: %d incomplete batches at end of stream\n", (int)pending.size());
+  printf("sinkreader: done\n");
+  return 0;
+}
@@ -13,6 +13,7 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 */
 
 #include <stdio.h>
+#include <math.h>
 #include "pmcl3d.h"
 
 int read_src_ifault_2(int rank, int READ_STEP,
@@ -35,10 +36,10 @@ int read_src_ifault_2(int rank, int READ_STEP,
   // First time entering this function
   if(idx == 1){
     sprintf(fname, "%s%07d", INSRC, rank);
-    printf("SOURCE reading first time: %s\n",fname);
+    logrank(LV_DETAIL, "SOURCE reading first time: %s", fname);
     f = fopen(fname, "rb");
     if(f == NULL){
-      printf("SOURCE %d) no such file: %s\n",rank,fname);
+      logrank(LV_DETAIL, "SOURCE no such file: %s", fname);
       *SRCPROC = -1;
       *NPSRC = 0;
       return 0;
@@ -50,7 +51,7 @@ int read_src_ifault_2(int rank, int READ_STEP,
     fread(NPSRC, sizeof(int), 1, f);
     fread(dummy, sizeof(int), 2, f);
 
-    printf("SOURCE I am, rank=%d npsrc=%d\n",rank,*NPSRC);
+    logrank(LV_DETAIL, "SOURCE I am, npsrc=%d", *NPSRC);
 
     tpsrc = Alloc1P((*NPSRC)*maxdim);
     fread(tpsrc, sizeof(int), (*NPSRC)*maxdim, f);
@@ -68,10 +69,10 @@ int read_src_ifault_2(int rank, int READ_STEP,
   }
   if(*NPSRC > 0){
     sprintf(fname, "%s%07d_%03d", INSRC_I2, rank, idx);
-    printf("SOURCE reading: %s\n",fname);
+    logrank(LV_DETAIL, "SOURCE reading: %s", fname);
     f = fopen(fname, "rb");
     if(f == NULL){
-      printf("ERROR! Rank=%d: Cannot open file: %s\n", rank, fname);
+      logrank(LV_ERROR, "ERROR! Cannot open file: %s", fname);
       return -1;
     }
     // fastest axis in partitioned source is npsrc, then read_step (see source.f)
@@ -135,7 +136,7 @@ int inisource(int      rank,    int     IFAULT, int     NSRC,   int     READ_STE
               MPI_Comm MCW,     int     nxt,    int     nyt,    int     nzt,       int     *coords, int     maxdim,   int    *NPSRC,
               PosInf   *ptpsrc, Grid1D  *ptaxx, Grid1D  *ptayy, Grid1D  *ptazz,    Grid1D  *ptaxz,  Grid1D  *ptayz,   Grid1D *ptaxy, char *INSRC, char *INSRC_I2)
 {
-   int i, j, k, npsrc, srcproc, master=0;
+   int i, j, k, npsrc, srcproc, master=0, nopen;
    int nbx, nex, nby, ney, nbz, nez;
    PosInf tpsrc=NULL, tpsrcp =NULL;
    Grid1D taxx =NULL, tayy   =NULL, tazz =NULL, taxz =NULL, tayz =NULL, taxy =NULL;
@@ -162,11 +163,12 @@ int inisource(int      rank,    int     IFAULT, int     NSRC,   int     READ_STE
       tayz  = Alloc1D(NSRC*READ_STEP);
       taxy  = Alloc1D(NSRC*READ_STEP);
 
+      nopen = 0;
       if(rank==master)
       {
-      	 FILE   *file;
+      	 FILE   *file = NULL;
          int    tmpsrc[3];
-         Grid1D tmpta;
+         Grid1D tmpta = NULL;
          if(IFAULT == 1){
           file = fopen(INSRC,"rb");
           tmpta = Alloc1D(NST*6);
@@ -174,47 +176,64 @@ int inisource(int      rank,    int     IFAULT, int     NSRC,   int     READ_STE
          else if(IFAULT == 0) file = fopen(INSRC,"r");
          if(!file)
          {
-            printf("can't open file %s", INSRC);
-	    return 0;
+            printf("can't open file %s\n", INSRC);
+            Delloc1D(tmpta);
+            nopen = 1;
          }
-         if(IFAULT == 1){
-          for(i=0;i<NSRC;i++)
-          {
-            if(fread(tmpsrc,sizeof(int),3,file) && fread(tmpta,sizeof(float),NST*6,file))
-            {
+         else
+         {
+            if(IFAULT == 1){
+             for(i=0;i<NSRC;i++)
+             {
+               if(fread(tmpsrc,sizeof(int),3,file) && fread(tmpta,sizeof(float),NST*6,file))
+               {
+                  tpsrc[i*maxdim]   = tmpsrc[0];
+                  tpsrc[i*maxdim+1] = tmpsrc[1];
+                  tpsrc[i*maxdim+2] = NZ+1-tmpsrc[2];
+                  for(j=0;j<READ_STEP;j++)
+                  {
+                     taxx[i*READ_STEP+j] = tmpta[j*6];
+                     tayy[i*READ_STEP+j] = tmpta[j*6+1];
+                     tazz[i*READ_STEP+j] = tmpta[j*6+2];
+                     taxz[i*READ_STEP+j] = tmpta[j*6+3];
+                     tayz[i*READ_STEP+j] = tmpta[j*6+4];
+                     taxy[i*READ_STEP+j] = tmpta[j*6+5];
+                  }
+               }
+             }
+             Delloc1D(tmpta);
+            }
+            else if(IFAULT == 0)
+             for(i=0;i<NSRC;i++)
+             {
+               fscanf(file, " %d %d %d ",&tmpsrc[0], &tmpsrc[1], &tmpsrc[2]);
                tpsrc[i*maxdim]   = tmpsrc[0];
                tpsrc[i*maxdim+1] = tmpsrc[1];
                tpsrc[i*maxdim+2] = NZ+1-tmpsrc[2];
-               for(j=0;j<READ_STEP;j++)
-               {
-                  taxx[i*READ_STEP+j] = tmpta[j*6];
-                  tayy[i*READ_STEP+j] = tmpta[j*6+1];
-                  tazz[i*READ_STEP+j] = tmpta[j*6+2];
-                  taxz[i*READ_STEP+j] = tmpta[j*6+3];
-                  tayz[i*READ_STEP+j] = tmpta[j*6+4];
-                  taxy[i*READ_STEP+j] = tmpta[j*6+5];
+               //printf("SOURCE: %d,%d,%d\n",tpsrc[0],tpsrc[1],tpsrc[2]);
+               for(j=0;j<READ_STEP;j++){
+                 fscanf(file, " %f %f %f %f %f %f ",
+                   &taxx[i*READ_STEP+j], &tayy[i*READ_STEP+j],
+                   &tazz[i*READ_STEP+j], &taxz[i*READ_STEP+j],
+                   &tayz[i*READ_STEP+j], &taxy[i*READ_STEP+j]);
+                 //printf("SOURCE VAL %d: %f,%f\n",j,taxx[j],tayy[j]);
                }
-            }
-          }
-          Delloc1D(tmpta);
+             }
+            fclose(file);
          }
-         else if(IFAULT == 0)
-          for(i=0;i<NSRC;i++)
-          {
-            fscanf(file, " %d %d %d ",&tmpsrc[0], &tmpsrc[1], &tmpsrc[2]);
-            tpsrc[i*maxdim]   = tmpsrc[0];
-            tpsrc[i*maxdim+1] = tmpsrc[1];
-            tpsrc[i*maxdim+2] = NZ+1-tmpsrc[2];
-            //printf("SOURCE: %d,%d,%d\n",tpsrc[0],tpsrc[1],tpsrc[2]);
-            for(j=0;j<READ_STEP;j++){
-              fscanf(file, " %f %f %f %f %f %f ",
-                &taxx[i*READ_STEP+j], &tayy[i*READ_STEP+j],
-                &tazz[i*READ_STEP+j], &taxz[i*READ_STEP+j],
-                &tayz[i*READ_STEP+j], &taxy[i*READ_STEP+j]);
-              //printf("SOURCE VAL %d: %f,%f\n",j,taxx[j],tayy[j]);
-            }
-          }
-         fclose(file);
+      }
+      // every rank gives up if the master can't read the file
+      MPI_Bcast(&nopen, 1, MPI_INT, master, MCW);
+      if(nopen)
+      {
+         Delloc1D(taxx);
+         Delloc1D(tayy);
+         Delloc1D(tazz);
+         Delloc1D(taxz);
+         Delloc1D(tayz);
+         Delloc1D(taxy);
+         Delloc1P(tpsrc);
+         return -1;
       }
       MPI_Bcast(tpsrc, NSRC*maxdim,    MPI_INT,  master, MCW);
       MPI_Bcast(taxx,  NSRC*READ_STEP, MPI_REAL, master, MCW);
@@ -324,3 +343,114 @@ void addsrc(int i,      float DH,   float DT,   int NST,    int npsrc,  int READ
   }
   return;
 }
+
+// Coarse source (--SRCDT): the file holds nstc samples at SRCDT instead of
+// NST samples at DT. All samples of the local subfaults are kept, sample m of
+// subfault j at a[j*hstride+m+1]; the pads before and after repeat the first
+// and last sample so the interpolation never reads past the ends.
+// Time step n is at time n*DT, the sample addsrc/addsrc_H add at step n of a
+// DT file: their index is 1-based (source_step, read at source_step-1), and
+// source_step is 1 for the initial step 0 and pre-incremented every step.
+int inisource_coarse(int      rank,    int     IFAULT, int     NSRC,   int     READ_STEP, int     nstc,    int     hstride,
+                     int     *SRCPROC, int     NZ,     MPI_Comm MCW,   int     nxt,       int     nyt,     int     nzt,
+                     int     *coords,  int     maxdim, int     *NPSRC, PosInf  *ptpsrc,
+                     Grid1D  *ptaxx,   Grid1D  *ptayy, Grid1D  *ptazz, Grid1D  *ptaxz,    Grid1D  *ptayz,  Grid1D *ptaxy,
+                     char    *INSRC,   char    *INSRC_I2)
+{
+   Grid1D a[6] = {NULL, NULL, NULL, NULL, NULL, NULL}, f[6];
+   Grid1D *pa[6] = {ptaxx, ptayy, ptazz, ptaxz, ptayz, ptaxy};
+   int    rs, c, j, m, v, err;
+
+   // IFAULT=2 files come in chunks of READ_STEP samples, the others at once
+   rs  = (IFAULT==2 ? READ_STEP : nstc);
+   err = inisource(rank, IFAULT, NSRC, rs, nstc, SRCPROC, NZ, MCW, nxt, nyt, nzt, coords, maxdim, NPSRC,
+                   ptpsrc, &a[0], &a[1], &a[2], &a[3], &a[4], &a[5], INSRC, INSRC_I2);
+   if(err || *NPSRC<=0)
+      return err;
+   for(v=0;v<6;v++)
+      f[v] = Alloc1D((*NPSRC)*hstride);
+   for(c=0;c*rs<nstc;c++)
+   {
+      if(c>0 && read_src_ifault_2(rank, rs, INSRC, INSRC_I2, maxdim, coords, NZ, nxt, nyt, nzt, NPSRC, SRCPROC,
+                                  ptpsrc, &a[0], &a[1], &a[2], &a[3], &a[4], &a[5], c+1))
+      {
+         for(v=0;v<6;v++)
+         {
+            Delloc1D(a[v]);
+            Delloc1D(f[v]);
+         }
+         return -1;
+      }
+      for(v=0;v<6;v++)
+        for(j=0;j<*NPSRC;j++)
+          for(m=0;m<rs && c*rs+m<nstc;m++)
+            f[v][j*hstride+c*rs+m+1] = a[v][j*rs+m];
+   }
+   for(v=0;v<6;v++)
+   {
+      for(j=0;j<*NPSRC;j++)
+      {
+         f[v][j*hstride] = f[v][j*hstride+1];
+         for(m=nstc+1;m<hstride;m++)
+            f[v][j*hstride+m] = f[v][j*hstride+nstc];
+      }
+      Delloc1D(a[v]);
+      *pa[v] = f[v];
+   }
+   return 0;
+}
+
+// weights c[0..3] of the coarse samples m-1..m+2 at fine step n, returns m
+long srcweights(long n, float DT, float SRCDT, int SRCINTERP, float *c)
+{
+   double x, w;
+   long   m;
+
+   x = n*(double)DT/SRCDT;
+   m = (long)floor(x+0.5);
+   // exact sample, also when DT/SRCDT is not exact in floats
+   if(fabs(x-m)>1.0e-6)
+      m = (long)floor(x);
+   w = (fabs(x-m)>1.0e-6 ? x-m : 0.0);
+   if(SRCINTERP==1)
+   {
+      c[0] = 0.0;
+      c[1] = 1.0-w;
+      c[2] = w;
+      c[3] = 0.0;
+   }
+   else
+   {
+      // Catmull-Rom
+      c[0] = w*(-0.5+w*(1.0-0.5*w));
+      c[1] = 1.0+w*w*(-2.5+1.5*w);
+      c[2] = w*(0.5+w*(2.0-1.5*w));
+      c[3] = w*w*(-0.5+0.5*w);
+   }
+   return m;
+}
+
+// addsrc of an interpolated coarse source, sample m-1 of subfault j at a[j*stride+o]
+void addsrci(int o,      float *c,   float DH,   float DT,   int npsrc,  int stride, int dim, PosInf psrc,
+             Grid1D axx, Grid1D ayy, Grid1D azz, Grid1D axz, Grid1D ayz, Grid1D axy,
+             Grid3D xx,  Grid3D yy,  Grid3D zz,  Grid3D xy,  Grid3D yz,  Grid3D xz)
+{
+  float vtst;
+  int idx, idy, idz, j, p;
+  vtst = (float)DT/(DH*DH*DH);
+
+  for(j=0;j<npsrc;j++)
+  {
+     idx = psrc[j*dim]   + 1 + 4*loop;
+     idy = psrc[j*dim+1] + 1 + 4*loop;
+     idz = psrc[j*dim+2] + align - 1;
+     p   = j*stride+o;
+     xx[idx][idy][idz] = xx[idx][idy][idz] - vtst*(c[0]*axx[p]+c[1]*axx[p+1]+c[2]*axx[p+2]+c[3]*axx[p+3]);
+     yy[idx][idy][idz] = yy[idx][idy][idz] - vtst*(c[0]*ayy[p]+c[1]*ayy[p+1]+c[2]*ayy[p+2]+c[3]*ayy[p+3]);
+     zz[idx][idy][idz] = zz[idx][idy][idz] - vtst*(c[0]*azz[p]+c[1]*azz[p+1]+c[2]*azz[p+2]+c[3]*azz[p+3]);
+     xz[idx][idy][idz] = xz[idx][idy][idz] - vtst*(c[0]*axz[p]+c[1]*axz[p+1]+c[2]*axz[p+2]+c[3]*axz[p+3]);
+     yz[idx][idy][idz] = yz[idx][idy][idz] - vtst*(c[0]*ayz[p]+c[1]*ayz[p+1]+c[2]*ayz[p+2]+c[3]*ayz[p+3]);
+     xy[idx][idy][idz] = xy[idx][idy][idz] - vtst*(c[0]*axy[p]+c[1]*axy[p+1]+c[2]*axy[p+2]+c[3]*axy[p+3]);
+  }
+  return;
+}
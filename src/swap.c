@@ -357,6 +357,26 @@ void Cpy2Device_source(int npsrc, int READ_STEP,
 return;
 }
 
+// window of a coarse source: host offsets base..base+win-1 of every subfault (stride hstride)
+// to a device array of stride win
+void Cpy2Device_srcwin(int npsrc, int win, int hstride, int base,
+      Grid1D taxx, Grid1D tayy, Grid1D tazz,
+      Grid1D taxz, Grid1D tayz, Grid1D taxy,
+      float *d_taxx, float *d_tayy, float *d_tazz,
+      float *d_taxz, float *d_tayz, float *d_taxy){
+
+      Grid1D h[6] = {taxx, tayy, tazz, taxz, tayz, taxy};
+      float  *d[6] = {d_taxx, d_tayy, d_tazz, d_taxz, d_tayz, d_taxy};
+      int    v;
+      cudaError_t cerr;
+      for(v=0;v<6;v++)
+      {
+         cerr=cudaMemcpy2D(d[v], sizeof(float)*win, h[v]+base, sizeof(float)*hstride, sizeof(float)*win, npsrc, cudaMemcpyHostToDevice);
+         if(cerr!=cudaSuccess) printf("CUDA ERROR: Cpy2Device_srcwin: %s\n",cudaGetErrorString(cerr));
+      }
+return;
+}
+
 void Cpy2Host_VX(float* u1, float* v1, float* w1, float* h_m, int nxt, int nyt, int nzt, cudaStream_t St, int rank, int flag)
 {
 	int d_offset=0, h_offset=0, msg_size=0;